@@ -0,0 +1,284 @@
+#include "clustered.h"
+#include "parallel.h"
+#include "shadervariants.h"
+#include "shadows.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define STRAING_SSE 1
+#endif
+
+namespace {
+
+GLTexture CreateBufferTexture(GLuint buffer, GLenum format)
+{
+    GLTexture texture = GLTexture::create();
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return texture;
+}
+
+template <typename T>
+void UploadStream(GLuint buffer, const std::vector<T>& data)
+{
+    // Orphaned every frame; the previous contents may still be in flight.
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(T), data.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+}
+
+bool ClusteredLighting::init()
+{
+    shader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/gbuffer.vertex.shader" },
+                              { GL_FRAGMENT_SHADER, "shaders/clustered.fragment.shader" },
+                              { GL_FRAGMENT_SHADER, "shaders/sunshadow.fragment.shader" } },
+                            ShaderFeatureTextured);
+    if (shader.get(0) == 0) {
+        shader = ShaderVariants();
+        return false;
+    }
+
+    gridBuffer = GLBuffer::create();
+    indexBuffer = GLBuffer::create();
+    lightBuffer = GLBuffer::create();
+    gridTexture = CreateBufferTexture(gridBuffer, GL_RG32UI);
+    indexTexture = CreateBufferTexture(indexBuffer, GL_R32UI);
+    lightTexture = CreateBufferTexture(lightBuffer, GL_RGBA32F);
+    slices.resize(Slices);
+    grid.assign(ClusterCount * 2, 0);
+    return true;
+}
+
+void ClusteredLighting::destroy()
+{
+    shader = ShaderVariants();
+    gridTexture.reset();
+    indexTexture.reset();
+    lightTexture.reset();
+    gridBuffer.reset();
+    indexBuffer.reset();
+    lightBuffer.reset();
+    slices.clear();
+    boundsWidth = boundsHeight = 0;
+    stats = {};
+}
+
+void ClusteredLighting::buildClusterBounds()
+{
+    // Reversing gluPerspective's depth terms gives the clip distances.
+    const glm::mat4& projection = boundsProjection;
+    nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    glm::mat4 inverseProjection = glm::inverse(projection);
+    auto nearPoint = [&](float ndcX, float ndcY) {
+        glm::vec4 point = inverseProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+        return glm::vec3(point) / point.w;
+    };
+
+    clusterMin.resize(ClusterCount);
+    clusterMax.resize(ClusterCount);
+    for (int slice = 0; slice < Slices; ++slice) {
+        float sliceNear = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(slice) / Slices);
+        float sliceFar = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(slice + 1) / Slices);
+        for (int y = 0; y < TilesY; ++y) {
+            for (int x = 0; x < TilesX; ++x) {
+                // The tile's lower-left and upper-right rays bound it on
+                // both slice planes, so four points give the box.
+                glm::vec3 low = nearPoint(-1.0f + 2.0f * x / TilesX, -1.0f + 2.0f * y / TilesY);
+                glm::vec3 high = nearPoint(-1.0f + 2.0f * (x + 1) / TilesX, -1.0f + 2.0f * (y + 1) / TilesY);
+                glm::vec3 points[4] = { low * (sliceNear / -low.z), low * (sliceFar / -low.z),
+                                        high * (sliceNear / -high.z), high * (sliceFar / -high.z) };
+                int cluster = (slice * TilesY + y) * TilesX + x;
+                clusterMin[cluster] = clusterMax[cluster] = points[0];
+                for (const glm::vec3& point : points) {
+                    clusterMin[cluster] = glm::min(clusterMin[cluster], point);
+                    clusterMax[cluster] = glm::max(clusterMax[cluster], point);
+                }
+            }
+        }
+    }
+}
+
+void ClusteredLighting::binSlice(int slice)
+{
+    SliceBins& bins = slices[slice];
+    const int firstCluster = slice * TilesX * TilesY;
+    // Every cluster of a slice spans the same depth, so lights outside it
+    // are rejected once for the whole slice.
+    float sliceNear = -clusterMax[firstCluster].z;
+    float sliceFar = -clusterMin[firstCluster].z;
+
+    bins.candidates.clear();
+    bins.x.clear();
+    bins.y.clear();
+    bins.z.clear();
+    bins.radiusSq.clear();
+    for (size_t i = 0; i < lightX.size(); ++i) {
+        float depth = -lightZ[i];
+        if (depth + lightRadius[i] < sliceNear || depth - lightRadius[i] > sliceFar)
+            continue;
+        bins.candidates.push_back(static_cast<uint32_t>(i));
+        bins.x.push_back(lightX[i]);
+        bins.y.push_back(lightY[i]);
+        bins.z.push_back(lightZ[i]);
+        bins.radiusSq.push_back(lightRadius[i] * lightRadius[i]);
+    }
+    // Padding can never pass: any distance exceeds a negative radius.
+    while (bins.x.size() % 4 != 0) {
+        bins.x.push_back(0.0f);
+        bins.y.push_back(0.0f);
+        bins.z.push_back(0.0f);
+        bins.radiusSq.push_back(-1.0f);
+    }
+
+    bins.indices.clear();
+    for (int tile = 0; tile < TilesX * TilesY; ++tile) {
+        const glm::vec3& boxMin = clusterMin[firstCluster + tile];
+        const glm::vec3& boxMax = clusterMax[firstCluster + tile];
+        size_t first = bins.indices.size();
+#ifdef STRAING_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 minX = _mm_set1_ps(boxMin.x), minY = _mm_set1_ps(boxMin.y), minZ = _mm_set1_ps(boxMin.z);
+        const __m128 maxX = _mm_set1_ps(boxMax.x), maxY = _mm_set1_ps(boxMax.y), maxZ = _mm_set1_ps(boxMax.z);
+        for (size_t i = 0; i < bins.x.size(); i += 4) {
+            // Distance from each sphere centre to the box, per axis.
+            __m128 cx = _mm_loadu_ps(&bins.x[i]);
+            __m128 cy = _mm_loadu_ps(&bins.y[i]);
+            __m128 cz = _mm_loadu_ps(&bins.z[i]);
+            __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minX, cx), zero), _mm_max_ps(_mm_sub_ps(cx, maxX), zero));
+            __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minY, cy), zero), _mm_max_ps(_mm_sub_ps(cy, maxY), zero));
+            __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minZ, cz), zero), _mm_max_ps(_mm_sub_ps(cz, maxZ), zero));
+            __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            int mask = _mm_movemask_ps(_mm_cmple_ps(distanceSq, _mm_loadu_ps(&bins.radiusSq[i])));
+            while (mask != 0) {
+                int lane = __builtin_ctz(static_cast<unsigned>(mask));
+                bins.indices.push_back(bins.candidates[i + lane]);
+                mask &= mask - 1;
+            }
+        }
+#else
+        for (size_t i = 0; i < bins.candidates.size(); ++i) {
+            glm::vec3 center(bins.x[i], bins.y[i], bins.z[i]);
+            glm::vec3 d = glm::max(boxMin - center, glm::vec3(0.0f)) + glm::max(center - boxMax, glm::vec3(0.0f));
+            if (glm::dot(d, d) <= bins.radiusSq[i])
+                bins.indices.push_back(bins.candidates[i]);
+        }
+#endif
+        bins.counts[tile] = static_cast<uint32_t>(bins.indices.size() - first);
+    }
+}
+
+void ClusteredLighting::update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                               int width, int height)
+{
+    stats = {};
+    if (!isReady() || width <= 0 || height <= 0)
+        return;
+    auto start = std::chrono::steady_clock::now();
+
+    if (projection != boundsProjection || width != boundsWidth || height != boundsHeight) {
+        boundsProjection = projection;
+        boundsWidth = width;
+        boundsHeight = height;
+        buildClusterBounds();
+    }
+
+    size_t count = lights.size();
+    lightX.resize(count);
+    lightY.resize(count);
+    lightZ.resize(count);
+    lightRadius.resize(count);
+    lightData.resize(std::max<size_t>(count, 1) * 2);
+    for (size_t i = 0; i < count; ++i) {
+        glm::vec3 position = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+        lightX[i] = position.x;
+        lightY[i] = position.y;
+        lightZ[i] = position.z;
+        lightRadius[i] = lights[i].radius;
+        lightData[i * 2] = glm::vec4(lights[i].position, lights[i].radius);
+        lightData[i * 2 + 1] = glm::vec4(lights[i].color * lights[i].intensity, 0.0f);
+    }
+
+    ParallelFor(Slices, 1, [&](size_t begin, size_t end) {
+        for (size_t slice = begin; slice < end; ++slice)
+            binSlice(static_cast<int>(slice));
+    });
+
+    // Concatenate the slices' lists; clusters are numbered slice-major.
+    indices.clear();
+    for (int slice = 0; slice < Slices; ++slice) {
+        const SliceBins& bins = slices[slice];
+        uint32_t offset = static_cast<uint32_t>(indices.size());
+        for (int tile = 0; tile < TilesX * TilesY; ++tile) {
+            int cluster = slice * TilesX * TilesY + tile;
+            grid[cluster * 2] = offset;
+            grid[cluster * 2 + 1] = bins.counts[tile];
+            offset += bins.counts[tile];
+            stats.occupiedClusters += bins.counts[tile] > 0 ? 1 : 0;
+            stats.maxClusterLights = std::max(stats.maxClusterLights, bins.counts[tile]);
+        }
+        indices.insert(indices.end(), bins.indices.begin(), bins.indices.end());
+    }
+    stats.lights = static_cast<uint32_t>(count);
+    stats.lightIndices = static_cast<uint32_t>(indices.size());
+    if (indices.empty())
+        indices.push_back(0);
+
+    UploadStream(gridBuffer, grid);
+    UploadStream(indexBuffer, indices);
+    UploadStream(lightBuffer, lightData);
+
+    inverseViewProjection = glm::inverse(projection * view);
+    screenSize = glm::vec2(static_cast<float>(width), static_cast<float>(height));
+    stats.binMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ClusteredLighting::bind(const glm::vec3& cameraPosition) const
+{
+    const GLTexture* textures[] = { &gridTexture, &indexTexture, &lightTexture };
+    for (GLuint i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE1 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, *textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    // Uniforms are per program, so every variant a draw may pick gets them.
+    uint32_t supported = shader.getSupportedFeatures();
+    for (uint32_t features = 0; features <= supported; ++features) {
+        GLuint program = (features & ~supported) == 0 ? shader.get(features) : 0;
+        if (program != 0)
+            bindUniforms(program, cameraPosition);
+    }
+}
+
+void ClusteredLighting::bindUniforms(GLuint program, const glm::vec3& cameraPosition) const
+{
+    glUseProgram(program);
+    const char* samplers[] = { "uClusterGrid", "uLightIndices", "uLightData" };
+    for (GLint i = 0; i < 3; ++i)
+        glUniform1i(glGetUniformLocation(program, samplers[i]), i + 1);
+
+    float sliceScale = Slices / std::log(farPlane / nearPlane);
+    glUniform3i(glGetUniformLocation(program, "uClusterCount"), TilesX, TilesY, Slices);
+    glUniform2f(glGetUniformLocation(program, "uTileSize"), screenSize.x / TilesX, screenSize.y / TilesY);
+    glUniform2f(glGetUniformLocation(program, "uDepthRange"), nearPlane, farPlane);
+    glUniform2f(glGetUniformLocation(program, "uSliceScaleBias"), sliceScale, -sliceScale * std::log(nearPlane));
+    glUniformMatrix4fv(glGetUniformLocation(program, "uInverseViewProjection"), 1, GL_FALSE,
+                       glm::value_ptr(inverseViewProjection));
+    glUniform2f(glGetUniformLocation(program, "uInvScreenSize"), 1.0f / screenSize.x, 1.0f / screenSize.y);
+    glUniform3fv(glGetUniformLocation(program, "uViewPos"), 1, glm::value_ptr(cameraPosition));
+    glm::vec3 sun = glm::normalize(sunDirection);
+    glUniform3fv(glGetUniformLocation(program, "uSunDirection"), 1, glm::value_ptr(sun));
+    glUniform3fv(glGetUniformLocation(program, "uSunColor"), 1, glm::value_ptr(sunColor));
+    glUniform1f(glGetUniformLocation(program, "uAmbient"), ambient);
+    glUniform1i(glGetUniformLocation(program, "uShowClusterLoad"), showClusterLoad ? 1 : 0);
+    BindShadowUniforms(shadows, program, 4);
+}
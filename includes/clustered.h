@@ -0,0 +1,88 @@
+#pragma once
+
+#include "def.h"
+#include "lights.h"
+#include "shadervariants.h"
+#include <cstdint>
+
+class CascadedShadowMaps;
+
+struct ClusteredStats {
+    uint32_t lights;
+    uint32_t occupiedClusters;
+    uint32_t lightIndices;
+    uint32_t maxClusterLights;
+    float binMs;
+};
+
+// Clustered forward shading. The view frustum is split into a screen-space
+// tile grid and exponentially spaced depth slices; every frame the worker
+// pool bins the point lights into those clusters, four lights per SSE test,
+// and the lists go to texture buffers:
+//   grid     RG32UI   first index and light count per cluster
+//   indices  R32UI    light indices, cluster after cluster
+//   lights   RGBA32F  two texels per light: position and radius, colour
+// Each fragment then loops over its own cluster's lights only. Nothing is
+// stored per pixel, so MSAA and blending work as in plain forward.
+class ClusteredLighting {
+public:
+    static constexpr int TilesX = 16;
+    static constexpr int TilesY = 9;
+    static constexpr int Slices = 24;
+    static constexpr int ClusterCount = TilesX * TilesY * Slices;
+
+    bool init();
+    void destroy();
+    bool isReady() const { return shader.get(0) != 0; }
+
+    // Bins `lights` for this view and uploads the lists.
+    void update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                int width, int height);
+    // Binds the light buffers and sets the per-frame uniforms of every
+    // variant of getShader(). Draw with them right after; mesh draws only
+    // touch texture unit 0.
+    void bind(const glm::vec3& cameraPosition) const;
+
+    const ShaderVariants& getShader() const { return shader; }
+    const ClusteredStats& getStats() const { return stats; }
+
+    glm::vec3 sunDirection = glm::vec3(-0.4f, -1.0f, -0.3f);
+    glm::vec3 sunColor = glm::vec3(0.6f);
+    float ambient = 0.25f;
+    // Colours each pixel by the number of lights in its cluster.
+    bool showClusterLoad = false;
+    // Sun shadows, if any.
+    const CascadedShadowMaps* shadows = nullptr;
+
+private:
+    void buildClusterBounds();
+    void binSlice(int slice);
+    void bindUniforms(GLuint program, const glm::vec3& cameraPosition) const;
+
+    ShaderVariants shader;
+    GLBuffer gridBuffer, indexBuffer, lightBuffer;
+    GLTexture gridTexture, indexTexture, lightTexture;
+
+    // View-space cluster bounds, rebuilt when the projection or size changes.
+    glm::mat4 boundsProjection = glm::mat4(0.0f);
+    int boundsWidth = 0, boundsHeight = 0;
+    std::vector<glm::vec3> clusterMin, clusterMax;
+    float nearPlane = 0.1f, farPlane = 100.0f;
+
+    // Lights in view space, structure-of-arrays for the SSE test.
+    std::vector<float> lightX, lightY, lightZ, lightRadius;
+    // Per-slice candidate lists and results, so slices bin independently.
+    struct SliceBins {
+        std::vector<uint32_t> candidates;
+        std::vector<float> x, y, z, radiusSq;
+        std::vector<uint32_t> indices;
+        uint32_t counts[TilesX * TilesY];
+    };
+    std::vector<SliceBins> slices;
+    std::vector<uint32_t> grid;        // offset, count pairs
+    std::vector<uint32_t> indices;
+    std::vector<glm::vec4> lightData;
+    glm::mat4 inverseViewProjection = glm::mat4(1.0f);
+    glm::vec2 screenSize = glm::vec2(1.0f);
+    ClusteredStats stats{};
+};
@@ -0,0 +1,188 @@
+#include "culling.h"
+#include "transforms.h"
+
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define STRAING_SSE 1
+#endif
+
+Frustum ExtractFrustum(const glm::mat4& viewProjection)
+{
+    // Gribb/Hartmann: each plane is the sum or difference of the fourth row and one other row.
+    const glm::mat4& m = viewProjection;
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0; // left
+    frustum.planes[1] = row3 - row0; // right
+    frustum.planes[2] = row3 + row1; // bottom
+    frustum.planes[3] = row3 - row1; // top
+    frustum.planes[4] = row3 + row2; // near
+    frustum.planes[5] = row3 - row2; // far
+
+    for (glm::vec4& plane : frustum.planes) {
+        float len = glm::length(glm::vec3(plane));
+        if (len > 0.0f)
+            plane /= len;
+    }
+    return frustum;
+}
+
+BoundingSphere SphereFromAABB(const AABB& box)
+{
+    BoundingSphere sphere;
+    sphere.center = (box.min + box.max) * 0.5f;
+    sphere.radius = glm::length(box.max - box.min) * 0.5f;
+    return sphere;
+}
+
+AABB TransformAABB(const AABB& box, const glm::mat4& model)
+{
+    // Arvo's method: transform the centre, and the extent by the absolute 3x3 part.
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+    glm::vec3 newCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+    glm::vec3 newExtent(0.0f);
+    for (int col = 0; col < 3; ++col) {
+        newExtent += glm::abs(glm::vec3(model[col])) * extent[col];
+    }
+    return { newCenter - newExtent, newCenter + newExtent };
+}
+
+glm::mat4 SceneObjectModel(const SceneObject& object)
+{
+    return ComposeTransform(object.position, object.rotation, object.scale);
+}
+
+void UpdateSceneObjectBounds(SceneObject& object)
+{
+    glm::mat4 model = SceneObjectModel(object);
+    object.worldBounds = TransformAABB(object.mesh->bounds, model);
+
+    float maxScale = glm::max(glm::abs(object.scale.x), glm::max(glm::abs(object.scale.y), glm::abs(object.scale.z)));
+    object.worldSphere.center = glm::vec3(model * glm::vec4(object.mesh->sphere.center, 1.0f));
+    object.worldSphere.radius = object.mesh->sphere.radius * maxScale;
+}
+
+bool SphereInFrustum(const Frustum& frustum, const BoundingSphere& sphere)
+{
+    for (const glm::vec4& plane : frustum.planes) {
+        if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+            return false;
+    }
+    return true;
+}
+
+bool AABBInFrustum(const Frustum& frustum, const AABB& box)
+{
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+    for (const glm::vec4& plane : frustum.planes) {
+        glm::vec3 normal = glm::vec3(plane);
+        float d = glm::dot(normal, center) + plane.w;
+        float r = glm::dot(glm::abs(normal), extent);
+        if (d + r < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void FrustumCuller::resize(size_t newCount)
+{
+    count = newCount;
+    size_t padded = (newCount + 3) & ~size_t(3);
+    for (std::vector<float>* lane : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ,
+                                      &sphereX, &sphereY, &sphereZ, &sphereR }) {
+        lane->assign(padded, 0.0f);
+    }
+}
+
+void FrustumCuller::set(size_t index, const AABB& box, const BoundingSphere& sphere)
+{
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    extentX[index] = extent.x;
+    extentY[index] = extent.y;
+    extentZ[index] = extent.z;
+    sphereX[index] = sphere.center.x;
+    sphereY[index] = sphere.center.y;
+    sphereZ[index] = sphere.center.z;
+    sphereR[index] = sphere.radius;
+}
+
+void FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible)
+{
+    size_t firstVisible = visible.size();
+
+#ifdef STRAING_SSE
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    __m128 absX[6], absY[6], absZ[6];
+    for (int p = 0; p < 6; ++p) {
+        const glm::vec4& plane = frustum.planes[p];
+        planeX[p] = _mm_set1_ps(plane.x);
+        planeY[p] = _mm_set1_ps(plane.y);
+        planeZ[p] = _mm_set1_ps(plane.z);
+        planeW[p] = _mm_set1_ps(plane.w);
+        absX[p] = _mm_set1_ps(std::fabs(plane.x));
+        absY[p] = _mm_set1_ps(std::fabs(plane.y));
+        absZ[p] = _mm_set1_ps(std::fabs(plane.z));
+    }
+    const __m128 zero = _mm_setzero_ps();
+
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 cx = _mm_loadu_ps(&centerX[i]);
+        __m128 cy = _mm_loadu_ps(&centerY[i]);
+        __m128 cz = _mm_loadu_ps(&centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&extentX[i]);
+        __m128 ey = _mm_loadu_ps(&extentY[i]);
+        __m128 ez = _mm_loadu_ps(&extentZ[i]);
+        __m128 sx = _mm_loadu_ps(&sphereX[i]);
+        __m128 sy = _mm_loadu_ps(&sphereY[i]);
+        __m128 sz = _mm_loadu_ps(&sphereZ[i]);
+        __m128 negR = _mm_sub_ps(zero, _mm_loadu_ps(&sphereR[i]));
+
+        __m128 outside = zero;
+        for (int p = 0; p < 6; ++p) {
+            __m128 ds = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], sx), _mm_mul_ps(planeY[p], sy)),
+                                   _mm_add_ps(_mm_mul_ps(planeZ[p], sz), planeW[p]));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(ds, negR));
+
+            __m128 db = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                                   _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+            __m128 rb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+                                   _mm_mul_ps(absZ[p], ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(db, rb), zero));
+        }
+
+        int insideMask = ~_mm_movemask_ps(outside) & 0xF;
+        while (insideMask) {
+            int lane = __builtin_ctz(insideMask);
+            insideMask &= insideMask - 1;
+            if (i + lane < count)
+                visible.push_back(static_cast<uint32_t>(i + lane));
+        }
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        BoundingSphere sphere{ glm::vec3(sphereX[i], sphereY[i], sphereZ[i]), sphereR[i] };
+        glm::vec3 center(centerX[i], centerY[i], centerZ[i]);
+        glm::vec3 extent(extentX[i], extentY[i], extentZ[i]);
+        if (SphereInFrustum(frustum, sphere) && AABBInFrustum(frustum, { center - extent, center + extent }))
+            visible.push_back(static_cast<uint32_t>(i));
+    }
+#endif
+
+    stats.tested = static_cast<uint32_t>(count);
+    stats.visible = static_cast<uint32_t>(visible.size() - firstVisible);
+    stats.culled = stats.tested - stats.visible;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "def.h"
+#include <cstdint>
+
+// Planes are stored as (normal, distance) with normals pointing into the frustum.
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+struct CullingStats {
+    uint32_t tested;
+    uint32_t visible;
+    uint32_t culled;
+};
+
+Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+BoundingSphere SphereFromAABB(const AABB& box);
+AABB TransformAABB(const AABB& box, const glm::mat4& model);
+glm::mat4 SceneObjectModel(const SceneObject& object);
+void UpdateSceneObjectBounds(SceneObject& object);
+
+// Scalar reference tests, used for single objects and by the spatial structures.
+bool SphereInFrustum(const Frustum& frustum, const BoundingSphere& sphere);
+bool AABBInFrustum(const Frustum& frustum, const AABB& box);
+
+// Bounds of every drawable in structure-of-arrays layout so that the
+// per-frame test can run four objects per SSE instruction.
+class FrustumCuller {
+public:
+    void resize(size_t count);
+    size_t size() const { return count; }
+    void set(size_t index, const AABB& box, const BoundingSphere& sphere);
+
+    // Appends the indices of all objects touching the frustum to `visible`.
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible);
+
+    const CullingStats& getStats() const { return stats; }
+
+private:
+    size_t count = 0;
+    // AABB centre / half extent and sphere centre / radius, padded to a multiple of 4.
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<float> sphereX, sphereY, sphereZ, sphereR;
+    CullingStats stats{};
+};
@@ -1 +1,179 @@
-#pragma once
\ No newline at end of file
+#pragma once
+
+#include <glad.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <memory>
+#include <glm/glm.hpp>
+
+#include "glresource.h"
+#include "resourcemanager.h"
+
+struct Color {
+    float r;
+    float g;
+    float b;
+    float a;
+};
+
+struct Camera {
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+
+    bool operator==(const Vertex& other) const {
+        return Position == other.Position &&
+               Normal == other.Normal &&
+               TexCoords == other.TexCoords;
+    }
+};
+
+struct Texture {
+    GLTexture id;
+    std::string type;
+    std::string path;
+};
+
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+// One level of detail: a range of the mesh's element buffer and its
+// object-space geometric error.
+struct MeshLOD {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error;
+};
+
+// What a mesh keeps in system memory once its buffers are uploaded.
+enum class MeshResidency {
+    KeepCPU,           // vertices and indices stay
+    DropAfterUpload,   // both go; reloaded from the mesh cache when needed
+    CollisionOnly,     // positions and indices stay for picking and occlusion
+};
+
+class TriangleBVH;
+struct OccluderMesh;
+struct MeshletSet;
+struct ObjectMatrices;
+
+class Mesh {
+public:
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Texture> textures;
+    // Set by upload(), so they survive the arrays being dropped.
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    GLVertexArray VAO;
+    GLBuffer VBO, EBO;
+    // Tightly packed copy of the positions and a vertex array that reads only
+    // it, for depth-only passes: 12 bytes fetched per vertex instead of 32.
+    bool positionStream = true;
+    GLVertexArray depthVAO;
+    GLBuffer positionVBO;
+
+    // Object-space bounds, filled in by the loaders.
+    AABB bounds;
+    BoundingSphere sphere;
+
+    // Filled in by GenerateMeshLODs(). Level 0 is `indices`; coarser levels
+    // reuse the same vertices and live in lodIndices, packed after it in the EBO.
+    std::vector<MeshLOD> lods;
+    std::vector<unsigned int> lodIndices;
+
+    // Built on demand by GetMeshBVH() for ray queries.
+    std::shared_ptr<TriangleBVH> bvh;
+    // Built on demand by GetMeshOccluder() for software occlusion culling.
+    std::shared_ptr<OccluderMesh> occluder;
+    // Built on demand by GetMeshMeshlets() for cluster culling.
+    std::shared_ptr<MeshletSet> meshlets;
+
+    // See ApplyMeshResidency(). geometryHash keys the dropped arrays in the
+    // mesh cache; collisionPositions is only filled under CollisionOnly.
+    MeshResidency residency = MeshResidency::KeepCPU;
+    uint64_t geometryHash = 0;
+    std::vector<glm::vec3> collisionPositions;
+
+    // Registrations with the GPU resource manager, see TrackMeshResources().
+    std::vector<ResourceTicket> gpuResources;
+
+    // Takes the loader's arrays by value so callers can move them in.
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), bounds{}, sphere{}
+    {
+        upload();
+    }
+
+    Mesh() : bounds{}, sphere{} {}
+
+    // Owns its GL objects, so copies would alias them.
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    void setBounds(const AABB& box);
+    // (Re)creates the vertex arrays and buffers from the CPU-side arrays,
+    // LOD indices and the position stream included.
+    void upload();
+    // Creates the vertex arrays on the current buffers. Vertex arrays are not
+    // shared between contexts, so a mesh loaded on another one needs this
+    // before it is drawn here.
+    void bindVertexArrays();
+    void Draw(GLuint shader, const glm::mat4& view, const glm::mat4& projection, glm::vec3 position, float rotationAngleX, float rotationAngleY, float rotationAngleZ, glm::vec3 scale, int lod = 0);
+    // Draws an index range of any vertex array holding this mesh's geometry,
+    // either its own buffers or a shared pool at `baseVertex`.
+    void DrawIndexed(GLuint shader, const glm::mat4& view, const glm::mat4& projection, const glm::mat4& model,
+                     GLuint vertexArray, GLsizei indexCount, size_t indexOffset, GLint baseVertex = 0);
+    // Same, with the matrices computed up front by a TransformSystem.
+    void DrawIndexed(GLuint shader, const ObjectMatrices& matrices, GLuint vertexArray, GLsizei indexCount,
+                     size_t indexOffset, GLint baseVertex = 0);
+    // Depth and shadow passes: uploads nothing but uMVP and binds no textures.
+    void DrawDepth(GLuint shader, const glm::mat4& mvp, GLuint vertexArray, GLsizei indexCount, size_t indexOffset,
+                   GLint baseVertex = 0);
+};
+
+// A placed copy of a mesh in the scene.
+struct SceneObject {
+    Mesh* mesh;
+    glm::vec3 position;
+    glm::vec3 rotation;
+    glm::vec3 scale;
+
+    // World-space bounds, refreshed by UpdateSceneObjectBounds().
+    AABB worldBounds;
+    BoundingSphere worldSphere;
+
+    // Set whenever the transform changes so bounds and the scene BVH get refreshed.
+    bool dirty;
+    int32_t bvhProxy;
+
+    // Level of detail picked by SelectLOD() last frame.
+    int lod;
+};
+
+namespace std {
+    template<> struct hash<Vertex> {
+        size_t operator()(const Vertex& v) const {
+            size_t h1 = hash<float>()(v.Position.x) ^ (hash<float>()(v.Position.y) << 1) ^ (hash<float>()(v.Position.z) << 2);
+            size_t h2 = hash<float>()(v.Normal.x) ^ (hash<float>()(v.Normal.y) << 1) ^ (hash<float>()(v.Normal.z) << 2);
+            size_t h3 = hash<float>()(v.TexCoords.x) ^ (hash<float>()(v.TexCoords.y) << 1);
+            return h1 ^ (h2 << 1) ^ (h3 << 2);
+        }
+    };
+}
@@ -0,0 +1,320 @@
+#include "deferred.h"
+#include "culling.h"
+#include "shaderutil.h"
+#include "shadervariants.h"
+#include "shadows.h"
+
+#include <cmath>
+#include <iostream>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+
+constexpr int VolumeSegments = 12;
+constexpr int VolumeRings = 8;
+
+GLTexture CreateTarget(GLint internalFormat, GLenum format, GLenum type, int width, int height)
+{
+    GLTexture texture = GLTexture::create();
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+bool FramebufferComplete(const char* name)
+{
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Deferred " << name << " framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void BindTexture(GLuint program, const char* name, GLuint unit, GLuint texture)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform1i(glGetUniformLocation(program, name), static_cast<GLint>(unit));
+}
+
+}
+
+bool DeferredRenderer::init()
+{
+    gbufferShader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/gbuffer.vertex.shader" },
+                                     { GL_FRAGMENT_SHADER, "shaders/gbuffer.fragment.shader" } },
+                                   ShaderFeatureTextured);
+    // Built through the program cache so that shader reloads reach them.
+    sunShader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/fullscreen.vertex.shader" },
+                                 { GL_FRAGMENT_SHADER, "shaders/deferredlight.fragment.shader" },
+                                 { GL_FRAGMENT_SHADER, "shaders/sunshadow.fragment.shader" } },
+                               0);
+    pointShader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/lightvolume.vertex.shader" },
+                                   { GL_FRAGMENT_SHADER, "shaders/deferredlight.fragment.shader" } },
+                                 0, "#define POINT_LIGHT\n");
+    compositeShader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/fullscreen.vertex.shader" },
+                                       { GL_FRAGMENT_SHADER, "shaders/composite.fragment.shader" } },
+                                     0);
+    if (!gbufferShader.get(0) || !sunShader.get(0) || !pointShader.get(0) || !compositeShader.get(0)) {
+        destroy();
+        return false;
+    }
+
+    // Low-poly UV sphere. Its faces cut inside the unit sphere, so it is
+    // scaled until the flattest face still clears the light's range.
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    for (int ring = 0; ring <= VolumeRings; ++ring) {
+        float theta = glm::radians(180.0f) * ring / VolumeRings;
+        for (int segment = 0; segment < VolumeSegments; ++segment) {
+            float phi = glm::radians(360.0f) * segment / VolumeSegments;
+            positions.push_back(glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+        }
+    }
+    for (int ring = 0; ring < VolumeRings; ++ring) {
+        for (int segment = 0; segment < VolumeSegments; ++segment) {
+            unsigned int a = ring * VolumeSegments + segment;
+            unsigned int b = ring * VolumeSegments + (segment + 1) % VolumeSegments;
+            unsigned int c = a + VolumeSegments, d = b + VolumeSegments;
+            indices.insert(indices.end(), { a, b, c, b, d, c });
+        }
+    }
+    volumeIndexCount = static_cast<GLsizei>(indices.size());
+    volumeScale = 1.0f / (std::cos(glm::radians(180.0f) / VolumeSegments) * std::cos(glm::radians(90.0f) / VolumeRings));
+
+    volumeVAO = GLVertexArray::create();
+    volumeVBO = GLBuffer::create();
+    volumeEBO = GLBuffer::create();
+    glBindVertexArray(volumeVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, volumeVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumeEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Full-screen passes generate their triangle from gl_VertexID.
+    emptyVAO = GLVertexArray::create();
+    return true;
+}
+
+void DeferredRenderer::destroy()
+{
+    for (ShaderVariants* shader : { &gbufferShader, &sunShader, &pointShader, &compositeShader })
+        *shader = ShaderVariants();
+    gbufferFBO.reset();
+    lightFBO.reset();
+    for (GLTexture* texture : { &albedoMetal, &normalRoughness, &depthStencil, &lightAccumulation, &lightDepthStencil })
+        texture->reset();
+    volumeVAO.reset();
+    emptyVAO.reset();
+    volumeVBO.reset();
+    volumeEBO.reset();
+    width = height = 0;
+    stats = {};
+}
+
+void DeferredRenderer::resize(int newWidth, int newHeight)
+{
+    if (!isReady() || newWidth <= 0 || newHeight <= 0 || (newWidth == width && newHeight == height))
+        return;
+    width = newWidth;
+    height = newHeight;
+
+    albedoMetal = CreateTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    normalRoughness = CreateTarget(GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, width, height);
+    depthStencil = CreateTarget(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+    lightAccumulation = CreateTarget(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height);
+    // The light passes test against scene depth and write stencil while
+    // sampling depth, so they get their own copy rather than a feedback loop.
+    lightDepthStencil = CreateTarget(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    gbufferFBO = GLFramebuffer::create();
+    glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoMetal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalRoughness, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthStencil, 0);
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    bool complete = FramebufferComplete("G-buffer");
+
+    lightFBO = GLFramebuffer::create();
+    glBindFramebuffer(GL_FRAMEBUFFER, lightFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lightAccumulation, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, lightDepthStencil, 0);
+    complete = FramebufferComplete("light") && complete;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!complete) {
+        destroy();
+        return;
+    }
+    // 4 + 4 + 4 bytes of G-buffer, 8 of accumulation and 4 of its depth.
+    stats.targetBytes = static_cast<size_t>(width) * height * 24;
+}
+
+void DeferredRenderer::beginGeometry()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+}
+
+void DeferredRenderer::resolve(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                               const glm::vec3& cameraPosition)
+{
+    size_t targetBytes = stats.targetBytes;
+    stats = {};
+    stats.targetBytes = targetBytes;
+    if (!gbufferFBO)
+        return;
+
+    glm::mat4 viewProjection = projection * view;
+    glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+    GLuint sunProgram = sunShader.get(0), pointProgram = pointShader.get(0), compositeProgram = compositeShader.get(0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gbufferFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, lightFBO);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, lightFBO);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClearStencil(0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    auto bindGBuffer = [&](GLuint program) {
+        glUseProgram(program);
+        BindTexture(program, "uAlbedoMetal", 0, albedoMetal);
+        BindTexture(program, "uNormalRoughness", 1, normalRoughness);
+        BindTexture(program, "uDepth", 2, depthStencil);
+        glUniformMatrix4fv(glGetUniformLocation(program, "uInverseViewProjection"), 1, GL_FALSE,
+                           glm::value_ptr(inverseViewProjection));
+        glUniform2f(glGetUniformLocation(program, "uInvScreenSize"), 1.0f / width, 1.0f / height);
+        glUniform3fv(glGetUniformLocation(program, "uViewPos"), 1, glm::value_ptr(cameraPosition));
+    };
+
+    // Sun and ambient over the whole screen.
+    glDisable(GL_DEPTH_TEST);
+    bindGBuffer(sunProgram);
+    glm::vec3 sun = glm::normalize(sunDirection);
+    glUniform3fv(glGetUniformLocation(sunProgram, "uSunDirection"), 1, glm::value_ptr(sun));
+    glUniform3fv(glGetUniformLocation(sunProgram, "uSunColor"), 1, glm::value_ptr(sunColor));
+    glUniform1f(glGetUniformLocation(sunProgram, "uAmbient"), ambient);
+    BindShadowUniforms(shadows, sunProgram, 3);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    // Point lights.
+    bindGBuffer(pointProgram);
+    glUniformMatrix4fv(glGetUniformLocation(pointProgram, "uViewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform1i(glGetUniformLocation(pointProgram, "uPointShadow"), 3);
+    // Looked up once here rather than per light; a reload may have replaced the program.
+    VolumeUniforms volumeUniforms{ glGetUniformLocation(pointProgram, "uPointShadowed"),
+                                   glGetUniformLocation(pointProgram, "uLightPosition"),
+                                   glGetUniformLocation(pointProgram, "uLightRadius"),
+                                   glGetUniformLocation(pointProgram, "uVolumeRadius"),
+                                   glGetUniformLocation(pointProgram, "uLightColor") };
+    glBindVertexArray(volumeVAO);
+    glEnable(GL_CULL_FACE);
+    Frustum frustum = ExtractFrustum(viewProjection);
+    // A volume reaching within the near plane distance may be clipped.
+    float nearDistance = projection[3][2] / (projection[2][2] - 1.0f);
+    for (size_t i = 0; i < lights.size(); ++i) {
+        const PointLight& light = lights[i];
+        stats.lights++;
+        float volumeRadius = light.radius * volumeScale;
+        if (!SphereInFrustum(frustum, { light.position, volumeRadius })) {
+            stats.culled++;
+            continue;
+        }
+        bool inside = glm::length(cameraPosition - light.position) < volumeRadius + nearDistance + 0.05f;
+        drawVolume(light, volumeUniforms, pointShadows ? pointShadows->getShadowMap(i) : 0,
+                   inside || !stencilCulling);
+    }
+    glDisable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_BLEND);
+
+    // Resolve: lit colour and scene depth into the default framebuffer.
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_ALWAYS);
+    glUseProgram(compositeProgram);
+    BindTexture(compositeProgram, "uLight", 0, lightAccumulation);
+    BindTexture(compositeProgram, "uDepth", 1, depthStencil);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDepthFunc(GL_LESS);
+
+    glBindVertexArray(0);
+    for (GLuint unit = 0; unit < 3; ++unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void DeferredRenderer::drawVolume(const PointLight& light, const VolumeUniforms& uniforms, GLuint shadowMap,
+                                  bool cameraInside)
+{
+    glUniform1i(uniforms.shadowed, shadowMap != 0 ? 1 : 0);
+    if (shadowMap != 0) {
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, shadowMap);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    glUniform3fv(uniforms.position, 1, glm::value_ptr(light.position));
+    glUniform1f(uniforms.radius, light.radius);
+    glUniform1f(uniforms.volumeRadius, light.radius * volumeScale);
+    glm::vec3 color = light.color * light.intensity;
+    glUniform3fv(uniforms.color, 1, glm::value_ptr(color));
+
+    if (cameraInside) {
+        // Front faces may be behind the near plane; the back faces with a
+        // depth test still reject everything beyond the volume.
+        stats.cameraInside++;
+        glDisable(GL_STENCIL_TEST);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_GEQUAL);
+        glCullFace(GL_FRONT);
+        glDrawElements(GL_TRIANGLES, volumeIndexCount, GL_UNSIGNED_INT, 0);
+        glDepthFunc(GL_LESS);
+        return;
+    }
+
+    // Stencil: back faces behind the scene count up, front faces behind it
+    // count down. Non-zero means the surface is inside the volume.
+    stats.stencilTested++;
+    glEnable(GL_STENCIL_TEST);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_CULL_FACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glStencilFunc(GL_ALWAYS, 0, 0xFF);
+    glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+    glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+    glDrawElements(GL_TRIANGLES, volumeIndexCount, GL_UNSIGNED_INT, 0);
+
+    // Shade the marked pixels and zero them again, so the next light needs
+    // no stencil clear: the back faces cover every pixel the count touched.
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+    glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
+    glDrawElements(GL_TRIANGLES, volumeIndexCount, GL_UNSIGNED_INT, 0);
+}
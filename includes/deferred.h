@@ -0,0 +1,74 @@
+#pragma once
+
+#include "def.h"
+#include "lights.h"
+#include "shadervariants.h"
+#include <cstdint>
+
+class CascadedShadowMaps;
+class OmniShadowMaps;
+
+struct DeferredStats {
+    uint32_t lights;
+    uint32_t culled;          // outside the view frustum
+    uint32_t stencilTested;   // volume marked in the stencil buffer first
+    uint32_t cameraInside;    // camera within the volume: back faces only
+    size_t targetBytes;
+};
+
+// Deferred shading for scenes with many point lights. Opaque geometry fills
+// a 12-byte-per-pixel G-buffer:
+//   colour 0  RGBA8     albedo, metalness
+//   colour 1  RGB10_A2  octahedral normal, roughness
+//   depth     D24S8     reconstructs position
+// Each light then shades only the pixels whose surface lies inside its
+// sphere: the volume's faces are first counted in the stencil buffer against
+// the scene depth, then its back faces add the light where the count is
+// non-zero. The result is written to the default framebuffer with depth, so
+// forward passes can follow.
+class DeferredRenderer {
+public:
+    bool init();
+    void destroy();
+    bool isReady() const { return gbufferShader.get(0) != 0; }
+
+    // Reallocates the targets when the framebuffer size changes.
+    void resize(int width, int height);
+    // Binds and clears the G-buffer. Draw opaque geometry with getGeometryShader().
+    void beginGeometry();
+    // Accumulates the sun, ambient and `lights`, then resolves colour and
+    // depth to the default framebuffer.
+    void resolve(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                 const glm::vec3& cameraPosition);
+
+    const ShaderVariants& getGeometryShader() const { return gbufferShader; }
+    const DeferredStats& getStats() const { return stats; }
+
+    glm::vec3 sunDirection = glm::vec3(-0.4f, -1.0f, -0.3f);
+    glm::vec3 sunColor = glm::vec3(0.6f);
+    float ambient = 0.25f;
+    // Off: every volume is drawn back faces only with a depth test, which
+    // shades some pixels in front of the light for nothing.
+    bool stencilCulling = true;
+    // Sun shadows, if any.
+    const CascadedShadowMaps* shadows = nullptr;
+    // Cube-map shadows of some of the point lights, if any.
+    const OmniShadowMaps* pointShadows = nullptr;
+
+private:
+    struct VolumeUniforms {
+        GLint shadowed, position, radius, volumeRadius, color;
+    };
+    void drawVolume(const PointLight& light, const VolumeUniforms& uniforms, GLuint shadowMap, bool cameraInside);
+
+    ShaderVariants gbufferShader, sunShader, pointShader, compositeShader;
+    GLFramebuffer gbufferFBO, lightFBO;
+    GLTexture albedoMetal, normalRoughness, depthStencil, lightAccumulation;
+    GLTexture lightDepthStencil;   // depth copied in from the G-buffer each frame
+    GLVertexArray volumeVAO, emptyVAO;
+    GLBuffer volumeVBO, volumeEBO;
+    GLsizei volumeIndexCount = 0;
+    float volumeScale = 1.0f;
+    int width = 0, height = 0;
+    DeferredStats stats{};
+};
@@ -0,0 +1,336 @@
+#include "geometrypool.h"
+#include "meshresidency.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint32_t MinVertexCapacity = 1u << 16;
+constexpr uint32_t MinIndexCapacity = 1u << 18;
+
+// Respecifying the store keeps the buffer name, so vertex arrays that
+// reference it stay valid. The old contents round-trip through a scratch
+// buffer without leaving the GPU.
+void ResizeBuffer(GLuint buffer, size_t oldBytes, size_t newBytes)
+{
+    if (oldBytes == 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return;
+    }
+
+    GLuint scratch = 0;
+    glGenBuffers(1, &scratch);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+    glBufferData(GL_COPY_WRITE_BUFFER, oldBytes, nullptr, GL_STREAM_COPY);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+    glBufferData(GL_COPY_READ_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+    glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, oldBytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &scratch);
+}
+
+void MoveBufferRange(GLuint buffer, size_t from, size_t to, size_t bytes)
+{
+    // Source and destination never overlap: the destination was free.
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, to, bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+}
+
+uint32_t RangeAllocator::allocate(uint32_t size)
+{
+    if (size == 0)
+        return 0;
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        if (it->second < size)
+            continue;
+        uint32_t offset = it->first;
+        uint32_t remaining = it->second - size;
+        blocks.erase(it);
+        if (remaining > 0)
+            blocks.emplace(offset + size, remaining);
+        freeTotal -= size;
+        return offset;
+    }
+    return Invalid;
+}
+
+void RangeAllocator::claim(uint32_t offset, uint32_t size)
+{
+    if (size == 0)
+        return;
+    auto it = blocks.upper_bound(offset);
+    --it;
+    uint32_t blockOffset = it->first;
+    uint32_t blockEnd = it->first + it->second;
+    blocks.erase(it);
+    if (offset > blockOffset)
+        blocks.emplace(blockOffset, offset - blockOffset);
+    if (offset + size < blockEnd)
+        blocks.emplace(offset + size, blockEnd - offset - size);
+    freeTotal -= size;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t size)
+{
+    if (size == 0)
+        return;
+    freeTotal += size;
+    auto next = blocks.lower_bound(offset);
+    if (next != blocks.end() && offset + size == next->first) {
+        size += next->second;
+        next = blocks.erase(next);
+    }
+    if (next != blocks.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    blocks.emplace_hint(next, offset, size);
+}
+
+void RangeAllocator::grow(uint32_t newCapacity)
+{
+    if (newCapacity <= capacity)
+        return;
+    uint32_t oldCapacity = capacity;
+    capacity = newCapacity;
+    free(oldCapacity, newCapacity - oldCapacity);
+}
+
+void RangeAllocator::reset()
+{
+    blocks.clear();
+    capacity = freeTotal = 0;
+}
+
+uint32_t RangeAllocator::findBelow(uint32_t size, uint32_t limit) const
+{
+    for (auto it = blocks.begin(); it != blocks.end() && it->first < limit; ++it) {
+        if (it->second >= size)
+            return it->first;
+    }
+    return Invalid;
+}
+
+const PooledMesh* GeometryPool::add(Mesh& mesh)
+{
+    auto it = meshes.find(&mesh);
+    if (it != meshes.end())
+        return &it->second;
+    if (!RestoreMeshCPUData(mesh))
+        return nullptr;
+
+    uint32_t vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    uint32_t indexCount = static_cast<uint32_t>(mesh.indices.size() + mesh.lodIndices.size());
+    uint32_t vertexOffset = vertexRanges.allocate(vertexCount);
+    uint32_t indexOffset = indexRanges.allocate(indexCount);
+    if (vertexOffset == RangeAllocator::Invalid || indexOffset == RangeAllocator::Invalid || VBO == 0) {
+        // Growth appends to the trailing free block, so one doubling (or the
+        // exact shortfall) always makes room.
+        uint32_t vertexCapacity = vertexRanges.getCapacity(), indexCapacity = indexRanges.getCapacity();
+        if (vertexOffset == RangeAllocator::Invalid)
+            vertexCapacity = std::max({ vertexCapacity * 2, vertexCapacity + vertexCount, MinVertexCapacity });
+        if (indexOffset == RangeAllocator::Invalid)
+            indexCapacity = std::max({ indexCapacity * 2, indexCapacity + indexCount, MinIndexCapacity });
+        reserve(std::max(vertexCapacity, MinVertexCapacity), std::max(indexCapacity, MinIndexCapacity));
+        if (vertexOffset == RangeAllocator::Invalid)
+            vertexOffset = vertexRanges.allocate(vertexCount);
+        if (indexOffset == RangeAllocator::Invalid)
+            indexOffset = indexRanges.allocate(indexCount);
+    }
+
+    PooledMesh pooled;
+    pooled.baseVertex = static_cast<int32_t>(vertexOffset);
+    pooled.vertexCount = vertexCount;
+    pooled.firstIndex = indexOffset;
+    pooled.indexCount = indexCount;
+    pooled.lods = mesh.lods;
+    if (pooled.lods.empty())
+        pooled.lods.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<size_t>(vertexOffset) * sizeof(Vertex),
+                    mesh.vertices.size() * sizeof(Vertex), mesh.vertices.data());
+    std::vector<glm::vec3> positions(mesh.vertices.size());
+    for (size_t i = 0; i < positions.size(); ++i)
+        positions[i] = mesh.vertices[i].Position;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, positionVBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<size_t>(vertexOffset) * sizeof(glm::vec3),
+                    positions.size() * sizeof(glm::vec3), positions.data());
+    // Written through the copy target so no vertex array's element binding changes.
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    size_t indexBytes = static_cast<size_t>(indexOffset) * sizeof(unsigned int);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indexBytes, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data());
+    if (!mesh.lodIndices.empty()) {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexBytes + mesh.indices.size() * sizeof(unsigned int),
+                        mesh.lodIndices.size() * sizeof(unsigned int), mesh.lodIndices.data());
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    ReleaseMeshCPUData(mesh);
+    return &meshes.emplace(&mesh, pooled).first->second;
+}
+
+void GeometryPool::remove(const Mesh& mesh)
+{
+    auto it = meshes.find(&mesh);
+    if (it == meshes.end())
+        return;
+    vertexRanges.free(static_cast<uint32_t>(it->second.baseVertex), it->second.vertexCount);
+    indexRanges.free(it->second.firstIndex, it->second.indexCount);
+    meshes.erase(it);
+}
+
+void GeometryPool::reserve(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    if (VBO == 0) {
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &positionVBO);
+        glGenBuffers(1, &EBO);
+        glGenVertexArrays(1, &VAO);
+        glGenVertexArrays(1, &depthVAO);
+    }
+    if (vertexCapacity > vertexRanges.getCapacity()) {
+        ResizeBuffer(VBO, static_cast<size_t>(vertexRanges.getCapacity()) * sizeof(Vertex),
+                     static_cast<size_t>(vertexCapacity) * sizeof(Vertex));
+        ResizeBuffer(positionVBO, static_cast<size_t>(vertexRanges.getCapacity()) * sizeof(glm::vec3),
+                     static_cast<size_t>(vertexCapacity) * sizeof(glm::vec3));
+        vertexRanges.grow(vertexCapacity);
+        grows++;
+    }
+    if (indexCapacity > indexRanges.getCapacity()) {
+        ResizeBuffer(EBO, static_cast<size_t>(indexRanges.getCapacity()) * sizeof(unsigned int),
+                     static_cast<size_t>(indexCapacity) * sizeof(unsigned int));
+        indexRanges.grow(indexCapacity);
+        grows++;
+    }
+
+    glBindVertexArray(VAO);
+    bindAttributes();
+    glBindVertexArray(depthVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+uint32_t GeometryPool::compactVertices(uint32_t maxMoves)
+{
+    uint32_t moved = 0;
+    while (moved < maxMoves) {
+        PooledMesh* last = nullptr;
+        for (auto& entry : meshes) {
+            if (entry.second.vertexCount > 0 && (!last || entry.second.baseVertex > last->baseVertex))
+                last = &entry.second;
+        }
+        if (!last)
+            break;
+        uint32_t from = static_cast<uint32_t>(last->baseVertex);
+        uint32_t to = vertexRanges.findBelow(last->vertexCount, from);
+        if (to == RangeAllocator::Invalid)
+            break;
+        vertexRanges.claim(to, last->vertexCount);
+        MoveBufferRange(VBO, static_cast<size_t>(from) * sizeof(Vertex), static_cast<size_t>(to) * sizeof(Vertex),
+                        static_cast<size_t>(last->vertexCount) * sizeof(Vertex));
+        MoveBufferRange(positionVBO, static_cast<size_t>(from) * sizeof(glm::vec3), static_cast<size_t>(to) * sizeof(glm::vec3),
+                        static_cast<size_t>(last->vertexCount) * sizeof(glm::vec3));
+        vertexRanges.free(from, last->vertexCount);
+        last->baseVertex = static_cast<int32_t>(to);
+        moved++;
+    }
+    return moved;
+}
+
+uint32_t GeometryPool::compactIndices(uint32_t maxMoves)
+{
+    uint32_t moved = 0;
+    while (moved < maxMoves) {
+        PooledMesh* last = nullptr;
+        for (auto& entry : meshes) {
+            if (entry.second.indexCount > 0 && (!last || entry.second.firstIndex > last->firstIndex))
+                last = &entry.second;
+        }
+        if (!last)
+            break;
+        uint32_t from = last->firstIndex;
+        uint32_t to = indexRanges.findBelow(last->indexCount, from);
+        if (to == RangeAllocator::Invalid)
+            break;
+        // Indices are relative to baseVertex, so they move without rewriting.
+        indexRanges.claim(to, last->indexCount);
+        MoveBufferRange(EBO, static_cast<size_t>(from) * sizeof(unsigned int), static_cast<size_t>(to) * sizeof(unsigned int),
+                        static_cast<size_t>(last->indexCount) * sizeof(unsigned int));
+        indexRanges.free(from, last->indexCount);
+        last->firstIndex = to;
+        moved++;
+    }
+    return moved;
+}
+
+void GeometryPool::compact(uint32_t maxMoves)
+{
+    if (VBO == 0)
+        return;
+    moves += compactVertices(maxMoves);
+    moves += compactIndices(maxMoves);
+}
+
+void GeometryPool::destroy()
+{
+    if (VBO != 0) {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteVertexArrays(1, &depthVAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &positionVBO);
+        glDeleteBuffers(1, &EBO);
+    }
+    VAO = depthVAO = VBO = positionVBO = EBO = 0;
+    vertexRanges.reset();
+    indexRanges.reset();
+    meshes.clear();
+    grows = moves = 0;
+}
+
+const PooledMesh* GeometryPool::find(const Mesh* mesh) const
+{
+    auto it = meshes.find(mesh);
+    return it != meshes.end() ? &it->second : nullptr;
+}
+
+void GeometryPool::bindAttributes() const
+{
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+}
+
+GeometryPoolStats GeometryPool::getStats() const
+{
+    GeometryPoolStats stats{};
+    stats.meshes = static_cast<uint32_t>(meshes.size());
+    stats.vertexCapacity = vertexRanges.getCapacity();
+    stats.verticesUsed = vertexRanges.getCapacity() - vertexRanges.getFree();
+    stats.indexCapacity = indexRanges.getCapacity();
+    stats.indicesUsed = indexRanges.getCapacity() - indexRanges.getFree();
+    stats.freeBlocks = static_cast<uint32_t>(vertexRanges.getFreeBlockCount() + indexRanges.getFreeBlockCount());
+    stats.grows = grows;
+    stats.moves = moves;
+    return stats;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "def.h"
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+
+// Where one mesh lives inside the pool. Index ranges of its levels of detail
+// are relative to firstIndex, exactly as in the mesh's own element buffer,
+// and the indices themselves are relative to baseVertex.
+struct PooledMesh {
+    int32_t baseVertex;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    std::vector<MeshLOD> lods;
+};
+
+// First-fit free-list over a range of elements. Freed blocks are merged
+// with their neighbours so the list stays short.
+class RangeAllocator {
+public:
+    static constexpr uint32_t Invalid = UINT32_MAX;
+
+    uint32_t allocate(uint32_t size);
+    // Takes `size` elements at `offset`, which must lie inside one free block.
+    void claim(uint32_t offset, uint32_t size);
+    void free(uint32_t offset, uint32_t size);
+    // Appends free space at the end of the range.
+    void grow(uint32_t newCapacity);
+    void reset();
+
+    uint32_t getCapacity() const { return capacity; }
+    uint32_t getFree() const { return freeTotal; }
+    size_t getFreeBlockCount() const { return blocks.size(); }
+    // Lowest free block below `limit` that can hold `size`, or Invalid.
+    uint32_t findBelow(uint32_t size, uint32_t limit) const;
+
+private:
+    std::map<uint32_t, uint32_t> blocks;   // offset -> size
+    uint32_t capacity = 0;
+    uint32_t freeTotal = 0;
+};
+
+struct GeometryPoolStats {
+    uint32_t meshes;
+    uint32_t vertexCapacity, verticesUsed;
+    uint32_t indexCapacity, indicesUsed;
+    uint32_t freeBlocks;
+    uint32_t grows;
+    uint32_t moves;
+};
+
+// Every static mesh sub-allocated from one vertex and one element buffer
+// sharing a single vertex array (plus a position-only copy of the vertices
+// with its own vertex array for depth passes), so draws of different meshes differ only by
+// their base vertex and first index. The buffers grow on demand and are
+// compacted a few meshes at a time; both keep the GL buffer names, so
+// vertex arrays built on them elsewhere stay valid.
+class GeometryPool {
+public:
+    // Uploads the mesh's vertices and all of its index data (LODs included).
+    // Dropped CPU arrays are reloaded from the mesh cache for the upload.
+    const PooledMesh* add(Mesh& mesh);
+    void remove(const Mesh& mesh);
+    // Moves up to `maxMoves` meshes from the end of each buffer into holes
+    // further down. Cheap enough to call every frame.
+    void compact(uint32_t maxMoves = 1);
+    void destroy();
+
+    const PooledMesh* find(const Mesh* mesh) const;
+    // Sets up attributes 0-2 from the pool on the currently bound vertex array.
+    void bindAttributes() const;
+
+    GLuint getVertexArray() const { return VAO; }
+    // Position stream only, same base vertices and element buffer.
+    GLuint getDepthVertexArray() const { return depthVAO; }
+    GLuint getVertexBuffer() const { return VBO; }
+    GLuint getIndexBuffer() const { return EBO; }
+    GeometryPoolStats getStats() const;
+
+private:
+    void reserve(uint32_t vertexCapacity, uint32_t indexCapacity);
+    uint32_t compactVertices(uint32_t maxMoves);
+    uint32_t compactIndices(uint32_t maxMoves);
+
+    RangeAllocator vertexRanges, indexRanges;
+    std::unordered_map<const Mesh*, PooledMesh> meshes;
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    GLuint depthVAO = 0, positionVBO = 0;
+    uint32_t grows = 0, moves = 0;
+};
@@ -0,0 +1,81 @@
+#include "glextra.h"
+
+#include <cstring>
+#include <iostream>
+
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC straing_glMultiDrawElementsIndirect = nullptr;
+PFNGLGETPROGRAMBINARYPROC straing_glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC straing_glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC straing_glProgramParameteri = nullptr;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC straing_glMaxShaderCompilerThreadsKHR = nullptr;
+
+namespace {
+
+GLCapabilities capabilities{};
+
+bool HasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool AtLeast(int major, int minor)
+{
+    return capabilities.major > major || (capabilities.major == major && capabilities.minor >= minor);
+}
+
+}
+
+bool LoadGLExtras(GLADloadproc load)
+{
+    capabilities = {};
+    glGetIntegerv(GL_MAJOR_VERSION, &capabilities.major);
+    glGetIntegerv(GL_MINOR_VERSION, &capabilities.minor);
+
+    capabilities.baseInstance = AtLeast(4, 2) || HasExtension("GL_ARB_base_instance");
+    capabilities.shaderStorage = AtLeast(4, 3) || HasExtension("GL_ARB_shader_storage_buffer_object");
+    capabilities.drawParameters = AtLeast(4, 6) || HasExtension("GL_ARB_shader_draw_parameters");
+
+    if (AtLeast(4, 3) || HasExtension("GL_ARB_multi_draw_indirect"))
+        straing_glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+    capabilities.multiDrawIndirect = straing_glMultiDrawElementsIndirect != nullptr;
+
+    if (AtLeast(4, 1) || HasExtension("GL_ARB_get_program_binary")) {
+        straing_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        straing_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        straing_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+    }
+    // Drivers may expose the entry points yet offer no format to store.
+    GLint binaryFormats = 0;
+    if (straing_glGetProgramBinary && straing_glProgramBinary && straing_glProgramParameteri)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    capabilities.programBinary = binaryFormats > 0;
+
+    if (HasExtension("GL_KHR_parallel_shader_compile"))
+        straing_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (HasExtension("GL_ARB_parallel_shader_compile"))
+        straing_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+    capabilities.parallelShaderCompile = straing_glMaxShaderCompilerThreadsKHR != nullptr;
+    // Let the driver pick how many compiler threads to use.
+    if (capabilities.parallelShaderCompile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+
+    std::cout << "OpenGL " << capabilities.major << "." << capabilities.minor
+              << (capabilities.multiDrawIndirect ? ", multi-draw indirect" : "")
+              << (capabilities.shaderStorage ? ", shader storage" : "")
+              << (capabilities.drawParameters ? ", draw parameters" : "")
+              << (capabilities.programBinary ? ", program binaries" : "")
+              << (capabilities.parallelShaderCompile ? ", parallel shader compile" : "") << std::endl;
+    return true;
+}
+
+const GLCapabilities& GetGLCapabilities()
+{
+    return capabilities;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glad.h>
+
+// glad is generated for core 3.3 only. Entry points and enums from newer
+// versions are declared here and loaded at runtime by LoadGLExtras(); each
+// is null unless the context reports support for it.
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC straing_glMultiDrawElementsIndirect;
+#define glMultiDrawElementsIndirect straing_glMultiDrawElementsIndirect
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+extern PFNGLGETPROGRAMBINARYPROC straing_glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC straing_glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC straing_glProgramParameteri;
+#define glGetProgramBinary straing_glGetProgramBinary
+#define glProgramBinary straing_glProgramBinary
+#define glProgramParameteri straing_glProgramParameteri
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC straing_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR straing_glMaxShaderCompilerThreadsKHR
+
+struct GLCapabilities {
+    int major;
+    int minor;
+    bool multiDrawIndirect;   // GL 4.3 or ARB_multi_draw_indirect
+    bool shaderStorage;       // GL 4.3 or ARB_shader_storage_buffer_object
+    bool baseInstance;        // GL 4.2 or ARB_base_instance
+    bool drawParameters;      // GL 4.6 or ARB_shader_draw_parameters (gl_DrawID in GLSL)
+    bool programBinary;       // GL 4.1 or ARB_get_program_binary, with at least one binary format
+    bool parallelShaderCompile;   // KHR/ARB_parallel_shader_compile: compiles can be polled for completion
+};
+
+// Call once after gladLoadGLLoader() with the same loader.
+bool LoadGLExtras(GLADloadproc load);
+const GLCapabilities& GetGLCapabilities();
@@ -0,0 +1,119 @@
+#include "glresource.h"
+
+GLuint CreateGLName(GLResourceKind kind)
+{
+    GLuint name = 0;
+    switch (kind) {
+    case GLResourceKind::Buffer:
+        glGenBuffers(1, &name);
+        break;
+    case GLResourceKind::VertexArray:
+        glGenVertexArrays(1, &name);
+        break;
+    case GLResourceKind::Texture:
+        glGenTextures(1, &name);
+        break;
+    case GLResourceKind::Program:
+        name = glCreateProgram();
+        break;
+    case GLResourceKind::Framebuffer:
+        glGenFramebuffers(1, &name);
+        break;
+    case GLResourceKind::Sampler:
+        glGenSamplers(1, &name);
+        break;
+    }
+    return name;
+}
+
+void GLReleaseQueue::release(GLResourceKind kind, GLuint name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!closed)
+        current.emplace_back(kind, name);
+}
+
+void GLReleaseQueue::endFrame()
+{
+    std::vector<std::pair<GLResourceKind, GLuint>> released;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed)
+            return;
+        released.swap(current);
+    }
+    if (!released.empty())
+        batches.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frame, std::move(released) });
+    frame++;
+
+    // Batches are fenced in order, so stop at the first one still in use.
+    while (!batches.empty()) {
+        Batch& batch = batches.front();
+        if (frame - batch.frame < framesToKeep)
+            break;
+        GLenum status = glClientWaitSync(batch.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(batch.fence);
+        deleteNames(batch.names);
+        batches.pop_front();
+    }
+}
+
+void GLReleaseQueue::shutdown()
+{
+    std::vector<std::pair<GLResourceKind, GLuint>> released;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        released.swap(current);
+    }
+    for (Batch& batch : batches) {
+        glDeleteSync(batch.fence);
+        deleteNames(batch.names);
+    }
+    batches.clear();
+    deleteNames(released);
+}
+
+size_t GLReleaseQueue::getPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = current.size();
+    for (const Batch& batch : batches)
+        count += batch.names.size();
+    return count;
+}
+
+void GLReleaseQueue::deleteNames(const std::vector<std::pair<GLResourceKind, GLuint>>& names)
+{
+    for (const auto& entry : names) {
+        GLuint name = entry.second;
+        switch (entry.first) {
+        case GLResourceKind::Buffer:
+            glDeleteBuffers(1, &name);
+            break;
+        case GLResourceKind::VertexArray:
+            glDeleteVertexArrays(1, &name);
+            break;
+        case GLResourceKind::Texture:
+            glDeleteTextures(1, &name);
+            break;
+        case GLResourceKind::Program:
+            glDeleteProgram(name);
+            break;
+        case GLResourceKind::Framebuffer:
+            glDeleteFramebuffers(1, &name);
+            break;
+        case GLResourceKind::Sampler:
+            glDeleteSamplers(1, &name);
+            break;
+        }
+    }
+}
+
+GLReleaseQueue& GetGLReleaseQueue()
+{
+    static GLReleaseQueue queue;
+    return queue;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <glad.h>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+enum class GLResourceKind {
+    Buffer,
+    VertexArray,
+    Texture,
+    Program,
+    Framebuffer,
+    Sampler,
+};
+
+GLuint CreateGLName(GLResourceKind kind);
+
+// Names released by handles are held back until the GPU has passed a fence
+// placed after their last use and `framesToKeep` frames have gone by, so a
+// name is never recycled while queued commands may still reference it.
+class GLReleaseQueue {
+public:
+    // Safe from any thread; deletion always happens in endFrame().
+    void release(GLResourceKind kind, GLuint name);
+    // Fences this frame's releases and deletes the batches the GPU is done with.
+    void endFrame();
+    // Deletes everything right away. The context is about to go, so releases
+    // after this are ignored.
+    void shutdown();
+
+    size_t getPendingCount() const;
+
+    uint32_t framesToKeep = 2;
+
+private:
+    struct Batch {
+        GLsync fence;
+        uint64_t frame;
+        std::vector<std::pair<GLResourceKind, GLuint>> names;
+    };
+
+    static void deleteNames(const std::vector<std::pair<GLResourceKind, GLuint>>& names);
+
+    mutable std::mutex mutex;
+    std::vector<std::pair<GLResourceKind, GLuint>> current;
+    std::deque<Batch> batches;
+    uint64_t frame = 0;
+    bool closed = false;
+};
+
+GLReleaseQueue& GetGLReleaseQueue();
+
+// Move-only owner of one GL object name. Converts to GLuint so it can be
+// passed straight to GL calls; destruction hands the name to the release queue.
+template <GLResourceKind Kind>
+class GLHandle {
+public:
+    GLHandle() = default;
+    explicit GLHandle(GLuint name) : name(name) {}
+    GLHandle(GLHandle&& other) noexcept : name(other.name) { other.name = 0; }
+    GLHandle& operator=(GLHandle&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            name = other.name;
+            other.name = 0;
+        }
+        return *this;
+    }
+    GLHandle(const GLHandle&) = delete;
+    GLHandle& operator=(const GLHandle&) = delete;
+    ~GLHandle() { reset(); }
+
+    static GLHandle create() { return GLHandle(CreateGLName(Kind)); }
+
+    void reset()
+    {
+        if (name != 0)
+            GetGLReleaseQueue().release(Kind, name);
+        name = 0;
+    }
+    // Gives up ownership without deleting.
+    GLuint detach()
+    {
+        GLuint detached = name;
+        name = 0;
+        return detached;
+    }
+
+    GLuint get() const { return name; }
+    operator GLuint() const { return name; }
+
+private:
+    GLuint name = 0;
+};
+
+using GLBuffer = GLHandle<GLResourceKind::Buffer>;
+using GLVertexArray = GLHandle<GLResourceKind::VertexArray>;
+using GLTexture = GLHandle<GLResourceKind::Texture>;
+using GLProgram = GLHandle<GLResourceKind::Program>;
+using GLFramebuffer = GLHandle<GLResourceKind::Framebuffer>;
+using GLSampler = GLHandle<GLResourceKind::Sampler>;
@@ -0,0 +1,203 @@
+#include "gpuculling.h"
+#include "culling.h"
+#include "shadows.h"
+
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+
+void SetMatrixAttributes(GLuint firstLocation, GLuint divisor)
+{
+    for (GLuint column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(firstLocation + column);
+        glVertexAttribPointer(firstLocation + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              (void*)(column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(firstLocation + column, divisor);
+    }
+}
+
+}
+
+bool GPUInstanceCuller::init(const Mesh& cullMesh)
+{
+    const char* varyings[] = { "outModel0", "outModel1", "outModel2", "outModel3" };
+    cullShader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/instancecull.vertex.shader" },
+                                  { GL_GEOMETRY_SHADER, "shaders/instancecull.geometry.shader" } },
+                                0, std::string(), std::vector<const char*>(std::begin(varyings), std::end(varyings)));
+    // The mesh is fixed, so its material variant is picked once. The cache
+    // owns the program and may swap it when the sources are reloaded.
+    drawShader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/vertex.shader" },
+                                  { GL_FRAGMENT_SHADER, "shaders/fragment.shader" },
+                                  { GL_FRAGMENT_SHADER, "shaders/sunshadow.fragment.shader" } },
+                                ShaderFeatureTextured | ShaderFeatureInstanced, "#define SUN_SHADOWS\n");
+    drawFeatures = ShaderFeatureInstanced | MeshShaderFeatures(cullMesh);
+    if (cullShader.get(0) == 0 || drawShader.get(drawFeatures) == 0) {
+        destroy();
+        return false;
+    }
+
+    mesh = &cullMesh;
+    levelCount = std::max(1, std::min(static_cast<int>(mesh->lods.size()), MaxLevels));
+
+    glGenBuffers(1, &instanceBuffer);
+    glGenVertexArrays(1, &cullVAO);
+    glBindVertexArray(cullVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    SetMatrixAttributes(0, 0);
+
+    glGenBuffers(levelCount, levelBuffers);
+    glGenVertexArrays(levelCount, levelVAOs);
+    glGenQueries(levelCount, levelQueries);
+    for (int level = 0; level < levelCount; ++level) {
+        // Mesh geometry per vertex, the level's surviving transforms per instance.
+        glBindVertexArray(levelVAOs[level]);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
+        glBindBuffer(GL_ARRAY_BUFFER, levelBuffers[level]);
+        SetMatrixAttributes(3, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void GPUInstanceCuller::destroy()
+{
+    if (cullVAO != 0)
+        glDeleteVertexArrays(1, &cullVAO);
+    if (instanceBuffer != 0)
+        glDeleteBuffers(1, &instanceBuffer);
+    if (levelCount > 0) {
+        glDeleteVertexArrays(levelCount, levelVAOs);
+        glDeleteBuffers(levelCount, levelBuffers);
+        glDeleteQueries(levelCount, levelQueries);
+    }
+    cullVAO = instanceBuffer = 0;
+    cullShader = ShaderVariants();
+    drawShader = ShaderVariants();
+    locationsProgram = 0;
+    drawFeatures = 0;
+    std::fill(std::begin(levelBuffers), std::end(levelBuffers), 0u);
+    std::fill(std::begin(levelVAOs), std::end(levelVAOs), 0u);
+    std::fill(std::begin(levelQueries), std::end(levelQueries), 0u);
+    levelCount = 0;
+    instanceCount = 0;
+    pending = false;
+    mesh = nullptr;
+}
+
+void GPUInstanceCuller::setInstances(const std::vector<glm::mat4>& models)
+{
+    if (!isReady())
+        return;
+    instanceCount = models.size();
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), models.data(), GL_STATIC_DRAW);
+    // Any level may receive every instance.
+    for (int level = 0; level < levelCount; ++level) {
+        glBindBuffer(GL_ARRAY_BUFFER, levelBuffers[level]);
+        glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GPUInstanceCuller::cull(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, const LODSelection& selection)
+{
+    pending = false;
+    if (!isReady() || instanceCount == 0)
+        return;
+
+    Frustum frustum = ExtractFrustum(viewProjection);
+    float lodErrors[MaxLevels] = {};
+    for (int level = 0; level < levelCount && level < static_cast<int>(mesh->lods.size()); ++level)
+        lodErrors[level] = mesh->lods[level].error;
+
+    GLuint cullProgram = cullShader.get(0);
+    if (cullProgram != locationsProgram) {
+        locationsProgram = cullProgram;
+        planesLoc = glGetUniformLocation(cullProgram, "uPlanes");
+        sphereLoc = glGetUniformLocation(cullProgram, "uSphere");
+        cameraPosLoc = glGetUniformLocation(cullProgram, "uCameraPos");
+        lodErrorsLoc = glGetUniformLocation(cullProgram, "uLodErrors");
+        lodCountLoc = glGetUniformLocation(cullProgram, "uLodCount");
+        pixelsPerUnitLoc = glGetUniformLocation(cullProgram, "uPixelsPerUnit");
+        maxErrorPixelsLoc = glGetUniformLocation(cullProgram, "uMaxErrorPixels");
+        lodLoc = glGetUniformLocation(cullProgram, "uLod");
+    }
+    glUseProgram(cullProgram);
+    glUniform4fv(planesLoc, 6, glm::value_ptr(frustum.planes[0]));
+    glUniform4f(sphereLoc, mesh->sphere.center.x, mesh->sphere.center.y, mesh->sphere.center.z, mesh->sphere.radius);
+    glUniform3fv(cameraPosLoc, 1, glm::value_ptr(cameraPosition));
+    glUniform1fv(lodErrorsLoc, MaxLevels, lodErrors);
+    glUniform1i(lodCountLoc, levelCount);
+    glUniform1f(pixelsPerUnitLoc, selection.pixelsPerUnit);
+    glUniform1f(maxErrorPixelsLoc, selection.maxErrorPixels);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(cullVAO);
+    for (int level = 0; level < levelCount; ++level) {
+        glUniform1i(lodLoc, level);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, levelBuffers[level]);
+        glBeginQuery(GL_PRIMITIVES_GENERATED, levelQueries[level]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(instanceCount));
+        glEndTransformFeedback();
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+    }
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    pending = true;
+}
+
+void GPUInstanceCuller::draw(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+    stats = {};
+    stats.instances = static_cast<uint32_t>(instanceCount);
+    if (!pending)
+        return;
+    pending = false;
+
+    GLuint drawProgram = drawShader.get(drawFeatures);
+    glUseProgram(drawProgram);
+    glUniformMatrix4fv(glGetUniformLocation(drawProgram, "uViewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    BindForwardSunUniforms(shadows, drawProgram, sunDirection, cameraPosition, 4);
+    if (!mesh->textures.empty()) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, mesh->textures[0].id);
+        glUniform1i(glGetUniformLocation(drawProgram, "uTexture"), 0);
+    } else {
+        glUniform4f(glGetUniformLocation(drawProgram, "uColor"), 1.0f, 0.5f, 0.2f, 1.0f);
+    }
+
+    for (int level = 0; level < levelCount; ++level) {
+        // Waits for this level's culling pass only, which was queued before
+        // the rest of the frame.
+        GLuint visible = 0;
+        glGetQueryObjectuiv(levelQueries[level], GL_QUERY_RESULT, &visible);
+        stats.levelInstances[level] = visible;
+        stats.visible += visible;
+        if (visible == 0)
+            continue;
+
+        GLsizei indexCount = static_cast<GLsizei>(mesh->indexCount);
+        size_t indexOffset = 0;
+        if (level < static_cast<int>(mesh->lods.size())) {
+            indexCount = static_cast<GLsizei>(mesh->lods[level].indexCount);
+            indexOffset = mesh->lods[level].indexOffset;
+        }
+        glBindVertexArray(levelVAOs[level]);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)(indexOffset * sizeof(unsigned int)),
+                                static_cast<GLsizei>(visible));
+        stats.drawCalls++;
+    }
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
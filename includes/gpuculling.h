@@ -0,0 +1,66 @@
+#pragma once
+
+#include "def.h"
+#include "meshlod.h"
+#include "shadervariants.h"
+#include <cstdint>
+
+class CascadedShadowMaps;
+
+constexpr int GPUCullingMaxLevels = 8;
+
+struct GPUCullingStats {
+    uint32_t instances;
+    uint32_t visible;
+    uint32_t levelInstances[GPUCullingMaxLevels];
+    uint32_t drawCalls;
+};
+
+// GL 3.3 instance culling without compute shaders. Every instance is a point
+// fed through a vertex shader that tests its bounding sphere against the
+// frustum and picks an LOD; a geometry shader keeps the points of one level
+// and transform feedback streams their transforms into that level's buffer.
+// A GL_PRIMITIVES_GENERATED query per level gives the instance count for
+// glDrawElementsInstanced, so the CPU never touches individual instances.
+class GPUInstanceCuller {
+public:
+    static constexpr int MaxLevels = GPUCullingMaxLevels;
+
+    // The mesh must outlive the culler; its LODs should already be generated.
+    bool init(const Mesh& mesh);
+    void destroy();
+    bool isReady() const { return !cullShader.isEmpty(); }
+
+    void setInstances(const std::vector<glm::mat4>& models);
+    size_t getInstanceCount() const { return instanceCount; }
+
+    // Issues the culling passes. Their counts are only read back in draw(),
+    // so any work recorded in between hides the round trip.
+    void cull(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, const LODSelection& selection);
+    void draw(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+
+    const GPUCullingStats& getStats() const { return stats; }
+
+    // Lit like the forward path: by the sun, with its shadows if any.
+    glm::vec3 sunDirection = glm::vec3(-0.4f, -1.0f, -0.3f);
+    const CascadedShadowMaps* shadows = nullptr;
+
+private:
+    const Mesh* mesh = nullptr;
+    ShaderVariants cullShader, drawShader;
+    uint32_t drawFeatures = 0;
+    GLuint instanceBuffer = 0, cullVAO = 0;
+    GLuint levelBuffers[MaxLevels] = {};
+    GLuint levelVAOs[MaxLevels] = {};
+    GLuint levelQueries[MaxLevels] = {};
+    int levelCount = 0;
+    size_t instanceCount = 0;
+    bool pending = false;
+
+    // Looked up again whenever a reload replaces the cull program.
+    GLuint locationsProgram = 0;
+    GLint planesLoc = -1, sphereLoc = -1, cameraPosLoc = -1, lodErrorsLoc = -1, lodCountLoc = -1;
+    GLint pixelsPerUnitLoc = -1, maxErrorPixelsLoc = -1, lodLoc = -1;
+
+    GPUCullingStats stats{};
+};
@@ -0,0 +1,61 @@
+#include "gputimer.h"
+
+void GPUTimers::beginFrame()
+{
+    frameIndex = (frameIndex + 1) % Latency;
+    for (Timer& timer : timers) {
+        if (!timer.issued[frameIndex])
+            continue;
+        // Issued Latency frames ago, so this practically never waits.
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(timer.queries[frameIndex], GL_QUERY_RESULT, &elapsed);
+        timer.ms = static_cast<float>(elapsed) * 1e-6f;
+        timer.issued[frameIndex] = false;
+    }
+}
+
+void GPUTimers::begin(const char* name)
+{
+    if (running)
+        end();
+
+    Timer* timer = nullptr;
+    for (Timer& candidate : timers) {
+        if (candidate.name == name)
+            timer = &candidate;
+    }
+    if (!timer) {
+        timers.emplace_back();
+        timer = &timers.back();
+        timer->name = name;
+        glGenQueries(Latency, timer->queries);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, timer->queries[frameIndex]);
+    timer->issued[frameIndex] = true;
+    running = true;
+}
+
+void GPUTimers::end()
+{
+    if (!running)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    running = false;
+}
+
+void GPUTimers::destroy()
+{
+    for (Timer& timer : timers)
+        glDeleteQueries(Latency, timer.queries);
+    timers.clear();
+    running = false;
+}
+
+float GPUTimers::getMs(const char* name) const
+{
+    for (const Timer& timer : timers) {
+        if (timer.name == name)
+            return timer.ms;
+    }
+    return -1.0f;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glad.h>
+#include <string>
+#include <vector>
+
+// GL_TIME_ELAPSED timings of named passes. Each frame uses its own set of
+// queries and results are read `Latency` frames later, by which time the GPU
+// has long finished, so reading them never stalls. Timers cannot nest.
+class GPUTimers {
+public:
+    static constexpr int Latency = 3;
+
+    void beginFrame();
+    void begin(const char* name);
+    void end();
+    void destroy();
+
+    // Milliseconds from the latest frame with a result, or -1 if none yet.
+    float getMs(const char* name) const;
+
+private:
+    struct Timer {
+        std::string name;
+        GLuint queries[Latency] = {};
+        bool issued[Latency] = {};
+        float ms = -1.0f;
+    };
+
+    std::vector<Timer> timers;
+    int frameIndex = 0;
+    bool running = false;
+};
@@ -0,0 +1,182 @@
+#include "hotreload.h"
+
+#include <glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#define STRAING_INOTIFY 1
+#endif
+
+bool FileWatcher::init(const std::vector<std::string>& roots)
+{
+    destroy();
+#if STRAING_INOTIFY
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "File watching unavailable: inotify_init1 failed\n";
+        return false;
+    }
+    buffer.resize(64 * 1024);
+    for (const std::string& root : roots) {
+        std::error_code error;
+        watch(root);
+        for (auto it = std::filesystem::recursive_directory_iterator(root, error);
+             !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+            if (it->is_directory(error))
+                watch(it->path().generic_string());
+        }
+    }
+    return !directories.empty();
+#else
+    (void)roots;
+    return false;
+#endif
+}
+
+void FileWatcher::watch(const std::string& directory)
+{
+#if STRAING_INOTIFY
+    int descriptor = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (descriptor < 0) {
+        std::cerr << "Failed to watch " << directory << "\n";
+        return;
+    }
+    directories[descriptor] = directory;
+#else
+    (void)directory;
+#endif
+}
+
+void FileWatcher::destroy()
+{
+#if STRAING_INOTIFY
+    if (fd >= 0)
+        close(fd);
+#endif
+    fd = -1;
+    directories.clear();
+}
+
+void FileWatcher::poll(std::vector<std::string>& changed)
+{
+#if STRAING_INOTIFY
+    if (fd < 0)
+        return;
+    size_t first = changed.size();
+    for (;;) {
+        ssize_t length = read(fd, buffer.data(), buffer.size());
+        if (length <= 0)
+            break;
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+            offset += sizeof(inotify_event) + event->len;
+            auto directory = directories.find(event->wd);
+            if (directory == directories.end() || event->len == 0)
+                continue;
+            std::string path = directory->second + "/" + event->name;
+            if (event->mask & IN_ISDIR) {
+                // New subdirectories are watched from now on.
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    watch(path);
+                continue;
+            }
+            // A created file is reported once it has been written and closed.
+            if (event->mask & IN_CREATE)
+                continue;
+            if (std::find(changed.begin() + first, changed.end(), path) == changed.end())
+                changed.push_back(path);
+        }
+    }
+#else
+    (void)changed;
+#endif
+}
+
+bool GLWorker::init(GLFWwindow* shareWith)
+{
+    destroy();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "Straing worker", nullptr, shareWith);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!context) {
+        std::cerr << "Failed to create a shared context for background GL work\n";
+        return false;
+    }
+    stopping = false;
+    thread = std::thread(&GLWorker::run, this);
+    return true;
+}
+
+void GLWorker::destroy()
+{
+    if (!context)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    wake.notify_all();
+    thread.join();
+    finished.clear();
+    running = 0;
+    glfwDestroyWindow(context);
+    context = nullptr;
+}
+
+void GLWorker::submit(std::function<void()> job, std::function<void()> done)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.emplace_back(std::move(job), std::move(done));
+    }
+    wake.notify_one();
+}
+
+void GLWorker::pump()
+{
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        callbacks.swap(finished);
+    }
+    for (std::function<void()>& callback : callbacks) {
+        if (callback)
+            callback();
+    }
+}
+
+size_t GLWorker::getPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs.size() + running + finished.size();
+}
+
+void GLWorker::run()
+{
+    glfwMakeContextCurrent(context);
+    for (;;) {
+        std::pair<std::function<void()>, std::function<void()>> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stopping || !jobs.empty(); });
+            if (stopping)
+                break;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            running = 1;
+        }
+        job.first();
+        glFinish();
+        std::lock_guard<std::mutex> lock(mutex);
+        running = 0;
+        if (!stopping)
+            finished.push_back(std::move(job.second));
+    }
+    glfwMakeContextCurrent(nullptr);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct GLFWwindow;
+
+// Reports files written under the watched directories, subdirectories
+// included, through inotify. Editors that save to a temporary file and
+// rename it over the original report the original path. Where inotify is
+// not available init() fails and nothing is ever reported.
+class FileWatcher {
+public:
+    FileWatcher() = default;
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+    ~FileWatcher() { destroy(); }
+
+    bool init(const std::vector<std::string>& directories);
+    void destroy();
+    bool isReady() const { return fd >= 0; }
+
+    // Never blocks. Appends each path changed since the last call once, in
+    // the form it was watched under, e.g. "shaders/vertex.shader".
+    void poll(std::vector<std::string>& changed);
+
+private:
+    void watch(const std::string& directory);
+
+    int fd = -1;
+    std::unordered_map<int, std::string> directories;   // watch descriptor to path
+    std::vector<char> buffer;
+};
+
+// A thread with a hidden context that shares objects with the main one, for
+// GL work that must not hold up the frame loop. Jobs run in order with the
+// context current and end with glFinish(), so whatever they created is
+// complete by the time their `done` callback runs on the main thread from
+// pump(). Vertex arrays and framebuffers are not shared between contexts:
+// jobs must delete the ones they create before returning.
+class GLWorker {
+public:
+    GLWorker() = default;
+    GLWorker(const GLWorker&) = delete;
+    GLWorker& operator=(const GLWorker&) = delete;
+    ~GLWorker() { destroy(); }
+
+    // Call from the main thread, which owns `shareWith`.
+    bool init(GLFWwindow* shareWith);
+    // Waits for the job in progress; queued jobs and callbacks are dropped.
+    void destroy();
+    bool isReady() const { return context != nullptr; }
+
+    void submit(std::function<void()> job, std::function<void()> done);
+    // Runs the callbacks of finished jobs. Call once per frame.
+    void pump();
+    size_t getPendingCount() const;
+
+private:
+    void run();
+
+    GLFWwindow* context = nullptr;
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::pair<std::function<void()>, std::function<void()>>> jobs;
+    std::vector<std::function<void()>> finished;
+    size_t running = 0;
+    bool stopping = false;
+};
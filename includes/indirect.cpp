@@ -0,0 +1,158 @@
+#include "indirect.h"
+#include "culling.h"
+#include "glextra.h"
+#include "shadervariants.h"
+#include "shadows.h"
+
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+bool IndirectRenderer::init(const GeometryPool& geometryPool)
+{
+    const GLCapabilities& caps = GetGLCapabilities();
+    if (!caps.multiDrawIndirect || !caps.shaderStorage || !(caps.drawParameters || caps.baseInstance))
+        return false;
+
+    shader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/indirect.vertex.shader" },
+                              { GL_FRAGMENT_SHADER, "shaders/fragment.shader" },
+                              { GL_FRAGMENT_SHADER, "shaders/sunshadow.fragment.shader" } },
+                            ShaderFeatureTextured | ShaderFeatureDrawParameters, "#define SUN_SHADOWS\n");
+    useDrawParameters = caps.drawParameters;
+    if (useDrawParameters && shader.get(ShaderFeatureDrawParameters) == 0) {
+        // Some drivers list the extension but reject it in GLSL 4.30.
+        useDrawParameters = false;
+    }
+    if (shader.get(useDrawParameters ? static_cast<uint32_t>(ShaderFeatureDrawParameters) : 0u) == 0) {
+        shader = ShaderVariants();
+        return false;
+    }
+
+    pool = &geometryPool;
+
+    glGenBuffers(1, &objectBuffer);
+    glGenBuffers(1, &commandBuffer);
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+    pool->bindAttributes();
+    if (!useDrawParameters) {
+        glGenBuffers(1, &drawIdBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glVertexAttribDivisor(3, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void IndirectRenderer::destroy()
+{
+    shader = ShaderVariants();
+    if (VAO != 0)
+        glDeleteVertexArrays(1, &VAO);
+    for (GLuint* buffer : { &objectBuffer, &commandBuffer, &drawIdBuffer }) {
+        if (*buffer != 0)
+            glDeleteBuffers(1, buffer);
+        *buffer = 0;
+    }
+    VAO = 0;
+    drawIdCapacity = 0;
+}
+
+void IndirectRenderer::render(const std::vector<SceneObject>& scene, const TransformSystem& transforms,
+                              const std::vector<uint32_t>& visible, const glm::mat4& viewProjection,
+                              const glm::vec3& cameraPosition)
+{
+    stats = {};
+    if (!isReady())
+        return;
+
+    // Group by texture: everything sharing one is a single multi-draw.
+    auto textureOf = [&](uint32_t index) {
+        const Mesh& mesh = *scene[index].mesh;
+        return mesh.textures.empty() ? 0u : mesh.textures[0].id;
+    };
+    order.clear();
+    for (uint32_t index : visible) {
+        if (pool->find(scene[index].mesh))
+            order.push_back(index);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return textureOf(a) < textureOf(b); });
+
+    objects.clear();
+    commands.clear();
+    batches.clear();
+    for (uint32_t index : order) {
+        const SceneObject& object = scene[index];
+        const PooledMesh& pooled = *pool->find(object.mesh);
+        const MeshLOD& lod = pooled.lods[std::min<size_t>(std::max(object.lod, 0), pooled.lods.size() - 1)];
+
+        const ObjectMatrices& matrices = transforms.get(index);
+        objects.push_back({ matrices.world, matrices.normal });
+
+        GLuint drawIndex = static_cast<GLuint>(commands.size());
+        commands.push_back({ lod.indexCount, 1, pooled.firstIndex + lod.indexOffset, pooled.baseVertex, drawIndex });
+
+        GLuint texture = textureOf(index);
+        if (batches.empty() || batches.back().texture != texture)
+            batches.push_back({ texture, drawIndex, 0 });
+        batches.back().count++;
+    }
+    if (commands.empty())
+        return;
+
+    // Orphan and refill every frame; the previous contents may still be in flight.
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(ObjectData), objects.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+
+    if (!useDrawParameters && drawIdCapacity < commands.size()) {
+        drawIdCapacity = std::max<size_t>(commands.size(), drawIdCapacity * 2);
+        std::vector<GLuint> ids(drawIdCapacity);
+        for (size_t i = 0; i < ids.size(); ++i)
+            ids[i] = static_cast<GLuint>(i);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+        glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+    glBindVertexArray(VAO);
+
+    // Untextured batches sort first, so this switches variant at most once.
+    uint32_t baseFeatures = useDrawParameters ? static_cast<uint32_t>(ShaderFeatureDrawParameters) : 0u;
+    GLuint program = 0;
+    for (const Batch& batch : batches) {
+        GLuint batchProgram = shader.get(batch.texture != 0 ? baseFeatures | ShaderFeatureTextured : baseFeatures);
+        if (batchProgram != program) {
+            program = batchProgram;
+            glUseProgram(program);
+            glUniformMatrix4fv(glGetUniformLocation(program, "uViewProjection"), 1, GL_FALSE,
+                               glm::value_ptr(viewProjection));
+            BindForwardSunUniforms(shadows, program, sunDirection, cameraPosition, 4);
+        }
+        if (batch.texture != 0) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, batch.texture);
+            glUniform1i(glGetUniformLocation(program, "uTexture"), 0);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glUniform4f(glGetUniformLocation(program, "uColor"), 1.0f, 0.5f, 0.2f, 1.0f);
+        }
+        // gl_DrawIDARB restarts at zero in every call; baseInstance does not.
+        glUniform1ui(glGetUniformLocation(program, "uDrawOffset"), useDrawParameters ? batch.first : 0u);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    (void*)(batch.first * sizeof(DrawElementsIndirectCommand)),
+                                    static_cast<GLsizei>(batch.count), 0);
+        stats.multiDrawCalls++;
+    }
+    stats.draws = static_cast<uint32_t>(commands.size());
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
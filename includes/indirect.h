@@ -0,0 +1,73 @@
+#pragma once
+
+#include "def.h"
+#include "geometrypool.h"
+#include "shadervariants.h"
+#include "transforms.h"
+#include <cstdint>
+
+class CascadedShadowMaps;
+
+// Layout fixed by the GL spec for glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+struct IndirectStats {
+    uint32_t draws;
+    uint32_t multiDrawCalls;
+};
+
+// GL 4.3+ path: per-object transforms go to a shader storage buffer, the
+// visible list becomes indirect commands into the geometry pool, and each
+// texture is one glMultiDrawElementsIndirect call. Objects are found by
+// gl_DrawIDARB when available, else through baseInstance.
+class IndirectRenderer {
+public:
+    // Returns false, leaving the renderer unusable, when the context lacks
+    // multi-draw indirect, shader storage or base instance support.
+    bool init(const GeometryPool& pool);
+    void destroy();
+    bool isReady() const { return !shader.isEmpty(); }
+
+    // Objects whose mesh is not in the pool are skipped. `transforms` holds
+    // this frame's matrices for every object in `scene`.
+    void render(const std::vector<SceneObject>& scene, const TransformSystem& transforms,
+                const std::vector<uint32_t>& visible, const glm::mat4& viewProjection,
+                const glm::vec3& cameraPosition);
+
+    const IndirectStats& getStats() const { return stats; }
+
+    // Lit like the forward path: by the sun, with its shadows if any.
+    glm::vec3 sunDirection = glm::vec3(-0.4f, -1.0f, -0.3f);
+    const CascadedShadowMaps* shadows = nullptr;
+
+private:
+    struct ObjectData {
+        glm::mat4 model;
+        glm::mat4 normalMatrix;
+    };
+
+    struct Batch {
+        GLuint texture;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    const GeometryPool* pool = nullptr;
+    ShaderVariants shader;
+    GLuint VAO = 0;
+    GLuint objectBuffer = 0, commandBuffer = 0, drawIdBuffer = 0;
+    size_t drawIdCapacity = 0;
+    bool useDrawParameters = false;
+
+    std::vector<uint32_t> order;
+    std::vector<ObjectData> objects;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<Batch> batches;
+    IndirectStats stats{};
+};
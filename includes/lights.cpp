@@ -0,0 +1,45 @@
+#include "lights.h"
+
+#include <cmath>
+
+namespace {
+
+// Uniform float in [0, 1) from an index and a stream, without global state.
+float HashUnit(uint32_t index, uint32_t stream)
+{
+    uint32_t h = index * 0x9E3779B1u ^ (stream + 1) * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return static_cast<float>(h >> 8) * (1.0f / 16777216.0f);
+}
+
+glm::vec3 HueToColor(float hue)
+{
+    glm::vec3 color(std::fabs(hue * 6.0f - 3.0f) - 1.0f, 2.0f - std::fabs(hue * 6.0f - 2.0f),
+                    2.0f - std::fabs(hue * 6.0f - 4.0f));
+    return glm::clamp(color, glm::vec3(0.0f), glm::vec3(1.0f));
+}
+
+}
+
+void AnimateLightField(std::vector<PointLight>& lights, size_t count, const glm::vec3& center, float extent, float time)
+{
+    lights.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t index = static_cast<uint32_t>(i);
+        // Square root spreads the orbits evenly over the disc's area.
+        float orbit = extent * std::sqrt(HashUnit(index, 0));
+        float speed = (HashUnit(index, 1) - 0.5f) * 1.2f;
+        float angle = HashUnit(index, 2) * 6.2831853f + speed * time;
+        float height = extent * 0.3f * HashUnit(index, 3) + 0.2f * std::sin(time * 1.7f + static_cast<float>(i));
+
+        PointLight& light = lights[i];
+        light.position = center + glm::vec3(std::cos(angle) * orbit, height, std::sin(angle) * orbit);
+        light.radius = extent * (0.1f + 0.15f * HashUnit(index, 4));
+        light.color = glm::mix(HueToColor(HashUnit(index, 5)), glm::vec3(1.0f), 0.25f);
+        light.intensity = 1.0f + 2.0f * HashUnit(index, 6);
+    }
+}
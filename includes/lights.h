@@ -0,0 +1,18 @@
+#pragma once
+
+#include "def.h"
+#include <vector>
+
+// Point light with a hard range: its attenuation reaches zero at `radius`,
+// so the sphere bounds everything it touches.
+struct PointLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    float intensity;
+};
+
+// Fills `lights` with `count` lights orbiting `center` at up to `extent`
+// away, advanced to `time` seconds. Each light's orbit, colour and range are
+// derived from its index, so the field is stable as the count changes.
+void AnimateLightField(std::vector<PointLight>& lights, size_t count, const glm::vec3& center, float extent, float time);
@@ -0,0 +1,96 @@
+#include "meshcache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const char* CacheDirectory = "cache";
+const uint32_t CacheMagic = 0x48534d53;   // "SMSH"
+const uint32_t CacheVersion = 1;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint64_t count;
+};
+
+uint64_t Fnv1a(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string CachePath(const std::string& kind, uint64_t hash)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return std::string(CacheDirectory) + "/" + kind + "-" + name + ".bin";
+}
+
+}
+
+uint64_t HashMeshGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint64_t counts[2] = { vertices.size(), indices.size() };
+    hash = Fnv1a(hash, counts, sizeof(counts));
+    hash = Fnv1a(hash, vertices.data(), vertices.size() * sizeof(Vertex));
+    hash = Fnv1a(hash, indices.data(), indices.size() * sizeof(unsigned int));
+    return hash;
+}
+
+uint64_t HashMeshGeometry(const Mesh& mesh)
+{
+    return HashMeshGeometry(mesh.vertices, mesh.indices);
+}
+
+uint64_t HashCacheKey(const std::string& key)
+{
+    return Fnv1a(0xcbf29ce484222325ull, key.data(), key.size());
+}
+
+bool LoadMeshCache(const std::string& kind, uint64_t hash, std::vector<uint32_t>& payload)
+{
+    std::ifstream file(CachePath(kind, hash), std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    CacheHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != CacheMagic || header.version != CacheVersion || header.hash != hash)
+        return false;
+
+    payload.resize(header.count);
+    file.read(reinterpret_cast<char*>(payload.data()), payload.size() * sizeof(uint32_t));
+    if (!file) {
+        payload.clear();
+        return false;
+    }
+    return true;
+}
+
+bool SaveMeshCache(const std::string& kind, uint64_t hash, const std::vector<uint32_t>& payload)
+{
+    std::error_code error;
+    std::filesystem::create_directories(CacheDirectory, error);
+
+    std::string path = CachePath(kind, hash);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to write mesh cache: " << path << "\n";
+        return false;
+    }
+
+    CacheHeader header{ CacheMagic, CacheVersion, hash, payload.size() };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(payload.data()), payload.size() * sizeof(uint32_t));
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "def.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary cache for data derived from a mesh at load time (LOD chains,
+// reordered index buffers, ...). Entries live in cache/ and are keyed by a
+// short kind name plus a hash of the mesh contents, so editing a model
+// simply misses the cache instead of loading stale data.
+uint64_t HashMeshGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+uint64_t HashMeshGeometry(const Mesh& mesh);
+// For entries keyed by name rather than contents, such as program binaries.
+uint64_t HashCacheKey(const std::string& key);
+
+bool LoadMeshCache(const std::string& kind, uint64_t hash, std::vector<uint32_t>& payload);
+bool SaveMeshCache(const std::string& kind, uint64_t hash, const std::vector<uint32_t>& payload);
@@ -0,0 +1,467 @@
+#include "meshlet.h"
+#include "culling.h"
+#include "meshresidency.h"
+#include "parallel.h"
+#include "transforms.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define STRAING_SSE 1
+#endif
+
+namespace {
+
+const uint32_t Invalid = ~0u;
+// Clusters whose normals spread wider than this (dot with the axis) get no cone.
+const float MinConeSpread = 0.1f;
+// Clusters per culling task; a multiple of 4 so every task starts on an SSE lane boundary.
+const size_t CullGrain = 256;
+
+void ComputeMeshletBounds(const Mesh& mesh, const std::vector<unsigned int>& indices, Meshlet& meshlet)
+{
+    glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+    glm::vec3 normalSum(0.0f);
+    std::vector<glm::vec3> normals;
+    for (uint32_t i = meshlet.indexOffset; i < meshlet.indexOffset + meshlet.indexCount; i += 3) {
+        glm::vec3 a = mesh.vertices[indices[i]].Position;
+        glm::vec3 b = mesh.vertices[indices[i + 1]].Position;
+        glm::vec3 c = mesh.vertices[indices[i + 2]].Position;
+        boxMin = glm::min(boxMin, glm::min(a, glm::min(b, c)));
+        boxMax = glm::max(boxMax, glm::max(a, glm::max(b, c)));
+
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length > 0.0f) {
+            normals.push_back(normal / length);
+            normalSum += normals.back();
+        }
+    }
+
+    meshlet.center = (boxMin + boxMax) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (uint32_t i = meshlet.indexOffset; i < meshlet.indexOffset + meshlet.indexCount; ++i) {
+        glm::vec3 offset = mesh.vertices[indices[i]].Position - meshlet.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    meshlet.radius = std::sqrt(radiusSquared);
+
+    // The cone holds every face normal; backfacing from a viewpoint means
+    // every face is seen from behind, padded by the sphere for the apex.
+    meshlet.coneAxis = glm::vec3(0.0f);
+    meshlet.coneCutoff = 2.0f;
+    float axisLength = glm::length(normalSum);
+    if (axisLength <= 0.0f)
+        return;
+    glm::vec3 axis = normalSum / axisLength;
+    float minDot = 1.0f;
+    for (const glm::vec3& normal : normals)
+        minDot = std::min(minDot, glm::dot(normal, axis));
+    if (minDot <= MinConeSpread)
+        return;
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+}
+
+MeshletSet BuildMeshlets(const Mesh& mesh)
+{
+    MeshletSet set;
+    const std::vector<unsigned int>& indices = mesh.indices;
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = mesh.vertices.size();
+    // Dropped vertices (see ApplyMeshResidency) or stray indices leave nothing safe to cluster.
+    if (vertexCount == 0 ||
+        std::any_of(indices.begin(), indices.end(), [&](unsigned int v) { return v >= vertexCount; }))
+        return set;
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (unsigned int v : indices)
+        adjacencyOffsets[v + 1]++;
+    for (size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+    std::vector<glm::vec3> triangleCenter(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleCenter[t] = (mesh.vertices[indices[t * 3]].Position + mesh.vertices[indices[t * 3 + 1]].Position +
+                             mesh.vertices[indices[t * 3 + 2]].Position) / 3.0f;
+    }
+
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> vertexStamp(vertexCount, Invalid);
+    std::vector<uint32_t> candidateStamp(triangleCount, Invalid);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> clusterTriangles;
+    size_t seed = 0;
+
+    // Greedy growth: start from the next unused triangle and keep adding the
+    // neighbour that brings the fewest new vertices, nearest to the cluster
+    // centroid on ties, until the triangle or vertex budget is used up.
+    for (;;) {
+        while (seed < triangleCount && emitted[seed])
+            ++seed;
+        if (seed == triangleCount)
+            break;
+
+        uint32_t stamp = static_cast<uint32_t>(set.meshlets.size());
+        size_t vertexUsed = 0;
+        glm::vec3 centroidSum(0.0f);
+        candidates.clear();
+        clusterTriangles.clear();
+
+        auto addTriangle = [&](uint32_t t) {
+            emitted[t] = 1;
+            clusterTriangles.push_back(t);
+            centroidSum += triangleCenter[t];
+            for (int k = 0; k < 3; ++k) {
+                unsigned int v = indices[t * 3 + k];
+                if (vertexStamp[v] == stamp)
+                    continue;
+                vertexStamp[v] = stamp;
+                ++vertexUsed;
+                for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a) {
+                    uint32_t neighbour = adjacency[a];
+                    if (!emitted[neighbour] && candidateStamp[neighbour] != stamp) {
+                        candidateStamp[neighbour] = stamp;
+                        candidates.push_back(neighbour);
+                    }
+                }
+            }
+        };
+        addTriangle(static_cast<uint32_t>(seed));
+
+        while (clusterTriangles.size() < MeshletSet::MaxTriangles) {
+            glm::vec3 centroid = centroidSum / static_cast<float>(clusterTriangles.size());
+            uint32_t best = Invalid;
+            int bestNew = 4;
+            float bestDistance = FLT_MAX;
+            size_t write = 0;
+            for (uint32_t candidate : candidates) {
+                if (emitted[candidate])
+                    continue;
+                candidates[write++] = candidate;
+
+                int newVertices = 0;
+                for (int k = 0; k < 3; ++k)
+                    newVertices += vertexStamp[indices[candidate * 3 + k]] != stamp ? 1 : 0;
+                if (vertexUsed + newVertices > MeshletSet::MaxVertices)
+                    continue;
+                glm::vec3 offset = triangleCenter[candidate] - centroid;
+                float distance = glm::dot(offset, offset);
+                if (newVertices < bestNew || (newVertices == bestNew && distance < bestDistance)) {
+                    best = candidate;
+                    bestNew = newVertices;
+                    bestDistance = distance;
+                }
+            }
+            candidates.resize(write);
+            if (best == Invalid)
+                break;
+            addTriangle(best);
+        }
+
+        Meshlet meshlet;
+        meshlet.indexOffset = static_cast<uint32_t>(set.indices.size());
+        meshlet.indexCount = static_cast<uint32_t>(clusterTriangles.size() * 3);
+        for (uint32_t t : clusterTriangles)
+            set.indices.insert(set.indices.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+        ComputeMeshletBounds(mesh, set.indices, meshlet);
+        set.meshlets.push_back(meshlet);
+    }
+
+    size_t padded = (set.meshlets.size() + 3) & ~size_t(3);
+    for (std::vector<float>* array : { &set.centerX, &set.centerY, &set.centerZ, &set.radius,
+                                       &set.axisX, &set.axisY, &set.axisZ, &set.cutoff })
+        array->assign(padded, 0.0f);
+    for (size_t i = 0; i < set.meshlets.size(); ++i) {
+        const Meshlet& meshlet = set.meshlets[i];
+        set.centerX[i] = meshlet.center.x;
+        set.centerY[i] = meshlet.center.y;
+        set.centerZ[i] = meshlet.center.z;
+        set.radius[i] = meshlet.radius;
+        set.axisX[i] = meshlet.coneAxis.x;
+        set.axisY[i] = meshlet.coneAxis.y;
+        set.axisZ[i] = meshlet.coneAxis.z;
+        set.cutoff[i] = meshlet.coneCutoff;
+    }
+    return set;
+}
+
+MeshletSet& GetMeshMeshlets(Mesh& mesh)
+{
+    if (mesh.meshlets)
+        return *mesh.meshlets;
+
+    if (!RestoreMeshCPUData(mesh)) {
+        mesh.meshlets = std::make_shared<MeshletSet>();
+        return *mesh.meshlets;
+    }
+    mesh.meshlets = std::make_shared<MeshletSet>(BuildMeshlets(mesh));
+    ReleaseMeshCPUData(mesh);
+    UploadMeshletBuffers(mesh);
+    return *mesh.meshlets;
+}
+
+void UploadMeshletBuffers(Mesh& mesh)
+{
+    if (!mesh.meshlets)
+        return;
+    MeshletSet& set = *mesh.meshlets;
+
+    // Same attribute layout as Mesh::upload(), with its own element buffer.
+    set.VAO = GLVertexArray::create();
+    set.EBO = GLBuffer::create();
+    glBindVertexArray(set.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, set.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, set.indices.size() * sizeof(unsigned int), nullptr, GL_STREAM_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+
+    set.depthVAO.reset();
+    if (mesh.positionVBO) {
+        set.depthVAO = GLVertexArray::create();
+        glBindVertexArray(set.depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.positionVBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, set.EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshletCuller::beginFrame()
+{
+    stats = {};
+}
+
+size_t MeshletCuller::cull(MeshletSet& set, const glm::mat4& model, const glm::mat4& viewProjection,
+                           const glm::vec3& cameraPosition, float pixelsPerUnit)
+{
+    size_t indexCount = cullIndices(set, model, viewProjection, cameraPosition, pixelsPerUnit);
+
+    // Orphan the previous contents so the driver never waits on last frame's draw.
+    glBindVertexArray(set.VAO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, set.indices.size() * sizeof(unsigned int), nullptr, GL_STREAM_DRAW);
+    if (indexCount > 0)
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexCount * sizeof(unsigned int), stream.data());
+    glBindVertexArray(0);
+    return indexCount;
+}
+
+size_t MeshletCuller::cullIndices(const MeshletSet& set, const glm::mat4& model, const glm::mat4& viewProjection,
+                                  const glm::vec3& cameraPosition, float pixelsPerUnit)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t count = set.meshlets.size();
+
+    // Everything runs in object space: the planes of viewProjection * model
+    // are normalized there, so object-space radii can be used directly.
+    Frustum frustum = ExtractFrustum(viewProjection * model);
+    glm::vec3 camera = glm::vec3(AffineInverse(model) * glm::vec4(cameraPosition, 1.0f));
+
+    // Cones and projected sizes only survive the transform under uniform scale.
+    float scaleX = glm::length(glm::vec3(model[0]));
+    float scaleY = glm::length(glm::vec3(model[1]));
+    float scaleZ = glm::length(glm::vec3(model[2]));
+    bool uniformScale = std::fabs(scaleX - scaleY) <= 1e-3f * scaleX && std::fabs(scaleX - scaleZ) <= 1e-3f * scaleX;
+    bool testCone = backfaceCulling && uniformScale;
+    bool testSmall = smallClusterCulling && uniformScale && pixelsPerUnit > 0.0f;
+    // Projected diameter 2 r ppu / d < minPixels, compared squared.
+    float smallScale = 4.0f * pixelsPerUnit * pixelsPerUnit / (minClusterPixels * minClusterPixels);
+
+    size_t chunkCount = (count + CullGrain - 1) / CullGrain;
+    survivors.resize(count);
+    // Per chunk: survivors, frustum, backface and small rejections, surviving indices.
+    chunkCounts.assign(chunkCount * 5, 0);
+
+    ParallelFor(count, CullGrain, [&](size_t begin, size_t end) {
+        uint32_t* counts = &chunkCounts[begin / CullGrain * 5];
+        uint32_t written = 0;
+        auto keep = [&](size_t i, bool frustumOut, bool backface, bool small) {
+            if (frustumOut) {
+                counts[1]++;
+            } else if (backface) {
+                counts[2]++;
+            } else if (small) {
+                counts[3]++;
+            } else {
+                survivors[begin + written++] = static_cast<uint32_t>(i);
+                counts[4] += set.meshlets[i].indexCount;
+            }
+        };
+
+#ifdef STRAING_SSE
+        __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; ++p) {
+            planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+            planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+            planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+            planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+        }
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 camX = _mm_set1_ps(camera.x), camY = _mm_set1_ps(camera.y), camZ = _mm_set1_ps(camera.z);
+        const __m128 smallFactor = _mm_set1_ps(smallScale);
+
+        for (size_t i = begin; i < end; i += 4) {
+            __m128 cx = _mm_loadu_ps(&set.centerX[i]);
+            __m128 cy = _mm_loadu_ps(&set.centerY[i]);
+            __m128 cz = _mm_loadu_ps(&set.centerZ[i]);
+            __m128 r = _mm_loadu_ps(&set.radius[i]);
+            __m128 negR = _mm_sub_ps(zero, r);
+
+            __m128 frustumOut = zero;
+            if (frustumCulling) {
+                for (int p = 0; p < 6; ++p) {
+                    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                                          _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+                    frustumOut = _mm_or_ps(frustumOut, _mm_cmplt_ps(d, negR));
+                }
+            }
+
+            __m128 dx = _mm_sub_ps(cx, camX);
+            __m128 dy = _mm_sub_ps(cy, camY);
+            __m128 dz = _mm_sub_ps(cz, camZ);
+            __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+            __m128 backface = zero;
+            if (testCone) {
+                __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&set.axisX[i])),
+                                                     _mm_mul_ps(dy, _mm_loadu_ps(&set.axisY[i]))),
+                                          _mm_mul_ps(dz, _mm_loadu_ps(&set.axisZ[i])));
+                __m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&set.cutoff[i]), _mm_sqrt_ps(distanceSquared)), r);
+                backface = _mm_cmpge_ps(along, limit);
+            }
+
+            __m128 small = zero;
+            if (testSmall) {
+                __m128 radiusSquared = _mm_mul_ps(r, r);
+                __m128 outsideSphere = _mm_cmpgt_ps(distanceSquared, radiusSquared);
+                small = _mm_and_ps(outsideSphere, _mm_cmplt_ps(_mm_mul_ps(smallFactor, radiusSquared), distanceSquared));
+            }
+
+            int frustumMask = _mm_movemask_ps(frustumOut);
+            int backfaceMask = _mm_movemask_ps(backface);
+            int smallMask = _mm_movemask_ps(small);
+            for (int lane = 0; lane < 4 && i + lane < end; ++lane)
+                keep(i + lane, (frustumMask >> lane) & 1, (backfaceMask >> lane) & 1, (smallMask >> lane) & 1);
+        }
+#else
+        for (size_t i = begin; i < end; ++i) {
+            const Meshlet& meshlet = set.meshlets[i];
+            bool frustumOut = frustumCulling && !SphereInFrustum(frustum, { meshlet.center, meshlet.radius });
+            glm::vec3 toCluster = meshlet.center - camera;
+            float distanceSquared = glm::dot(toCluster, toCluster);
+            bool backface = testCone && glm::dot(toCluster, meshlet.coneAxis) >=
+                                        meshlet.coneCutoff * std::sqrt(distanceSquared) + meshlet.radius;
+            float radiusSquared = meshlet.radius * meshlet.radius;
+            bool small = testSmall && distanceSquared > radiusSquared && smallScale * radiusSquared < distanceSquared;
+            keep(i, frustumOut, backface, small);
+        }
+#endif
+        counts[0] = written;
+    });
+
+    // Compact: each chunk copies its clusters' triangles to its own slice.
+    std::vector<size_t> chunkOffsets(chunkCount + 1, 0);
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        const uint32_t* counts = &chunkCounts[chunk * 5];
+        chunkOffsets[chunk + 1] = chunkOffsets[chunk] + counts[4];
+        stats.frustumCulled += counts[1];
+        stats.backfaceCulled += counts[2];
+        stats.smallCulled += counts[3];
+    }
+    size_t indexCount = chunkOffsets[chunkCount];
+    stream.resize(indexCount);
+    ParallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk) {
+            unsigned int* out = stream.data() + chunkOffsets[chunk];
+            const uint32_t* ids = &survivors[chunk * CullGrain];
+            for (uint32_t k = 0; k < chunkCounts[chunk * 5]; ++k) {
+                const Meshlet& meshlet = set.meshlets[ids[k]];
+                std::copy(set.indices.begin() + meshlet.indexOffset,
+                          set.indices.begin() + meshlet.indexOffset + meshlet.indexCount, out);
+                out += meshlet.indexCount;
+            }
+        }
+    });
+
+    stats.clusters += static_cast<uint32_t>(count);
+    stats.triangles += set.indices.size() / 3;
+    stats.trianglesSubmitted += indexCount / 3;
+    stats.cullMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return indexCount;
+}
+
+std::string BenchmarkMeshletCulling(const Mesh& mesh)
+{
+    using Clock = std::chrono::steady_clock;
+    std::ostringstream report;
+    report.setf(std::ios::fixed);
+    report.precision(2);
+
+    auto t0 = Clock::now();
+    MeshletSet set = BuildMeshlets(mesh);
+    auto t1 = Clock::now();
+    if (set.meshlets.empty())
+        return "Meshlet benchmark: empty mesh\n";
+    report << "Meshlets: " << set.meshlets.size() << " clusters, "
+           << static_cast<float>(set.indices.size() / 3) / set.meshlets.size() << " triangles each, built in "
+           << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+
+    // Half the viewpoints orbit outside the mesh, half sit close to its surface.
+    const int ViewCount = 32;
+    const float ViewportHeight = 800.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 2.0f, 0.1f, 1000.0f);
+    float pixelsPerUnit = projection[1][1] * ViewportHeight * 0.5f;
+    glm::vec3 center = mesh.sphere.center;
+    float radius = std::max(mesh.sphere.radius, 1e-3f);
+
+    struct Config {
+        const char* name;
+        bool frustum, backface, small;
+    };
+    const Config configs[] = {
+        { "frustum", true, false, false },
+        { "backface cone", false, true, false },
+        { "small cluster", false, false, true },
+        { "all", true, true, true },
+    };
+
+    for (const Config& config : configs) {
+        MeshletCuller culler;
+        culler.frustumCulling = config.frustum;
+        culler.backfaceCulling = config.backface;
+        culler.smallClusterCulling = config.small;
+        culler.beginFrame();
+        for (int view = 0; view < ViewCount; ++view) {
+            float angle = 6.2831853f * view / (ViewCount / 2);
+            float distance = view < ViewCount / 2 ? radius * 3.0f : radius * 1.1f;
+            glm::vec3 eye = center + glm::vec3(std::cos(angle), 0.3f, std::sin(angle)) * distance;
+            glm::vec3 target = view < ViewCount / 2 ? center : center + glm::vec3(-std::sin(angle), 0.0f, std::cos(angle)) * radius;
+            glm::mat4 viewMatrix = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+            culler.cullIndices(set, glm::mat4(1.0f), projection * viewMatrix, eye, pixelsPerUnit);
+        }
+        const MeshletCullStats& stats = culler.getStats();
+        double saved = 100.0 * (1.0 - static_cast<double>(stats.trianglesSubmitted) / static_cast<double>(stats.triangles));
+        report << "  " << config.name << ": " << saved << "% triangles saved, "
+               << stats.cullMs / ViewCount << " ms per cull\n";
+    }
+    return report.str();
+}
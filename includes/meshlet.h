@@ -0,0 +1,89 @@
+#pragma once
+
+#include "def.h"
+#include <cstdint>
+#include <string>
+
+// A small cluster of neighbouring triangles with its object-space bounding
+// sphere and normal cone. coneCutoff > 1 marks a cluster whose normals are
+// too spread out for backface rejection.
+struct Meshlet {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// The mesh's triangles regrouped into meshlets. Bounds are duplicated in
+// structure-of-arrays layout, padded to a multiple of 4, for the SSE cull.
+struct MeshletSet {
+    static constexpr size_t MaxVertices = 64;
+    static constexpr size_t MaxTriangles = 124;
+
+    std::vector<Meshlet> meshlets;
+    std::vector<unsigned int> indices;   // meshlet-ordered triangle list
+    std::vector<float> centerX, centerY, centerZ, radius;
+    std::vector<float> axisX, axisY, axisZ, cutoff;
+
+    // Shares the mesh's vertex buffer; the element buffer receives the
+    // indices of the clusters that survived culling each frame.
+    GLVertexArray VAO;
+    GLBuffer EBO;
+    // Same element buffer on the mesh's position stream, if it has one.
+    GLVertexArray depthVAO;
+};
+
+// Empty when the mesh has no CPU-side vertices or an index is out of range.
+MeshletSet BuildMeshlets(const Mesh& mesh);
+// Builds the mesh's meshlets and their stream buffers on first use.
+MeshletSet& GetMeshMeshlets(Mesh& mesh);
+// Recreates the stream buffers of already built meshlets on the mesh's
+// current vertex buffer.
+void UploadMeshletBuffers(Mesh& mesh);
+
+struct MeshletCullStats {
+    uint32_t clusters;
+    uint32_t frustumCulled;
+    uint32_t backfaceCulled;
+    uint32_t smallCulled;
+    uint64_t triangles;
+    uint64_t trianglesSubmitted;
+    float cullMs;
+};
+
+// Per-object cluster culling: frustum, normal cone and projected size tests
+// run four clusters at a time with SSE across the worker pool, then the
+// survivors' indices are compacted into one stream for a single draw.
+class MeshletCuller {
+public:
+    void beginFrame();
+    // Culls in object space and uploads the surviving indices to set.EBO.
+    // Returns the number of indices to draw.
+    size_t cull(MeshletSet& set, const glm::mat4& model, const glm::mat4& viewProjection,
+                const glm::vec3& cameraPosition, float pixelsPerUnit);
+
+    const MeshletCullStats& getStats() const { return stats; }
+
+    bool frustumCulling = true;
+    // The renderer draws both faces, so this is only safe on closed meshes.
+    bool backfaceCulling = false;
+    bool smallClusterCulling = true;
+    float minClusterPixels = 0.5f;
+
+private:
+    size_t cullIndices(const MeshletSet& set, const glm::mat4& model, const glm::mat4& viewProjection,
+                       const glm::vec3& cameraPosition, float pixelsPerUnit);
+
+    std::vector<uint32_t> survivors;
+    std::vector<uint32_t> chunkCounts;
+    std::vector<unsigned int> stream;
+    MeshletCullStats stats{};
+
+    friend std::string BenchmarkMeshletCulling(const Mesh& mesh);
+};
+
+// Culls the mesh's clusters from a ring of viewpoints and reports the
+// triangles saved by each test and the cost of the pass.
+std::string BenchmarkMeshletCulling(const Mesh& mesh);
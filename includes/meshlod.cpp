@@ -0,0 +1,612 @@
+#include "meshlod.h"
+#include "meshcache.h"
+#include "meshoptimize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+const uint32_t Invalid = ~0u;
+// Planes along open borders and seams weigh this much more than faces.
+const float BorderWeight = 10.0f;
+// Penalty per unit of squared normal change, relative to the edge length.
+const float NormalWeight = 0.5f;
+// Collapses may not turn a face by more than ~75 degrees.
+const float MinFaceAlignment = 0.25f;
+const size_t MinLODTriangles = 64;
+// A level has to drop at least 10% of the triangles to be worth keeping.
+const float MinLODReduction = 0.9f;
+
+enum VertexKind : uint8_t {
+    Manifold,   // may collapse into any neighbour
+    Border,     // single wedge on an open border, collapses along the border
+    Seam,       // two wedges on a UV/normal seam, collapses along the seam
+    Locked,     // corners, seam ends, non-manifold: never moves
+};
+
+// Sum of squared plane distances, kept as the symmetric matrix A, vector b
+// and constant c of p'Ap + 2b'p + c.
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+Quadric PlaneQuadric(const glm::vec3& n, float d, float weight)
+{
+    double w = weight;
+    Quadric q;
+    q.a00 = w * n.x * n.x;
+    q.a01 = w * n.x * n.y;
+    q.a02 = w * n.x * n.z;
+    q.a11 = w * n.y * n.y;
+    q.a12 = w * n.y * n.z;
+    q.a22 = w * n.z * n.z;
+    q.b0 = w * n.x * d;
+    q.b1 = w * n.y * d;
+    q.b2 = w * n.z * d;
+    q.c = w * d * d;
+    q.weight = w;
+    return q;
+}
+
+void AddQuadric(Quadric& to, const Quadric& q)
+{
+    to.a00 += q.a00; to.a01 += q.a01; to.a02 += q.a02;
+    to.a11 += q.a11; to.a12 += q.a12; to.a22 += q.a22;
+    to.b0 += q.b0; to.b1 += q.b1; to.b2 += q.b2;
+    to.c += q.c;
+    to.weight += q.weight;
+}
+
+// Weighted mean squared distance of p from the accumulated planes.
+double QuadricError(const Quadric& q, const glm::vec3& p)
+{
+    if (q.weight <= 0.0)
+        return 0.0;
+    double x = p.x, y = p.y, z = p.z;
+    double e = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+             + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+             + 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    return std::max(e, 0.0) / q.weight;
+}
+
+struct PositionKey {
+    uint32_t bits[3];
+    bool operator==(const PositionKey& other) const { return std::memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct PositionKeyHash {
+    size_t operator()(const PositionKey& key) const
+    {
+        return (static_cast<size_t>(key.bits[0]) * 73856093u) ^ (static_cast<size_t>(key.bits[1]) * 19349663u) ^
+               (static_cast<size_t>(key.bits[2]) * 83492791u);
+    }
+};
+
+inline uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+    return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+struct Collapse {
+    uint32_t from, to;
+    // Sibling wedge pair that moves along with a seam collapse.
+    uint32_t seamFrom, seamTo;
+    float geometricError;
+    float cost;
+};
+
+// State shared by the collapse passes of one SimplifyMesh() call.
+class Simplifier {
+public:
+    Simplifier(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+        : vertices(vertices), indices(indices)
+    {
+        weldPositions();
+        classifyVertices();
+        buildQuadrics();
+    }
+
+    std::vector<unsigned int> run(size_t targetIndexCount, float& error)
+    {
+        size_t targetTriangles = targetIndexCount / 3;
+        double maxError = 0.0;
+        while (indices.size() / 3 > targetTriangles) {
+            size_t collapsed = collapsePass(targetTriangles, maxError);
+            if (collapsed == 0)
+                break;
+        }
+        error = static_cast<float>(std::sqrt(maxError));
+        return indices;
+    }
+
+private:
+    void weldPositions();
+    void classifyVertices();
+    void buildQuadrics();
+    bool canCollapse(uint32_t from, uint32_t to, Collapse& collapse) const;
+    bool keepsOrientation(uint32_t fromPosition, uint32_t toPosition, const glm::vec3& target) const;
+    void relinkOpenEdges(uint32_t from, uint32_t to);
+    size_t collapsePass(size_t targetTriangles, double& maxError);
+
+    const std::vector<Vertex>& vertices;
+    std::vector<unsigned int> indices;
+
+    std::vector<uint32_t> position;   // first vertex with the same position
+    std::vector<uint32_t> wedge;      // next vertex with the same position, circular
+    std::vector<uint32_t> openIn, openOut;
+    std::vector<VertexKind> kind;
+    std::vector<Quadric> quadrics;    // indexed by position
+    std::unordered_set<uint64_t> positionEdges;
+    std::vector<uint8_t> openEdge;    // per corner of the input: edge to the next corner is open
+
+    // Triangles around each position, rebuilt every pass.
+    std::vector<uint32_t> adjacencyOffsets;
+    std::vector<uint32_t> adjacency;
+};
+
+void Simplifier::weldPositions()
+{
+    size_t vertexCount = vertices.size();
+    position.resize(vertexCount);
+    wedge.resize(vertexCount);
+
+    std::unordered_map<PositionKey, uint32_t, PositionKeyHash> firstVertex;
+    firstVertex.reserve(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        PositionKey key;
+        std::memcpy(key.bits, &vertices[v].Position, sizeof(key.bits));
+        uint32_t first = firstVertex.emplace(key, v).first->second;
+        position[v] = first;
+        if (first == v) {
+            wedge[v] = v;
+        } else {
+            wedge[v] = wedge[first];
+            wedge[first] = v;
+        }
+    }
+}
+
+void Simplifier::classifyVertices()
+{
+    size_t vertexCount = vertices.size();
+    std::unordered_set<uint64_t> wedgeEdges;
+    wedgeEdges.reserve(indices.size());
+    positionEdges.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int e = 0; e < 3; ++e) {
+            uint32_t a = indices[i + e], b = indices[i + (e + 1) % 3];
+            wedgeEdges.insert(EdgeKey(a, b));
+            positionEdges.insert(EdgeKey(position[a], position[b]));
+        }
+    }
+
+    // An edge is open when no triangle uses it in the other direction. The
+    // open neighbours of a vertex are tracked so borders and seams can be
+    // walked; a vertex with several open edges on one side points to itself.
+    openIn.assign(vertexCount, Invalid);
+    openOut.assign(vertexCount, Invalid);
+    openEdge.assign(indices.size(), 0);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int e = 0; e < 3; ++e) {
+            uint32_t a = indices[i + e], b = indices[i + (e + 1) % 3];
+            if (wedgeEdges.count(EdgeKey(b, a)))
+                continue;
+            openEdge[i + e] = 1;
+            openOut[a] = openOut[a] == Invalid ? b : a;
+            openIn[b] = openIn[b] == Invalid ? a : b;
+        }
+    }
+
+    auto singleOpenPath = [&](uint32_t v) {
+        return openIn[v] != Invalid && openIn[v] != v && openOut[v] != Invalid && openOut[v] != v;
+    };
+    auto positionOpen = [&](uint32_t a, uint32_t b) {
+        return positionEdges.count(EdgeKey(position[b], position[a])) == 0;
+    };
+
+    kind.assign(vertexCount, Locked);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        if (position[v] != v)
+            continue;
+
+        uint32_t wedgeCount = 1;
+        for (uint32_t w = wedge[v]; w != v; w = wedge[w])
+            ++wedgeCount;
+
+        VertexKind vertexKind = Locked;
+        if (wedgeCount == 1) {
+            if (openIn[v] == Invalid && openOut[v] == Invalid)
+                vertexKind = Manifold;
+            else if (singleOpenPath(v) && positionOpen(v, openOut[v]) && positionOpen(openIn[v], v))
+                vertexKind = Border;
+        } else if (wedgeCount == 2) {
+            uint32_t w0 = v, w1 = wedge[v];
+            // Both sides of the seam must run between the same two positions
+            // in opposite directions, and the edges must be closed geometrically.
+            if (singleOpenPath(w0) && singleOpenPath(w1) &&
+                position[openOut[w0]] == position[openIn[w1]] && position[openIn[w0]] == position[openOut[w1]] &&
+                !positionOpen(w0, openOut[w0]) && !positionOpen(openIn[w0], w0))
+                vertexKind = Seam;
+        }
+
+        uint32_t w = v;
+        do {
+            kind[w] = vertexKind;
+            w = wedge[w];
+        } while (w != v);
+    }
+}
+
+void Simplifier::buildQuadrics()
+{
+    quadrics.assign(vertices.size(), Quadric{});
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        uint32_t corner[3] = { indices[i], indices[i + 1], indices[i + 2] };
+        glm::vec3 p0 = vertices[corner[0]].Position;
+        glm::vec3 p1 = vertices[corner[1]].Position;
+        glm::vec3 p2 = vertices[corner[2]].Position;
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float doubleArea = glm::length(normal);
+        if (doubleArea <= 0.0f)
+            continue;
+        normal /= doubleArea;
+
+        Quadric face = PlaneQuadric(normal, -glm::dot(normal, p0), doubleArea * 0.5f);
+        for (uint32_t v : corner)
+            AddQuadric(quadrics[position[v]], face);
+
+        // Planes through open edges, perpendicular to the face, keep borders
+        // and seams from drifting sideways.
+        for (int e = 0; e < 3; ++e) {
+            if (!openEdge[i + e])
+                continue;
+            uint32_t a = corner[e], b = corner[(e + 1) % 3];
+            glm::vec3 edge = vertices[b].Position - vertices[a].Position;
+            float lengthSquared = glm::dot(edge, edge);
+            glm::vec3 side = glm::cross(edge, normal);
+            float sideLength = glm::length(side);
+            if (sideLength <= 0.0f)
+                continue;
+            side /= sideLength;
+            Quadric border = PlaneQuadric(side, -glm::dot(side, vertices[a].Position), lengthSquared * BorderWeight);
+            AddQuadric(quadrics[position[a]], border);
+            AddQuadric(quadrics[position[b]], border);
+        }
+    }
+}
+
+bool Simplifier::canCollapse(uint32_t from, uint32_t to, Collapse& collapse) const
+{
+    collapse.from = from;
+    collapse.to = to;
+    collapse.seamFrom = Invalid;
+    collapse.seamTo = Invalid;
+
+    switch (kind[from]) {
+    case Manifold:
+        return true;
+    case Border:
+        return kind[to] == Border && (openOut[from] == to || openIn[from] == to) && openIn[from] != openOut[from];
+    case Seam: {
+        if (kind[to] != Seam || !(openOut[from] == to || openIn[from] == to) || openIn[from] == openOut[from])
+            return false;
+        // The other side of the seam runs the opposite way.
+        uint32_t sibling = wedge[from];
+        uint32_t siblingTarget = openOut[from] == to ? openIn[sibling] : openOut[sibling];
+        if (siblingTarget == Invalid || siblingTarget == to || position[siblingTarget] != position[to])
+            return false;
+        collapse.seamFrom = sibling;
+        collapse.seamTo = siblingTarget;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool Simplifier::keepsOrientation(uint32_t fromPosition, uint32_t toPosition, const glm::vec3& target) const
+{
+    for (uint32_t k = adjacencyOffsets[fromPosition]; k < adjacencyOffsets[fromPosition + 1]; ++k) {
+        size_t triangle = adjacency[k] * 3;
+        glm::vec3 p[3];
+        bool removed = false;
+        for (int c = 0; c < 3; ++c) {
+            uint32_t v = indices[triangle + c];
+            if (position[v] == toPosition)
+                removed = true;
+            p[c] = vertices[v].Position;
+        }
+        if (removed)
+            continue;
+
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        for (int c = 0; c < 3; ++c) {
+            if (position[indices[triangle + c]] == fromPosition)
+                p[c] = target;
+        }
+        glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float alignment = glm::dot(before, after);
+        if (alignment <= MinFaceAlignment * glm::length(before) * glm::length(after))
+            return false;
+    }
+    return true;
+}
+
+void Simplifier::relinkOpenEdges(uint32_t from, uint32_t to)
+{
+    if (openOut[from] == to) {
+        uint32_t previous = openIn[from];
+        openOut[previous] = to;
+        openIn[to] = previous;
+    } else {
+        uint32_t next = openOut[from];
+        openIn[next] = to;
+        openOut[to] = next;
+    }
+}
+
+size_t Simplifier::collapsePass(size_t targetTriangles, double& maxError)
+{
+    size_t vertexCount = vertices.size();
+    size_t triangleCount = indices.size() / 3;
+
+    adjacencyOffsets.assign(vertexCount + 1, 0);
+    for (unsigned int v : indices)
+        adjacencyOffsets[position[v] + 1]++;
+    for (size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    adjacency.resize(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[fill[position[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+
+    std::vector<Collapse> candidates;
+    candidates.reserve(indices.size() * 2);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int e = 0; e < 3; ++e) {
+            uint32_t ends[2] = { indices[i + e], indices[i + (e + 1) % 3] };
+            for (int direction = 0; direction < 2; ++direction) {
+                Collapse collapse;
+                if (!canCollapse(ends[direction], ends[1 - direction], collapse))
+                    continue;
+
+                const Vertex& from = vertices[collapse.from];
+                const Vertex& to = vertices[collapse.to];
+                Quadric combined = quadrics[position[collapse.from]];
+                AddQuadric(combined, quadrics[position[collapse.to]]);
+                double geometric = QuadricError(combined, to.Position);
+
+                glm::vec3 edge = to.Position - from.Position;
+                glm::vec3 normalChange = to.Normal - from.Normal;
+                float attribute = glm::dot(normalChange, normalChange);
+                if (collapse.seamFrom != Invalid) {
+                    normalChange = vertices[collapse.seamTo].Normal - vertices[collapse.seamFrom].Normal;
+                    attribute += glm::dot(normalChange, normalChange);
+                }
+
+                collapse.geometricError = static_cast<float>(geometric);
+                collapse.cost = static_cast<float>(geometric) + NormalWeight * attribute * glm::dot(edge, edge);
+                candidates.push_back(collapse);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+    // Greedy independent set: a position that moved or gained triangles this
+    // pass is frozen until the adjacency is rebuilt.
+    std::vector<uint32_t> remap(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        remap[v] = v;
+    std::vector<uint8_t> frozen(vertexCount, 0);
+    size_t collapsed = 0;
+
+    for (const Collapse& collapse : candidates) {
+        if (triangleCount <= targetTriangles)
+            break;
+        uint32_t fromPosition = position[collapse.from];
+        uint32_t toPosition = position[collapse.to];
+        if (frozen[fromPosition] || frozen[toPosition])
+            continue;
+        if (!keepsOrientation(fromPosition, toPosition, vertices[collapse.to].Position))
+            continue;
+
+        remap[collapse.from] = collapse.to;
+        if (collapse.seamFrom != Invalid)
+            remap[collapse.seamFrom] = collapse.seamTo;
+        if (kind[collapse.from] != Manifold) {
+            relinkOpenEdges(collapse.from, collapse.to);
+            if (collapse.seamFrom != Invalid)
+                relinkOpenEdges(collapse.seamFrom, collapse.seamTo);
+        }
+
+        for (uint32_t p : { fromPosition, toPosition }) {
+            for (uint32_t k = adjacencyOffsets[p]; k < adjacencyOffsets[p + 1]; ++k) {
+                size_t triangle = adjacency[k] * 3;
+                bool removed = p == fromPosition &&
+                               (position[indices[triangle]] == toPosition || position[indices[triangle + 1]] == toPosition ||
+                                position[indices[triangle + 2]] == toPosition);
+                if (removed)
+                    --triangleCount;
+                for (int c = 0; c < 3; ++c)
+                    frozen[position[indices[triangle + c]]] = 1;
+            }
+        }
+
+        AddQuadric(quadrics[toPosition], quadrics[fromPosition]);
+        maxError = std::max(maxError, static_cast<double>(collapse.geometricError));
+        ++collapsed;
+    }
+
+    if (collapsed == 0)
+        return 0;
+
+    size_t write = 0;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+        if (position[a] == position[b] || position[b] == position[c] || position[a] == position[c])
+            continue;
+        indices[write++] = a;
+        indices[write++] = b;
+        indices[write++] = c;
+    }
+    indices.resize(write);
+    return collapsed;
+}
+
+const char* LODCacheKind = "lod2";
+
+// Payload layout: level count, then per level its error bits, index count and indices.
+bool ReadLODPayload(const std::vector<uint32_t>& payload, Mesh& mesh)
+{
+    if (payload.empty())
+        return false;
+    size_t cursor = 1;
+    std::vector<MeshLOD> lods;
+    std::vector<unsigned int> lodIndices;
+    for (uint32_t level = 0; level < payload[0]; ++level) {
+        if (cursor + 2 > payload.size())
+            return false;
+        MeshLOD lod;
+        std::memcpy(&lod.error, &payload[cursor], sizeof(float));
+        lod.indexCount = payload[cursor + 1];
+        lod.indexOffset = static_cast<uint32_t>(mesh.indices.size() + lodIndices.size());
+        cursor += 2;
+        if (cursor + lod.indexCount > payload.size())
+            return false;
+        for (uint32_t i = 0; i < lod.indexCount; ++i) {
+            if (payload[cursor + i] >= mesh.vertices.size())
+                return false;
+        }
+        lodIndices.insert(lodIndices.end(), payload.begin() + cursor, payload.begin() + cursor + lod.indexCount);
+        cursor += lod.indexCount;
+        lods.push_back(lod);
+    }
+    mesh.lods.insert(mesh.lods.end(), lods.begin(), lods.end());
+    mesh.lodIndices = std::move(lodIndices);
+    return true;
+}
+
+std::vector<uint32_t> WriteLODPayload(const Mesh& mesh)
+{
+    std::vector<uint32_t> payload;
+    payload.push_back(static_cast<uint32_t>(mesh.lods.size() - 1));
+    for (size_t level = 1; level < mesh.lods.size(); ++level) {
+        const MeshLOD& lod = mesh.lods[level];
+        uint32_t errorBits;
+        std::memcpy(&errorBits, &lod.error, sizeof(float));
+        payload.push_back(errorBits);
+        payload.push_back(lod.indexCount);
+        size_t begin = lod.indexOffset - mesh.indices.size();
+        payload.insert(payload.end(), mesh.lodIndices.begin() + begin, mesh.lodIndices.begin() + begin + lod.indexCount);
+    }
+    return payload;
+}
+
+}
+
+std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                                       size_t targetIndexCount, float& error)
+{
+    error = 0.0f;
+    if (indices.size() <= targetIndexCount)
+        return indices;
+    Simplifier simplifier(vertices, indices);
+    return simplifier.run(targetIndexCount, error);
+}
+
+int GenerateMeshLODs(Mesh& mesh, int maxLevels)
+{
+    mesh.lods.clear();
+    mesh.lodIndices.clear();
+    mesh.lods.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+    if (mesh.indices.empty())
+        return 1;
+
+    uint64_t hash = HashMeshGeometry(mesh);
+    std::vector<uint32_t> payload;
+    if (!LoadMeshCache(LODCacheKind, hash, payload) || !ReadLODPayload(payload, mesh)) {
+        mesh.lods.resize(1);
+        mesh.lodIndices.clear();
+
+        // Every level starts from the full mesh so errors are measured
+        // against the original surface rather than piling up level by level.
+        size_t previousCount = mesh.indices.size();
+        for (int level = 1; level <= maxLevels; ++level) {
+            size_t target = previousCount / 6 * 3;
+            if (target / 3 < MinLODTriangles)
+                break;
+            float error = 0.0f;
+            std::vector<unsigned int> simplified = SimplifyMesh(mesh.vertices, mesh.indices, target, error);
+            if (simplified.size() > previousCount * MinLODReduction)
+                break;
+            OptimizeVertexCache(simplified, mesh.vertices.size());
+
+            MeshLOD lod;
+            lod.indexOffset = static_cast<uint32_t>(mesh.indices.size() + mesh.lodIndices.size());
+            lod.indexCount = static_cast<uint32_t>(simplified.size());
+            lod.error = std::max(error, mesh.lods.back().error);
+            mesh.lods.push_back(lod);
+            mesh.lodIndices.insert(mesh.lodIndices.end(), simplified.begin(), simplified.end());
+            previousCount = simplified.size();
+        }
+        SaveMeshCache(LODCacheKind, hash, WriteLODPayload(mesh));
+    }
+
+    size_t totalIndices = mesh.indices.size() + mesh.lodIndices.size();
+    glBindVertexArray(mesh.VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data());
+    if (!mesh.lodIndices.empty()) {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int),
+                        mesh.lodIndices.size() * sizeof(unsigned int), mesh.lodIndices.data());
+    }
+    glBindVertexArray(0);
+    return static_cast<int>(mesh.lods.size());
+}
+
+LODSelection MakeLODSelection(const glm::mat4& projection, int viewportHeight, float maxErrorPixels, float hysteresis)
+{
+    LODSelection selection;
+    selection.pixelsPerUnit = projection[1][1] * static_cast<float>(viewportHeight) * 0.5f;
+    selection.maxErrorPixels = maxErrorPixels;
+    selection.hysteresis = hysteresis;
+    return selection;
+}
+
+int SelectLOD(const SceneObject& object, const glm::vec3& cameraPosition, const LODSelection& selection)
+{
+    const std::vector<MeshLOD>& lods = object.mesh->lods;
+    int levels = static_cast<int>(lods.size());
+    if (levels <= 1)
+        return 0;
+
+    // Measure from the nearest point of the bounding sphere so large objects
+    // refine before the camera reaches their center.
+    float scale = std::max(std::fabs(object.scale.x), std::max(std::fabs(object.scale.y), std::fabs(object.scale.z)));
+    float distance = glm::length(object.worldSphere.center - cameraPosition) - object.worldSphere.radius;
+    if (distance <= 0.0f)
+        return 0;
+    float pixelsPerError = selection.pixelsPerUnit * scale / distance;
+
+    auto coarsestWithin = [&](int first, float limit) {
+        int level = first;
+        for (int l = first + 1; l < levels && lods[l].error * pixelsPerError <= limit; ++l)
+            level = l;
+        return level;
+    };
+
+    int current = std::min(std::max(object.lod, 0), levels - 1);
+    int level = coarsestWithin(0, selection.maxErrorPixels);
+    if (level > current)
+        level = coarsestWithin(current, selection.maxErrorPixels * (1.0f - selection.hysteresis));
+    return level;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "def.h"
+#include <cstdint>
+
+// Quadric error edge collapse (Garland & Heckbert) restricted to half-edge
+// collapses, so every level indexes the original vertex buffer. Open borders
+// and UV/normal seams only collapse along themselves and normal changes are
+// penalized, which keeps texture charts and shading intact. `error` receives
+// the object-space distance error of the result.
+std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                                       size_t targetIndexCount, float& error);
+
+// Builds up to `maxLevels` coarser levels, each about half the previous one,
+// or loads them from the mesh cache, and uploads them into the mesh's EBO.
+// Returns the total number of levels including the full mesh.
+int GenerateMeshLODs(Mesh& mesh, int maxLevels = 4);
+
+struct LODSelection {
+    float pixelsPerUnit;   // screen pixels covered by one world unit at distance 1
+    float maxErrorPixels;
+    float hysteresis;      // fraction of maxErrorPixels to undershoot before going coarser
+};
+
+LODSelection MakeLODSelection(const glm::mat4& projection, int viewportHeight, float maxErrorPixels, float hysteresis = 0.25f);
+
+// Coarsest level whose projected error stays under the limit. Switching to a
+// coarser level needs the extra margin so objects near a threshold do not
+// flicker between levels.
+int SelectLOD(const SceneObject& object, const glm::vec3& cameraPosition, const LODSelection& selection);
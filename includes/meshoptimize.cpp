@@ -0,0 +1,372 @@
+#include "meshoptimize.h"
+#include "meshcache.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+const uint32_t Invalid = ~0u;
+const char* OptimizeCacheKind = "optimize";
+
+// Forsyth's tuning: an LRU of 32 entries, the last triangle's vertices get a
+// flat score and low-valence vertices are boosted so islands get finished.
+const size_t LRUCacheSize = 32;
+const float CacheDecayPower = 1.5f;
+const float LastTriangleScore = 0.75f;
+const float ValenceBoostScale = 2.0f;
+const float ValenceBoostPower = 0.5f;
+const uint32_t MaxScoredValence = 32;
+
+float ForsythScore(int cachePosition, uint32_t remainingValence)
+{
+    if (remainingValence == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            score = LastTriangleScore;
+        } else {
+            float scaler = 1.0f / (LRUCacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, CacheDecayPower);
+        }
+    }
+    score += ValenceBoostScale * std::pow(static_cast<float>(std::min(remainingValence, MaxScoredValence)), -ValenceBoostPower);
+    return score;
+}
+
+// FIFO cache simulation by timestamps: a vertex is still cached if fewer
+// than cacheSize misses happened since it was last loaded.
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount, size_t cacheSize)
+        : stamps(vertexCount, 0), size(static_cast<uint32_t>(cacheSize)), time(static_cast<uint32_t>(cacheSize) + 1) {}
+
+    bool access(unsigned int v)
+    {
+        if (time - stamps[v] <= size)
+            return true;
+        stamps[v] = time++;
+        return false;
+    }
+
+    void flush() { time += size + 1; }
+
+private:
+    std::vector<uint32_t> stamps;
+    uint32_t size;
+    uint32_t time;
+};
+
+const size_t FifoCacheSize = 16;
+
+// New-to-old vertex order by first use.
+std::vector<uint32_t> VertexFetchOrder(const std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, Invalid);
+    std::vector<uint32_t> order;
+    order.reserve(vertexCount);
+    for (unsigned int v : indices) {
+        if (remap[v] == Invalid) {
+            remap[v] = static_cast<uint32_t>(order.size());
+            order.push_back(v);
+        }
+    }
+    return order;
+}
+
+void ApplyVertexOrder(const std::vector<uint32_t>& order, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::vector<uint32_t> remap(vertices.size(), Invalid);
+    std::vector<Vertex> reordered(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        remap[order[i]] = static_cast<uint32_t>(i);
+        reordered[i] = vertices[order[i]];
+    }
+    for (unsigned int& index : indices)
+        index = remap[index];
+    vertices.swap(reordered);
+}
+
+// Payload layout: vertex count, new-to-old vertex order, index count, indices.
+bool ReadOptimizePayload(const std::vector<uint32_t>& payload, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    if (payload.empty())
+        return false;
+    size_t vertexCount = payload[0];
+    if (vertexCount > vertices.size() || payload.size() != 2 + vertexCount + indices.size() ||
+        payload[1 + vertexCount] != indices.size())
+        return false;
+
+    std::vector<uint32_t> order(payload.begin() + 1, payload.begin() + 1 + vertexCount);
+    for (uint32_t v : order) {
+        if (v >= vertices.size())
+            return false;
+    }
+    std::vector<unsigned int> optimized(payload.begin() + 2 + vertexCount, payload.end());
+    for (unsigned int index : optimized) {
+        if (index >= vertexCount)
+            return false;
+    }
+
+    std::vector<Vertex> reordered(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+        reordered[i] = vertices[order[i]];
+    vertices.swap(reordered);
+    indices.swap(optimized);
+    return true;
+}
+
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, size_t cacheSize)
+{
+    VertexCacheStats stats{ 0.0f, 0.0f };
+    if (indices.empty())
+        return stats;
+
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<uint8_t> used(vertexCount, 0);
+    size_t misses = 0, unique = 0;
+    for (unsigned int v : indices) {
+        misses += cache.access(v) ? 0 : 1;
+        if (!used[v]) {
+            used[v] = 1;
+            ++unique;
+        }
+    }
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(unique);
+    return stats;
+}
+
+void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles still to be emitted around each vertex; the live ones are
+    // kept at the front of each vertex's range.
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (unsigned int v : indices)
+        offsets[v + 1]++;
+    for (size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] += offsets[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        unsigned int v = indices[i];
+        adjacency[offsets[v] + remaining[v]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = ForsythScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(LRUCacheSize + 3);
+    nextCache.reserve(LRUCacheSize + 3);
+
+    uint32_t best = static_cast<uint32_t>(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    size_t cursor = 0;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (best == Invalid) {
+            // Dead end: nothing in the cache has triangles left, continue in input order.
+            while (emitted[cursor])
+                ++cursor;
+            best = static_cast<uint32_t>(cursor);
+        }
+
+        emitted[best] = 1;
+        const unsigned int* corner = &indices[best * 3];
+        output.insert(output.end(), corner, corner + 3);
+
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = corner[k];
+            uint32_t* begin = &adjacency[offsets[v]];
+            uint32_t* end = begin + remaining[v];
+            uint32_t* it = std::find(begin, end, best);
+            if (it != end) {
+                std::swap(*it, *(end - 1));
+                remaining[v]--;
+            }
+        }
+
+        // Most recent first: the new triangle's vertices, then the old cache.
+        nextCache.clear();
+        for (int k = 0; k < 3; ++k) {
+            if (std::find(nextCache.begin(), nextCache.end(), corner[k]) == nextCache.end())
+                nextCache.push_back(corner[k]);
+        }
+        for (uint32_t v : cache) {
+            if (v != corner[0] && v != corner[1] && v != corner[2])
+                nextCache.push_back(v);
+        }
+
+        for (size_t i = 0; i < nextCache.size(); ++i) {
+            uint32_t v = nextCache[i];
+            int position = i < LRUCacheSize ? static_cast<int>(i) : -1;
+            float score = ForsythScore(position, remaining[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+            for (uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; ++a)
+                triangleScore[adjacency[a]] += delta;
+        }
+        if (nextCache.size() > LRUCacheSize)
+            nextCache.resize(LRUCacheSize);
+        cache.swap(nextCache);
+
+        best = Invalid;
+        float bestScore = -FLT_MAX;
+        for (uint32_t v : cache) {
+            for (uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; ++a) {
+                uint32_t t = adjacency[a];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, float threshold)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Hard boundaries: triangles that miss on all three vertices, i.e. where
+    // the cache-optimized order already starts over.
+    std::vector<uint32_t> hard;
+    FifoCache cache(vertices.size(), FifoCacheSize);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        int misses = 0;
+        for (int k = 0; k < 3; ++k)
+            misses += cache.access(indices[t * 3 + k]) ? 0 : 1;
+        if (t == 0 || misses == 3)
+            hard.push_back(static_cast<uint32_t>(t));
+    }
+    hard.push_back(static_cast<uint32_t>(triangleCount));
+
+    // Soft boundaries: inside each hard cluster, split as soon as the part so
+    // far is within `threshold` of the whole cluster's ACMR, so breaking the
+    // order there costs little cache efficiency.
+    std::vector<uint32_t> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); ++h) {
+        uint32_t begin = hard[h], end = hard[h + 1];
+        cache.flush();
+        size_t clusterMisses = 0;
+        for (uint32_t t = begin; t < end; ++t) {
+            for (int k = 0; k < 3; ++k)
+                clusterMisses += cache.access(indices[t * 3 + k]) ? 0 : 1;
+        }
+        float limit = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - begin);
+
+        cache.flush();
+        clusters.push_back(begin);
+        uint32_t start = begin;
+        size_t misses = 0;
+        for (uint32_t t = begin; t < end; ++t) {
+            for (int k = 0; k < 3; ++k)
+                misses += cache.access(indices[t * 3 + k]) ? 0 : 1;
+            if (t + 1 < end && static_cast<float>(misses) / static_cast<float>(t - start + 1) <= limit) {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+    }
+    clusters.push_back(static_cast<uint32_t>(triangleCount));
+
+    // Sort key: how far the cluster faces away from the mesh centre.
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<glm::vec3> clusterCenter(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    std::vector<float> clusterArea(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        for (uint32_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            glm::vec3 a = vertices[indices[t * 3]].Position;
+            glm::vec3 b = vertices[indices[t * 3 + 1]].Position;
+            glm::vec3 d = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(b - a, d - a);
+            float area = glm::length(normal);
+            clusterCenter[c] += (a + b + d) * (area / 3.0f);
+            clusterNormal[c] += normal;
+            clusterArea[c] += area;
+        }
+        meshCenter += clusterCenter[c];
+        meshArea += clusterArea[c];
+        if (clusterArea[c] > 0.0f)
+            clusterCenter[c] /= clusterArea[c];
+    }
+    if (meshArea > 0.0f)
+        meshCenter /= meshArea;
+
+    std::vector<float> key(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        float normalLength = glm::length(clusterNormal[c]);
+        if (normalLength > 0.0f)
+            key[c] = glm::dot(clusterCenter[c] - meshCenter, clusterNormal[c] / normalLength);
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+        order[c] = static_cast<uint32_t>(c);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return key[a] > key[b]; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (uint32_t c : order)
+        output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    indices.swap(output);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    ApplyVertexOrder(VertexFetchOrder(indices, vertices.size()), vertices, indices);
+}
+
+MeshOptimizeStats OptimizeMeshBuffers(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    MeshOptimizeStats stats{};
+    stats.before = AnalyzeVertexCache(indices, vertices.size());
+    if (indices.empty())
+        return stats;
+
+    uint64_t hash = HashMeshGeometry(vertices, indices);
+    std::vector<uint32_t> payload;
+    stats.cached = LoadMeshCache(OptimizeCacheKind, hash, payload) && ReadOptimizePayload(payload, vertices, indices);
+    if (!stats.cached) {
+        OptimizeVertexCache(indices, vertices.size());
+        OptimizeOverdraw(indices, vertices);
+        std::vector<uint32_t> order = VertexFetchOrder(indices, vertices.size());
+        ApplyVertexOrder(order, vertices, indices);
+
+        payload.clear();
+        payload.push_back(static_cast<uint32_t>(order.size()));
+        payload.insert(payload.end(), order.begin(), order.end());
+        payload.push_back(static_cast<uint32_t>(indices.size()));
+        payload.insert(payload.end(), indices.begin(), indices.end());
+        SaveMeshCache(OptimizeCacheKind, hash, payload);
+    }
+
+    stats.after = AnalyzeVertexCache(indices, vertices.size());
+    return stats;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "def.h"
+#include <cstdint>
+
+// Post-transform vertex cache efficiency of an index buffer, measured with a
+// FIFO cache. ACMR is vertices transformed per triangle (0.5 is ideal for
+// large grids, 3 the worst), ATVR the same per unique vertex (1 is ideal).
+struct VertexCacheStats {
+    float acmr;
+    float atvr;
+};
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, size_t cacheSize = 16);
+
+// Forsyth's linear-speed triangle reordering for an LRU cache.
+void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+// Sander et al.: cuts the cache-ordered list into clusters where that costs
+// little cache efficiency (ACMR within `threshold` of the original) and sorts
+// them outward facing first, so the nearest surfaces tend to be drawn first.
+void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+// Renumbers vertices in order of first use and drops unreferenced ones.
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+struct MeshOptimizeStats {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    bool cached;
+};
+
+// Runs the three passes above on freshly loaded buffers, or replays them
+// from the mesh cache.
+MeshOptimizeStats OptimizeMeshBuffers(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
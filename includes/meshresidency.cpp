@@ -0,0 +1,126 @@
+#include "meshresidency.h"
+#include "meshcache.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char* GeometryCacheKind = "geometry";
+const size_t VertexWords = sizeof(Vertex) / sizeof(uint32_t);
+
+bool HasDroppedData(const Mesh& mesh)
+{
+    return mesh.vertices.empty() && mesh.vertexCount > 0;
+}
+
+// Payload: vertex, index and LOD index counts, then the three arrays.
+bool SaveGeometry(const Mesh& mesh, uint64_t hash)
+{
+    std::vector<uint32_t> payload;
+    payload.reserve(3 + mesh.vertices.size() * VertexWords + mesh.indices.size() + mesh.lodIndices.size());
+    payload.push_back(static_cast<uint32_t>(mesh.vertices.size()));
+    payload.push_back(static_cast<uint32_t>(mesh.indices.size()));
+    payload.push_back(static_cast<uint32_t>(mesh.lodIndices.size()));
+    payload.resize(3 + mesh.vertices.size() * VertexWords);
+    std::memcpy(payload.data() + 3, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+    payload.insert(payload.end(), mesh.indices.begin(), mesh.indices.end());
+    payload.insert(payload.end(), mesh.lodIndices.begin(), mesh.lodIndices.end());
+    return SaveMeshCache(GeometryCacheKind, hash, payload);
+}
+
+void DropCPUData(Mesh& mesh)
+{
+    if (mesh.residency == MeshResidency::CollisionOnly) {
+        mesh.collisionPositions.resize(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); ++i)
+            mesh.collisionPositions[i] = mesh.vertices[i].Position;
+    } else {
+        std::vector<unsigned int>().swap(mesh.indices);
+    }
+    std::vector<Vertex>().swap(mesh.vertices);
+    std::vector<unsigned int>().swap(mesh.lodIndices);
+}
+
+}
+
+size_t MeshCPUBytes(const Mesh& mesh)
+{
+    return mesh.vertices.size() * sizeof(Vertex) + mesh.collisionPositions.size() * sizeof(glm::vec3) +
+           (mesh.indices.size() + mesh.lodIndices.size()) * sizeof(unsigned int);
+}
+
+void ApplyMeshResidency(Mesh& mesh, MeshResidency policy)
+{
+    if (!RestoreMeshCPUData(mesh))
+        return;
+    std::vector<glm::vec3>().swap(mesh.collisionPositions);
+    mesh.residency = policy;
+    if (policy == MeshResidency::KeepCPU || mesh.vertices.empty())
+        return;
+
+    // The cache is written once; the arrays never change after loading.
+    if (mesh.geometryHash == 0) {
+        uint64_t hash = HashMeshGeometry(mesh);
+        if (!SaveGeometry(mesh, hash)) {
+            std::cerr << "Keeping CPU geometry: could not write it to the mesh cache\n";
+            mesh.residency = MeshResidency::KeepCPU;
+            return;
+        }
+        mesh.geometryHash = hash;
+    }
+    DropCPUData(mesh);
+}
+
+bool RestoreMeshCPUData(Mesh& mesh)
+{
+    if (!HasDroppedData(mesh))
+        return true;
+
+    std::vector<uint32_t> payload;
+    if (!LoadMeshCache(GeometryCacheKind, mesh.geometryHash, payload) || payload.size() < 3) {
+        std::cerr << "Mesh geometry " << std::hex << mesh.geometryHash << std::dec << " is missing from the cache\n";
+        return false;
+    }
+    size_t vertexCount = payload[0], indexCount = payload[1], lodIndexCount = payload[2];
+    if (payload.size() != 3 + vertexCount * VertexWords + indexCount + lodIndexCount || vertexCount != mesh.vertexCount) {
+        std::cerr << "Mesh geometry " << std::hex << mesh.geometryHash << std::dec << " in the cache is corrupt\n";
+        return false;
+    }
+
+    const uint32_t* cursor = payload.data() + 3;
+    mesh.vertices.resize(vertexCount);
+    std::memcpy(static_cast<void*>(mesh.vertices.data()), cursor, vertexCount * sizeof(Vertex));
+    cursor += vertexCount * VertexWords;
+    mesh.indices.assign(cursor, cursor + indexCount);
+    cursor += indexCount;
+    mesh.lodIndices.assign(cursor, cursor + lodIndexCount);
+    std::vector<glm::vec3>().swap(mesh.collisionPositions);
+    return true;
+}
+
+void ReleaseMeshCPUData(Mesh& mesh)
+{
+    if (mesh.residency != MeshResidency::KeepCPU && mesh.geometryHash != 0 && !mesh.vertices.empty())
+        DropCPUData(mesh);
+}
+
+bool VisitMeshPositions(Mesh& mesh,
+                        const std::function<void(const std::vector<glm::vec3>&, const std::vector<unsigned int>&)>& visit)
+{
+    if (!mesh.collisionPositions.empty()) {
+        visit(mesh.collisionPositions, mesh.indices);
+        return true;
+    }
+
+    bool restored = HasDroppedData(mesh);
+    if (!RestoreMeshCPUData(mesh))
+        return false;
+    std::vector<glm::vec3> positions(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); ++i)
+        positions[i] = mesh.vertices[i].Position;
+    visit(positions, mesh.indices);
+    if (restored)
+        ReleaseMeshCPUData(mesh);
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "def.h"
+#include <functional>
+
+// Bytes held by the mesh's CPU-side geometry arrays.
+size_t MeshCPUBytes(const Mesh& mesh);
+
+// Switches the mesh to `policy`. Call it after everything that needs the full
+// arrays at load time (LODs, meshlets, the geometry pool) has run. Dropped
+// arrays are written to the mesh cache first so they can come back.
+void ApplyMeshResidency(Mesh& mesh, MeshResidency policy);
+
+// Reloads dropped vertices and indices from the mesh cache. Returns whether
+// the full arrays are present afterwards.
+bool RestoreMeshCPUData(Mesh& mesh);
+// Drops them again after a RestoreMeshCPUData(), as the policy says.
+void ReleaseMeshCPUData(Mesh& mesh);
+
+// Calls `visit` with the mesh's positions and level-0 indices under any
+// policy, restoring them from the cache for the duration if needed.
+bool VisitMeshPositions(Mesh& mesh,
+                        const std::function<void(const std::vector<glm::vec3>&, const std::vector<unsigned int>&)>& visit);
@@ -0,0 +1,141 @@
+#include "meshresources.h"
+#include "meshcache.h"
+#include "meshlet.h"
+#include "meshresidency.h"
+
+#include <iostream>
+
+namespace {
+
+const char* TextureCacheKind = "texture";
+
+size_t GeometryBytes(const Mesh& mesh)
+{
+    // From the counts, which stay valid when the CPU arrays are dropped.
+    size_t indices = mesh.indexCount;
+    for (size_t level = 1; level < mesh.lods.size(); ++level)
+        indices += mesh.lods[level].indexCount;
+    size_t bytes = mesh.vertexCount * sizeof(Vertex) + indices * sizeof(unsigned int);
+    if (mesh.positionStream)
+        bytes += mesh.vertexCount * sizeof(glm::vec3);
+    if (mesh.meshlets)
+        bytes += mesh.meshlets->indices.size() * sizeof(unsigned int);
+    return bytes;
+}
+
+bool EvictGeometry(Mesh& mesh)
+{
+    mesh.VAO.reset();
+    mesh.VBO.reset();
+    mesh.EBO.reset();
+    mesh.depthVAO.reset();
+    mesh.positionVBO.reset();
+    if (mesh.meshlets) {
+        mesh.meshlets->VAO.reset();
+        mesh.meshlets->depthVAO.reset();
+        mesh.meshlets->EBO.reset();
+    }
+    return true;
+}
+
+bool RestoreGeometry(Mesh& mesh)
+{
+    if (mesh.vertexCount == 0 || !RestoreMeshCPUData(mesh))
+        return false;
+    mesh.upload();
+    UploadMeshletBuffers(mesh);
+    ReleaseMeshCPUData(mesh);
+    return true;
+}
+
+// Payload: width, height, then RGBA8 texels one per word.
+bool EvictTexture(Texture& texture, uint64_t key)
+{
+    GLint width = 0, height = 0;
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    std::vector<uint32_t> payload(2 + static_cast<size_t>(width) * height);
+    payload[0] = static_cast<uint32_t>(width);
+    payload[1] = static_cast<uint32_t>(height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, payload.data() + 2);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (!SaveMeshCache(TextureCacheKind, key, payload))
+        return false;
+    texture.id.reset();
+    return true;
+}
+
+bool RestoreTexture(Texture& texture, uint64_t key)
+{
+    std::vector<uint32_t> payload;
+    if (!LoadMeshCache(TextureCacheKind, key, payload) || payload.size() < 2 ||
+        payload.size() != 2 + static_cast<size_t>(payload[0]) * payload[1])
+        return false;
+
+    texture.id = GLTexture::create();
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, payload[0], payload[1], 0, GL_RGBA, GL_UNSIGNED_BYTE, payload.data() + 2);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+}
+
+size_t TextureBytes(GLuint texture)
+{
+    if (texture == 0)
+        return 0;
+    GLint width = 0, height = 0, format = 0;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Drivers pad three-channel formats to four.
+    size_t texelBytes = 4;
+    if (format == GL_RED || format == GL_R8)
+        texelBytes = 1;
+    // A full mip chain adds a third.
+    return static_cast<size_t>(width) * height * texelBytes * 4 / 3;
+}
+
+void TrackMeshResources(Mesh& mesh, const std::string& owner)
+{
+    GPUResourceManager& manager = GetResourceManager();
+    mesh.gpuResources.clear();
+    mesh.gpuResources.push_back(manager.add(owner, ResourceCategory::Geometry, GeometryBytes(mesh),
+                                            [&mesh]() { return EvictGeometry(mesh); },
+                                            [&mesh]() { return RestoreGeometry(mesh); }));
+
+    for (size_t i = 0; i < mesh.textures.size(); ++i) {
+        Texture& texture = mesh.textures[i];
+        uint64_t key = HashCacheKey(owner + "#" + std::to_string(i) + "#" + texture.path);
+        mesh.gpuResources.push_back(manager.add(owner + " / " + texture.path, ResourceCategory::Texture,
+                                                TextureBytes(texture.id),
+                                                [&texture, key]() { return EvictTexture(texture, key); },
+                                                [&texture, key]() { return RestoreTexture(texture, key); }));
+    }
+}
+
+void TouchMeshResources(const Mesh& mesh)
+{
+    GPUResourceManager& manager = GetResourceManager();
+    for (const ResourceTicket& ticket : mesh.gpuResources)
+        manager.touch(ticket.get());
+}
+
+void PinMeshResources(const Mesh& mesh, bool pinned)
+{
+    GPUResourceManager& manager = GetResourceManager();
+    for (const ResourceTicket& ticket : mesh.gpuResources)
+        manager.setPinned(ticket.get(), pinned);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "def.h"
+#include <string>
+
+// Estimated video memory of a 2D texture, mip chain included.
+size_t TextureBytes(GLuint texture);
+
+// Registers the mesh's buffers and each of its textures with the resource
+// manager. Evicted geometry is re-uploaded from the CPU-side arrays, or from
+// the mesh cache if they were dropped, and evicted textures are read back
+// into the cache directory first. The
+// callbacks keep a pointer to the mesh, so call this once it has reached its
+// final address.
+void TrackMeshResources(Mesh& mesh, const std::string& owner);
+// Call before drawing; brings back anything that was evicted.
+void TouchMeshResources(const Mesh& mesh);
+// For meshes whose GL names are captured elsewhere and must not change.
+void PinMeshResources(const Mesh& mesh, bool pinned);
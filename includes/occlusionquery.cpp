@@ -0,0 +1,160 @@
+#include "occlusionquery.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+void OcclusionQueries::init(const ShaderVariants& boundingBoxShader)
+{
+    boxShader = boundingBoxShader;
+
+    const float corners[] = {
+        0.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 1.0f,   1.0f, 0.0f, 1.0f,   1.0f, 1.0f, 1.0f,   0.0f, 1.0f, 1.0f,
+    };
+    const unsigned char faces[] = {
+        0, 2, 1,  0, 3, 2,   4, 5, 6,  4, 6, 7,
+        0, 1, 5,  0, 5, 4,   3, 6, 2,  3, 7, 6,
+        0, 4, 7,  0, 7, 3,   1, 2, 6,  1, 6, 5,
+    };
+
+    glGenVertexArrays(1, &boxVAO);
+    glGenBuffers(1, &boxVBO);
+    glGenBuffers(1, &boxEBO);
+
+    glBindVertexArray(boxVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glBindVertexArray(0);
+}
+
+void OcclusionQueries::destroy()
+{
+    for (ObjectState& state : states) {
+        if (state.query != 0)
+            glDeleteQueries(1, &state.query);
+    }
+    states.clear();
+    glDeleteBuffers(1, &boxVBO);
+    glDeleteBuffers(1, &boxEBO);
+    glDeleteVertexArrays(1, &boxVAO);
+    boxVAO = boxVBO = boxEBO = 0;
+}
+
+void OcclusionQueries::drawBox(const AABB& box, const glm::mat4& viewProjection)
+{
+    // Grow the box a little so it never z-fights with the surface it encloses.
+    glm::vec3 pad = (box.max - box.min) * 0.01f + glm::vec3(1e-3f);
+    glm::vec3 origin = box.min - pad;
+    glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), origin), box.max + pad - origin);
+    glm::mat4 mvp = viewProjection * model;
+    glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(mvp));
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+}
+
+void OcclusionQueries::render(const std::vector<SceneObject>& scene, const std::vector<uint32_t>& visible,
+                              const glm::mat4& viewProjection, const glm::vec3& cameraPosition,
+                              const std::function<void(uint32_t)>& drawObject)
+{
+    ++frame;
+    stats = {};
+
+    if (states.size() < scene.size())
+        states.resize(scene.size());
+
+    // Pick up whatever results have arrived; never block on the rest.
+    for (uint32_t index : visible) {
+        ObjectState& state = states[index];
+        if (!state.pending)
+            continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint anySamples = 0;
+        glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &anySamples);
+        state.pending = false;
+        state.visible = anySamples != 0;
+        if (state.visible) {
+            // Spread re-queries of visible objects over the interval.
+            state.nextQueryFrame = frame + visibleQueryInterval + (index % visibleQueryInterval);
+        }
+    }
+
+    // Pass 1: objects visible last time are drawn as usual. Their own draw
+    // doubles as the re-query when one is due.
+    std::vector<uint32_t> hidden;
+    for (uint32_t index : visible) {
+        ObjectState& state = states[index];
+        const AABB& box = scene[index].worldBounds;
+        bool cameraInside = box.min.x <= cameraPosition.x && cameraPosition.x <= box.max.x &&
+                            box.min.y <= cameraPosition.y && cameraPosition.y <= box.max.y &&
+                            box.min.z <= cameraPosition.z && cameraPosition.z <= box.max.z;
+        if (cameraInside)
+            state.visible = true;
+
+        if (!state.visible) {
+            hidden.push_back(index);
+            continue;
+        }
+
+        bool requery = !cameraInside && !state.pending && frame >= state.nextQueryFrame;
+        if (requery) {
+            if (state.query == 0)
+                glGenQueries(1, &state.query);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+        }
+        drawObject(index);
+        if (requery) {
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            state.pending = true;
+            stats.geometryQueries++;
+        }
+        stats.drawn++;
+    }
+
+    // Pass 2: objects occluded last time test their bounding box against the
+    // depth laid down above, without touching color or depth.
+    for (uint32_t index : hidden) {
+        ObjectState& state = states[index];
+        bool heavy = scene[index].mesh->indexCount >= heavyIndexCount;
+
+        if (!state.pending) {
+            if (state.query == 0)
+                glGenQueries(1, &state.query);
+
+            // A reload may have replaced the program since the last box.
+            GLuint program = boxShader.get(0);
+            if (program != locationProgram) {
+                locationProgram = program;
+                mvpLocation = glGetUniformLocation(program, "uMVP");
+            }
+            glUseProgram(program);
+            glBindVertexArray(boxVAO);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDepthMask(GL_FALSE);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+            drawBox(scene[index].worldBounds, viewProjection);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            glDepthMask(GL_TRUE);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glBindVertexArray(0);
+
+            state.pending = true;
+            stats.boxQueries++;
+        }
+
+        if (heavy) {
+            // The GPU drops the draw itself if the latest box query found nothing.
+            glBeginConditionalRender(state.query, GL_QUERY_NO_WAIT);
+            drawObject(index);
+            glEndConditionalRender();
+            stats.conditionalDraws++;
+            continue;
+        }
+        stats.skipped++;
+    }
+}
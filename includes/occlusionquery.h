@@ -0,0 +1,55 @@
+#pragma once
+
+#include "def.h"
+#include "shadervariants.h"
+#include <cstdint>
+#include <functional>
+
+struct OcclusionQueryStats {
+    uint32_t drawn;
+    uint32_t skipped;            // previously occluded, not drawn this frame
+    uint32_t conditionalDraws;   // heavy meshes submitted under glBeginConditionalRender
+    uint32_t boxQueries;
+    uint32_t geometryQueries;
+};
+
+// GL_ANY_SAMPLES_PASSED based culling with temporal coherence, after CHC++:
+// results are read one or more frames late so the CPU never waits on the
+// GPU. Visible objects are drawn directly and re-queried with their real
+// geometry every few frames; occluded objects only get their bounding box
+// drawn under a query, and heavy meshes are submitted right behind it with
+// conditional rendering so they appear without a frame of latency.
+class OcclusionQueries {
+public:
+    void init(const ShaderVariants& boundingBoxShader);
+    void destroy();
+
+    void render(const std::vector<SceneObject>& scene, const std::vector<uint32_t>& visible,
+                const glm::mat4& viewProjection, const glm::vec3& cameraPosition,
+                const std::function<void(uint32_t index)>& drawObject);
+
+    const OcclusionQueryStats& getStats() const { return stats; }
+
+    // Frames between re-queries of objects known to be visible.
+    uint32_t visibleQueryInterval = 8;
+    // Meshes with at least this many indices are drawn conditionally while occluded.
+    size_t heavyIndexCount = 20000;
+
+private:
+    struct ObjectState {
+        GLuint query = 0;
+        bool visible = true;
+        bool pending = false;
+        uint32_t nextQueryFrame = 0;
+    };
+
+    void drawBox(const AABB& box, const glm::mat4& viewProjection);
+
+    std::vector<ObjectState> states;
+    ShaderVariants boxShader;
+    GLuint locationProgram = 0;   // the program mvpLocation belongs to
+    GLint mvpLocation = -1;
+    GLuint boxVAO = 0, boxVBO = 0, boxEBO = 0;
+    uint32_t frame = 0;
+    OcclusionQueryStats stats{};
+};
@@ -0,0 +1,141 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+thread_local bool insideParallelFor = false;
+
+class ThreadPool {
+public:
+    ThreadPool()
+    {
+        size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 1; i < hardware; ++i)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    size_t threadCount() const { return workers.size() + 1; }
+
+    void run(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+    {
+        std::lock_guard<std::mutex> submitLock(submitMutex);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobCount = count;
+            jobGrain = grain;
+            nextChunk = 0;
+            chunksLeft = (count + grain - 1) / grain;
+            ++generation;
+        }
+        wake.notify_all();
+
+        insideParallelFor = true;
+        runChunks();
+        insideParallelFor = false;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return chunksLeft == 0 && busyWorkers == 0; });
+        job = nullptr;
+    }
+
+private:
+    void runChunks()
+    {
+        size_t chunkCount = (jobCount + jobGrain - 1) / jobGrain;
+        for (;;) {
+            size_t chunk = nextChunk.fetch_add(1);
+            if (chunk >= chunkCount)
+                break;
+            size_t begin = chunk * jobGrain;
+            size_t end = std::min(begin + jobGrain, jobCount);
+            (*job)(begin, end);
+            if (chunksLeft.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+
+    void workerLoop()
+    {
+        insideParallelFor = true;
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return quit || (job && generation != seen); });
+                if (quit)
+                    return;
+                seen = generation;
+                ++busyWorkers;
+            }
+            runChunks();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --busyWorkers;
+            }
+            done.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex submitMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t, size_t)>* job = nullptr;
+    size_t jobCount = 0;
+    size_t jobGrain = 1;
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<size_t> chunksLeft{0};
+    uint64_t generation = 0;
+    int busyWorkers = 0;
+    bool quit = false;
+};
+
+ThreadPool& Pool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+}
+
+size_t ParallelThreadCount()
+{
+    return Pool().threadCount();
+}
+
+void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+    if (count == 0)
+        return;
+    grain = std::max<size_t>(grain, 1);
+
+    if (insideParallelFor || count <= grain || Pool().threadCount() == 1) {
+        for (size_t begin = 0; begin < count; begin += grain)
+            fn(begin, std::min(begin + grain, count));
+        return;
+    }
+    Pool().run(count, grain, fn);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads ParallelFor spreads work over, including the caller.
+size_t ParallelThreadCount();
+
+// Splits [0, count) into chunks of at most `grain` items and runs them on a
+// persistent worker pool; the calling thread works too and returns once all
+// chunks are done. Calls made from inside a worker run serially.
+void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& fn);
@@ -0,0 +1,146 @@
+#include "resourcemanager.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+const char* ResourceCategoryName(ResourceCategory category)
+{
+    switch (category) {
+    case ResourceCategory::Geometry:
+        return "Geometry";
+    case ResourceCategory::Texture:
+        return "Texture";
+    case ResourceCategory::Pool:
+        return "Pool";
+    case ResourceCategory::RenderTarget:
+        return "Render target";
+    default:
+        return "Unknown";
+    }
+}
+
+ResourceTicket& ResourceTicket::operator=(ResourceTicket&& other) noexcept
+{
+    if (this != &other) {
+        reset();
+        id = other.id;
+        other.id = 0;
+    }
+    return *this;
+}
+
+void ResourceTicket::reset()
+{
+    if (id != 0)
+        GetResourceManager().remove(id);
+    id = 0;
+}
+
+ResourceTicket GPUResourceManager::add(std::string owner, ResourceCategory category, size_t bytes, EvictFn evict,
+                                       RestoreFn restore)
+{
+    uint32_t id = nextId++;
+    Entry entry;
+    entry.info = { std::move(owner), category, bytes, frame, true, false, evict && restore };
+    entry.evict = std::move(evict);
+    entry.restore = std::move(restore);
+    entries.emplace(id, std::move(entry));
+    return ResourceTicket(id);
+}
+
+void GPUResourceManager::remove(uint32_t id)
+{
+    entries.erase(id);
+}
+
+void GPUResourceManager::setBytes(uint32_t id, size_t bytes)
+{
+    auto it = entries.find(id);
+    if (it != entries.end())
+        it->second.info.bytes = bytes;
+}
+
+void GPUResourceManager::setPinned(uint32_t id, bool pinned)
+{
+    auto it = entries.find(id);
+    if (it == entries.end())
+        return;
+    it->second.info.pinned = pinned;
+    if (pinned)
+        touch(id);
+}
+
+bool GPUResourceManager::touch(uint32_t id)
+{
+    auto it = entries.find(id);
+    if (it == entries.end())
+        return false;
+    ResourceInfo& info = it->second.info;
+    info.lastUsedFrame = frame;
+    if (!info.resident) {
+        if (!it->second.restore()) {
+            std::cerr << "Failed to restore " << ResourceCategoryName(info.category) << " of " << info.owner << "\n";
+            return false;
+        }
+        info.resident = true;
+        restores++;
+    }
+    return true;
+}
+
+void GPUResourceManager::endFrame()
+{
+    size_t resident = 0;
+    for (const auto& entry : entries) {
+        if (entry.second.info.resident)
+            resident += entry.second.info.bytes;
+    }
+
+    if (budgetBytes > 0 && resident > budgetBytes) {
+        std::vector<Entry*> candidates;
+        for (auto& entry : entries) {
+            const ResourceInfo& info = entry.second.info;
+            if (info.resident && info.evictable && !info.pinned && info.lastUsedFrame < frame)
+                candidates.push_back(&entry.second);
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Entry* a, const Entry* b) { return a->info.lastUsedFrame < b->info.lastUsedFrame; });
+        for (Entry* entry : candidates) {
+            if (resident <= budgetBytes)
+                break;
+            if (!entry->evict())
+                continue;
+            entry->info.resident = false;
+            resident -= entry->info.bytes;
+            evictions++;
+        }
+    }
+
+    stats = {};
+    for (const auto& entry : entries) {
+        const ResourceInfo& info = entry.second.info;
+        if (info.resident) {
+            stats.residentBytes[static_cast<int>(info.category)] += info.bytes;
+            stats.residentTotal += info.bytes;
+        } else {
+            stats.evictedBytes += info.bytes;
+        }
+    }
+    stats.resources = static_cast<uint32_t>(entries.size());
+    stats.evictions = evictions;
+    stats.restores = restores;
+    frame++;
+}
+
+void GPUResourceManager::forEach(const std::function<void(const ResourceInfo&)>& visit) const
+{
+    for (const auto& entry : entries)
+        visit(entry.second.info);
+}
+
+GPUResourceManager& GetResourceManager()
+{
+    static GPUResourceManager manager;
+    return manager;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+enum class ResourceCategory {
+    Geometry,
+    Texture,
+    Pool,
+    RenderTarget,
+    Count
+};
+
+const char* ResourceCategoryName(ResourceCategory category);
+
+struct ResourceInfo {
+    std::string owner;
+    ResourceCategory category;
+    size_t bytes;
+    uint64_t lastUsedFrame;
+    bool resident;
+    bool pinned;
+    bool evictable;
+};
+
+struct ResourceStats {
+    size_t residentBytes[static_cast<int>(ResourceCategory::Count)];
+    size_t residentTotal;
+    size_t evictedBytes;
+    uint32_t resources;
+    uint32_t evictions;
+    uint32_t restores;
+};
+
+// Unregisters its resource when destroyed. Move-only, like the GL handles
+// it usually sits next to.
+class ResourceTicket {
+public:
+    ResourceTicket() = default;
+    explicit ResourceTicket(uint32_t id) : id(id) {}
+    ResourceTicket(ResourceTicket&& other) noexcept : id(other.id) { other.id = 0; }
+    ResourceTicket& operator=(ResourceTicket&& other) noexcept;
+    ResourceTicket(const ResourceTicket&) = delete;
+    ResourceTicket& operator=(const ResourceTicket&) = delete;
+    ~ResourceTicket() { reset(); }
+
+    void reset();
+    uint32_t get() const { return id; }
+
+private:
+    uint32_t id = 0;
+};
+
+// Accounts for every tracked GPU allocation by owner and category and keeps
+// the resident total under `budgetBytes`. Going over evicts the resources
+// drawn least recently through their evict callback; touching an evicted
+// resource brings it back through its restore callback. Resources without
+// callbacks are counted but never evicted.
+class GPUResourceManager {
+public:
+    // Both return false when they could not do their job, which leaves the
+    // resource as it was.
+    using EvictFn = std::function<bool()>;
+    using RestoreFn = std::function<bool()>;
+
+    ResourceTicket add(std::string owner, ResourceCategory category, size_t bytes, EvictFn evict = nullptr,
+                       RestoreFn restore = nullptr);
+    void setBytes(uint32_t id, size_t bytes);
+    void setPinned(uint32_t id, bool pinned);
+    // Marks the resource as used this frame, restoring it first if needed.
+    // Returns whether it is resident.
+    bool touch(uint32_t id);
+    // Evicts down to the budget, skipping anything used this frame, and
+    // refreshes the statistics.
+    void endFrame();
+
+    const ResourceStats& getStats() const { return stats; }
+    void forEach(const std::function<void(const ResourceInfo&)>& visit) const;
+
+    // Zero means unlimited.
+    size_t budgetBytes = 0;
+
+private:
+    struct Entry {
+        ResourceInfo info;
+        EvictFn evict;
+        RestoreFn restore;
+    };
+
+    void remove(uint32_t id);
+    friend class ResourceTicket;
+
+    std::unordered_map<uint32_t, Entry> entries;
+    uint32_t nextId = 1;
+    uint64_t frame = 0;
+    uint32_t evictions = 0, restores = 0;
+    ResourceStats stats{};
+};
+
+GPUResourceManager& GetResourceManager();
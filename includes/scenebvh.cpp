@@ -0,0 +1,589 @@
+#include "scenebvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+
+AABB Union(const AABB& a, const AABB& b)
+{
+    return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
+
+float SurfaceArea(const AABB& box)
+{
+    glm::vec3 d = box.max - box.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+bool Contains(const AABB& outer, const AABB& inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+           outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+bool Overlaps(const AABB& a, const AABB& b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y &&
+           a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+float DistanceSquared(const glm::vec3& point, const AABB& box)
+{
+    glm::vec3 d = glm::max(glm::max(box.min - point, point - box.max), glm::vec3(0.0f));
+    return glm::dot(d, d);
+}
+
+// Slab test; returns the entry distance or a negative value on a miss.
+float RayAABB(const glm::vec3& origin, const glm::vec3& invDir, float maxT, const AABB& box)
+{
+    glm::vec3 t0 = (box.min - origin) * invDir;
+    glm::vec3 t1 = (box.max - origin) * invDir;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+    float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxT));
+    return enter <= exit ? enter : -1.0f;
+}
+
+}
+
+SceneBVH::SceneBVH(float margin) : margin(margin) {}
+
+int32_t SceneBVH::allocateNode()
+{
+    if (freeList == NullNode) {
+        nodes.push_back({});
+        nodes.back().height = -1;
+        nodes.back().parent = NullNode;
+        freeList = static_cast<int32_t>(nodes.size() - 1);
+    }
+
+    int32_t node = freeList;
+    freeList = nodes[node].parent;
+    nodes[node].parent = NullNode;
+    nodes[node].child1 = NullNode;
+    nodes[node].child2 = NullNode;
+    nodes[node].height = 0;
+    nodes[node].userData = 0;
+    return node;
+}
+
+void SceneBVH::freeNode(int32_t node)
+{
+    nodes[node].parent = freeList;
+    nodes[node].height = -1;
+    freeList = node;
+}
+
+int32_t SceneBVH::insert(const AABB& box, uint32_t userData)
+{
+    int32_t proxy = allocateNode();
+    glm::vec3 fat(margin);
+    nodes[proxy].box = { box.min - fat, box.max + fat };
+    nodes[proxy].userData = userData;
+    insertLeaf(proxy);
+    ++leafCount;
+    return proxy;
+}
+
+void SceneBVH::remove(int32_t proxy)
+{
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --leafCount;
+}
+
+bool SceneBVH::update(int32_t proxy, const AABB& box, const glm::vec3& displacement)
+{
+    if (Contains(nodes[proxy].box, box))
+        return false;
+
+    removeLeaf(proxy);
+
+    // Extend the fat box in the direction of travel so steady motion re-inserts less often.
+    glm::vec3 fat(margin);
+    AABB fatBox = { box.min - fat, box.max + fat };
+    glm::vec3 predicted = displacement * 2.0f;
+    fatBox.min += glm::min(predicted, glm::vec3(0.0f));
+    fatBox.max += glm::max(predicted, glm::vec3(0.0f));
+
+    nodes[proxy].box = fatBox;
+    insertLeaf(proxy);
+    return true;
+}
+
+void SceneBVH::clear()
+{
+    nodes.clear();
+    root = NullNode;
+    freeList = NullNode;
+    leafCount = 0;
+}
+
+void SceneBVH::insertLeaf(int32_t leaf)
+{
+    if (root == NullNode) {
+        root = leaf;
+        nodes[root].parent = NullNode;
+        return;
+    }
+
+    // Descend towards the sibling with the lowest surface area heuristic cost.
+    AABB leafBox = nodes[leaf].box;
+    int32_t index = root;
+    while (!nodes[index].isLeaf()) {
+        int32_t child1 = nodes[index].child1;
+        int32_t child2 = nodes[index].child2;
+
+        float area = SurfaceArea(nodes[index].box);
+        float combinedArea = SurfaceArea(Union(nodes[index].box, leafBox));
+
+        float cost = 2.0f * combinedArea;
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        auto descendCost = [&](int32_t child) {
+            float unionArea = SurfaceArea(Union(leafBox, nodes[child].box));
+            if (nodes[child].isLeaf())
+                return unionArea + inheritanceCost;
+            return (unionArea - SurfaceArea(nodes[child].box)) + inheritanceCost;
+        };
+        float cost1 = descendCost(child1);
+        float cost2 = descendCost(child2);
+
+        if (cost < cost1 && cost < cost2)
+            break;
+        index = cost1 < cost2 ? child1 : child2;
+    }
+
+    int32_t sibling = index;
+    int32_t oldParent = nodes[sibling].parent;
+    int32_t newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = Union(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+
+    if (oldParent != NullNode) {
+        if (nodes[oldParent].child1 == sibling)
+            nodes[oldParent].child1 = newParent;
+        else
+            nodes[oldParent].child2 = newParent;
+    } else {
+        root = newParent;
+    }
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    refitUpwards(nodes[leaf].parent);
+}
+
+void SceneBVH::removeLeaf(int32_t leaf)
+{
+    if (leaf == root) {
+        root = NullNode;
+        return;
+    }
+
+    int32_t parent = nodes[leaf].parent;
+    int32_t grandParent = nodes[parent].parent;
+    int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent != NullNode) {
+        if (nodes[grandParent].child1 == parent)
+            nodes[grandParent].child1 = sibling;
+        else
+            nodes[grandParent].child2 = sibling;
+        nodes[sibling].parent = grandParent;
+        freeNode(parent);
+        refitUpwards(grandParent);
+    } else {
+        root = sibling;
+        nodes[sibling].parent = NullNode;
+        freeNode(parent);
+    }
+}
+
+void SceneBVH::refitUpwards(int32_t index)
+{
+    while (index != NullNode) {
+        index = balance(index);
+
+        int32_t child1 = nodes[index].child1;
+        int32_t child2 = nodes[index].child2;
+        nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+        nodes[index].box = Union(nodes[child1].box, nodes[child2].box);
+
+        index = nodes[index].parent;
+    }
+}
+
+int32_t SceneBVH::balance(int32_t iA)
+{
+    if (nodes[iA].isLeaf() || nodes[iA].height < 2)
+        return iA;
+
+    int32_t iB = nodes[iA].child1;
+    int32_t iC = nodes[iA].child2;
+    int32_t diff = nodes[iC].height - nodes[iB].height;
+
+    // Rotate C up.
+    if (diff > 1) {
+        int32_t iF = nodes[iC].child1;
+        int32_t iG = nodes[iC].child2;
+
+        nodes[iC].child1 = iA;
+        nodes[iC].parent = nodes[iA].parent;
+        nodes[iA].parent = iC;
+
+        int32_t up = nodes[iC].parent;
+        if (up != NullNode) {
+            if (nodes[up].child1 == iA)
+                nodes[up].child1 = iC;
+            else
+                nodes[up].child2 = iC;
+        } else {
+            root = iC;
+        }
+
+        int32_t keep = nodes[iF].height > nodes[iG].height ? iF : iG;
+        int32_t move = keep == iF ? iG : iF;
+        nodes[iC].child2 = keep;
+        nodes[iA].child2 = move;
+        nodes[move].parent = iA;
+        nodes[iA].box = Union(nodes[iB].box, nodes[move].box);
+        nodes[iC].box = Union(nodes[iA].box, nodes[keep].box);
+        nodes[iA].height = 1 + std::max(nodes[iB].height, nodes[move].height);
+        nodes[iC].height = 1 + std::max(nodes[iA].height, nodes[keep].height);
+        return iC;
+    }
+
+    // Rotate B up.
+    if (diff < -1) {
+        int32_t iD = nodes[iB].child1;
+        int32_t iE = nodes[iB].child2;
+
+        nodes[iB].child1 = iA;
+        nodes[iB].parent = nodes[iA].parent;
+        nodes[iA].parent = iB;
+
+        int32_t up = nodes[iB].parent;
+        if (up != NullNode) {
+            if (nodes[up].child1 == iA)
+                nodes[up].child1 = iB;
+            else
+                nodes[up].child2 = iB;
+        } else {
+            root = iB;
+        }
+
+        int32_t keep = nodes[iD].height > nodes[iE].height ? iD : iE;
+        int32_t move = keep == iD ? iE : iD;
+        nodes[iB].child2 = keep;
+        nodes[iA].child1 = move;
+        nodes[move].parent = iA;
+        nodes[iA].box = Union(nodes[iC].box, nodes[move].box);
+        nodes[iB].box = Union(nodes[iA].box, nodes[keep].box);
+        nodes[iA].height = 1 + std::max(nodes[iC].height, nodes[move].height);
+        nodes[iB].height = 1 + std::max(nodes[iA].height, nodes[keep].height);
+        return iB;
+    }
+
+    return iA;
+}
+
+void SceneBVH::collectLeaves(int32_t index, std::vector<uint32_t>& out, std::vector<int32_t>& stack) const
+{
+    size_t base = stack.size();
+    stack.push_back(index);
+    while (stack.size() > base) {
+        int32_t node = stack.back();
+        stack.pop_back();
+        if (nodes[node].isLeaf()) {
+            out.push_back(nodes[node].userData);
+        } else {
+            stack.push_back(nodes[node].child1);
+            stack.push_back(nodes[node].child2);
+        }
+    }
+}
+
+void SceneBVH::cullFrustum(const Frustum& frustum, std::vector<uint32_t>& visible)
+{
+    stats = {};
+    if (root == NullNode)
+        return;
+
+    size_t firstVisible = visible.size();
+    std::vector<std::pair<int32_t, uint32_t>> stack;
+    stack.push_back({ root, 0x3Fu });
+    std::vector<int32_t>& leafStack = traversalStack;
+    leafStack.clear();
+
+    while (!stack.empty()) {
+        auto [node, planeMask] = stack.back();
+        stack.pop_back();
+        ++stats.nodesVisited;
+
+        const AABB& box = nodes[node].box;
+        glm::vec3 center = (box.min + box.max) * 0.5f;
+        glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+        bool outside = false;
+        for (int p = 0; p < 6; ++p) {
+            if (!(planeMask & (1u << p)))
+                continue;
+            glm::vec3 normal = glm::vec3(frustum.planes[p]);
+            float d = glm::dot(normal, center) + frustum.planes[p].w;
+            float r = glm::dot(glm::abs(normal), extent);
+            if (d + r < 0.0f) {
+                outside = true;
+                break;
+            }
+            if (d - r >= 0.0f)
+                planeMask &= ~(1u << p);
+        }
+        if (outside)
+            continue;
+
+        if (planeMask == 0) {
+            collectLeaves(node, visible, leafStack);
+        } else if (nodes[node].isLeaf()) {
+            visible.push_back(nodes[node].userData);
+        } else {
+            stack.push_back({ nodes[node].child1, planeMask });
+            stack.push_back({ nodes[node].child2, planeMask });
+        }
+    }
+
+    stats.visible = static_cast<uint32_t>(visible.size() - firstVisible);
+}
+
+void SceneBVH::queryAABB(const AABB& box, std::vector<uint32_t>& results) const
+{
+    if (root == NullNode)
+        return;
+
+    std::vector<int32_t> stack;
+    stack.push_back(root);
+    while (!stack.empty()) {
+        int32_t node = stack.back();
+        stack.pop_back();
+        if (!Overlaps(nodes[node].box, box))
+            continue;
+        if (nodes[node].isLeaf()) {
+            results.push_back(nodes[node].userData);
+        } else {
+            stack.push_back(nodes[node].child1);
+            stack.push_back(nodes[node].child2);
+        }
+    }
+}
+
+void SceneBVH::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& results) const
+{
+    if (root == NullNode)
+        return;
+
+    float radiusSquared = radius * radius;
+    std::vector<int32_t> stack;
+    stack.push_back(root);
+    while (!stack.empty()) {
+        int32_t node = stack.back();
+        stack.pop_back();
+        if (DistanceSquared(center, nodes[node].box) > radiusSquared)
+            continue;
+        if (nodes[node].isLeaf()) {
+            results.push_back(nodes[node].userData);
+        } else {
+            stack.push_back(nodes[node].child1);
+            stack.push_back(nodes[node].child2);
+        }
+    }
+}
+
+void SceneBVH::queryKNearest(const glm::vec3& point, size_t k, std::vector<uint32_t>& results) const
+{
+    if (root == NullNode || k == 0)
+        return;
+
+    // Best-first search: nodes are expanded in order of their distance to the point,
+    // and the search stops once the closest open node is farther than the k-th result.
+    using Entry = std::pair<float, int32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    std::priority_queue<Entry> best;
+
+    open.push({ DistanceSquared(point, nodes[root].box), root });
+    while (!open.empty()) {
+        auto [distance, node] = open.top();
+        open.pop();
+        if (best.size() == k && distance >= best.top().first)
+            break;
+
+        if (nodes[node].isLeaf()) {
+            best.push({ distance, node });
+            if (best.size() > k)
+                best.pop();
+        } else {
+            for (int32_t child : { nodes[node].child1, nodes[node].child2 }) {
+                float childDistance = DistanceSquared(point, nodes[child].box);
+                if (best.size() < k || childDistance < best.top().first)
+                    open.push({ childDistance, child });
+            }
+        }
+    }
+
+    size_t first = results.size();
+    results.resize(first + best.size());
+    for (size_t i = results.size(); i > first; --i) {
+        results[i - 1] = nodes[best.top().second].userData;
+        best.pop();
+    }
+}
+
+bool SceneBVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxT, SceneRayHit& hit,
+                       const std::function<float(uint32_t, float)>& narrowPhase) const
+{
+    if (root == NullNode)
+        return false;
+
+    glm::vec3 invDir = 1.0f / direction;
+    float closest = maxT;
+    bool found = false;
+
+    std::vector<std::pair<float, int32_t>> stack;
+    float rootT = RayAABB(origin, invDir, closest, nodes[root].box);
+    if (rootT >= 0.0f)
+        stack.push_back({ rootT, root });
+
+    while (!stack.empty()) {
+        auto [entry, node] = stack.back();
+        stack.pop_back();
+        if (entry > closest)
+            continue;
+
+        if (nodes[node].isLeaf()) {
+            float t = narrowPhase ? narrowPhase(nodes[node].userData, closest) : entry;
+            if (t >= 0.0f && t <= closest) {
+                closest = t;
+                hit.userData = nodes[node].userData;
+                hit.t = t;
+                found = true;
+            }
+            continue;
+        }
+
+        // Push the farther child first so the nearer one is popped next.
+        int32_t child1 = nodes[node].child1;
+        int32_t child2 = nodes[node].child2;
+        float t1 = RayAABB(origin, invDir, closest, nodes[child1].box);
+        float t2 = RayAABB(origin, invDir, closest, nodes[child2].box);
+        if (t1 >= 0.0f && t2 >= 0.0f && t1 < t2) {
+            std::swap(t1, t2);
+            std::swap(child1, child2);
+        }
+        if (t1 >= 0.0f)
+            stack.push_back({ t1, child1 });
+        if (t2 >= 0.0f)
+            stack.push_back({ t2, child2 });
+    }
+    return found;
+}
+
+std::string BenchmarkSceneBVH()
+{
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+
+    std::ostringstream report;
+    report.setf(std::ios::fixed);
+    report.precision(2);
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 2.0f, 0.1f, 100.0f);
+    Frustum frustum = ExtractFrustum(projection * view);
+
+    for (size_t count : { size_t(10000), size_t(100000), size_t(1000000) }) {
+        // Keep the object density constant so the visible set stays comparable.
+        float halfWorld = 2.5f * std::cbrt(static_cast<float>(count));
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> position(-halfWorld, halfWorld);
+        std::uniform_real_distribution<float> size(0.25f, 1.5f);
+        std::uniform_real_distribution<float> step(-0.2f, 0.2f);
+
+        std::vector<AABB> boxes(count);
+        for (AABB& box : boxes) {
+            glm::vec3 center(position(rng), position(rng), position(rng));
+            glm::vec3 extent(size(rng));
+            box = { center - extent, center + extent };
+        }
+
+        SceneBVH tree;
+        std::vector<int32_t> proxies(count);
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < count; ++i)
+            proxies[i] = tree.insert(boxes[i], static_cast<uint32_t>(i));
+        auto t1 = Clock::now();
+
+        // Move a tenth of the objects by a small step, as a typical frame would.
+        size_t reinserted = 0;
+        for (size_t i = 0; i < count; i += 10) {
+            glm::vec3 delta(step(rng), step(rng), step(rng));
+            boxes[i].min += delta;
+            boxes[i].max += delta;
+            reinserted += tree.update(proxies[i], boxes[i], delta) ? 1 : 0;
+        }
+        auto t2 = Clock::now();
+
+        std::vector<uint32_t> visible;
+        tree.cullFrustum(frustum, visible);
+        auto t3 = Clock::now();
+        uint32_t nodesVisited = tree.getStats().nodesVisited;
+
+        FrustumCuller flat;
+        flat.resize(count);
+        for (size_t i = 0; i < count; ++i)
+            flat.set(i, boxes[i], SphereFromAABB(boxes[i]));
+        std::vector<uint32_t> flatVisible;
+        auto t4 = Clock::now();
+        flat.cull(frustum, flatVisible);
+        auto t5 = Clock::now();
+
+        std::vector<uint32_t> results;
+        const int queryCount = 1000;
+        auto t6 = Clock::now();
+        for (int q = 0; q < queryCount; ++q) {
+            results.clear();
+            tree.querySphere(glm::vec3(position(rng), position(rng), position(rng)), 5.0f, results);
+        }
+        auto t7 = Clock::now();
+        for (int q = 0; q < queryCount; ++q) {
+            results.clear();
+            tree.queryKNearest(glm::vec3(position(rng), position(rng), position(rng)), 8, results);
+        }
+        auto t8 = Clock::now();
+        SceneRayHit hit{};
+        for (int q = 0; q < queryCount; ++q) {
+            glm::vec3 direction = glm::normalize(glm::vec3(step(rng), step(rng), step(rng)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+            tree.raycast(glm::vec3(0.0f), direction, 2.0f * halfWorld, hit);
+        }
+        auto t9 = Clock::now();
+
+        report << count << " objects (height " << tree.getHeight() << ")\n"
+               << "  build " << ms(t0, t1) << " ms, refit 10% " << ms(t1, t2) << " ms (" << reinserted << " reinserted)\n"
+               << "  frustum: bvh " << ms(t2, t3) << " ms / " << nodesVisited << " nodes, flat simd "
+               << ms(t4, t5) << " ms, visible " << visible.size() << " vs " << flatVisible.size() << "\n"
+               << "  per query: sphere " << ms(t6, t7) * 1000.0 / queryCount << " us, 8-nn "
+               << ms(t7, t8) * 1000.0 / queryCount << " us, ray " << ms(t8, t9) * 1000.0 / queryCount << " us\n";
+    }
+    return report.str();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "def.h"
+#include "culling.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct SceneBVHNode {
+    AABB box;          // fattened for leaves so small moves don't touch the tree
+    int32_t parent;    // doubles as the free-list link
+    int32_t child1;
+    int32_t child2;
+    int32_t height;    // 0 for leaves, -1 for free nodes
+    uint32_t userData;
+
+    bool isLeaf() const { return child1 == -1; }
+};
+
+struct SceneRayHit {
+    uint32_t userData;
+    float t;
+};
+
+struct SceneBVHStats {
+    uint32_t nodesVisited;
+    uint32_t visible;
+};
+
+// Dynamic AABB tree over scene objects. Leaves are inserted with a margin
+// and only re-inserted once an object leaves its fat box; the tree is kept
+// balanced with AVL-style rotations on the way back up.
+class SceneBVH {
+public:
+    static constexpr int32_t NullNode = -1;
+
+    explicit SceneBVH(float margin = 0.1f);
+
+    int32_t insert(const AABB& box, uint32_t userData);
+    void remove(int32_t proxy);
+    // Returns true when the leaf had to be re-inserted.
+    bool update(int32_t proxy, const AABB& box, const glm::vec3& displacement = glm::vec3(0.0f));
+    void clear();
+
+    const AABB& getFatAABB(int32_t proxy) const { return nodes[proxy].box; }
+    uint32_t getUserData(int32_t proxy) const { return nodes[proxy].userData; }
+    int32_t getHeight() const { return root == NullNode ? 0 : nodes[root].height; }
+    size_t getLeafCount() const { return leafCount; }
+
+    // Appends the user data of every leaf touching the frustum. Planes a
+    // node is completely inside of are not re-tested for its children.
+    void cullFrustum(const Frustum& frustum, std::vector<uint32_t>& visible);
+    void queryAABB(const AABB& box, std::vector<uint32_t>& results) const;
+    void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& results) const;
+    // The k leaves closest to `point`, nearest first.
+    void queryKNearest(const glm::vec3& point, size_t k, std::vector<uint32_t>& results) const;
+    // Closest leaf along the ray. `narrowPhase` may refine a candidate and
+    // returns the exact hit distance, or a negative value for a miss.
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxT, SceneRayHit& hit,
+                 const std::function<float(uint32_t userData, float maxT)>& narrowPhase = nullptr) const;
+
+    const SceneBVHStats& getStats() const { return stats; }
+
+private:
+    int32_t allocateNode();
+    void freeNode(int32_t node);
+    void insertLeaf(int32_t leaf);
+    void removeLeaf(int32_t leaf);
+    int32_t balance(int32_t index);
+    void refitUpwards(int32_t index);
+    void collectLeaves(int32_t index, std::vector<uint32_t>& out, std::vector<int32_t>& stack) const;
+
+    std::vector<SceneBVHNode> nodes;
+    int32_t root = NullNode;
+    int32_t freeList = NullNode;
+    size_t leafCount = 0;
+    float margin;
+    SceneBVHStats stats{};
+    std::vector<int32_t> traversalStack;
+};
+
+// Builds, refits and queries trees of 10k, 100k and 1M random objects and
+// compares against the flat SIMD culler. Returns a printable report.
+std::string BenchmarkSceneBVH();
@@ -0,0 +1,218 @@
+#include "shaderutil.h"
+#include "glextra.h"
+#include "meshcache.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+std::string ReadShaderFile(const char* path)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to load the shader from file: " << path << "\n";
+        return std::string();
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+    return source.str();
+}
+
+namespace {
+
+ProgramBinaryStats binaryStats{};
+
+// Everything that decides the linked result: the driver, every stage's
+// final source (defines, and so the feature mask, included) and any
+// transform feedback outputs.
+uint64_t ProgramBinaryKey(const std::vector<ShaderStageSource>& stages, const std::vector<std::string>& sources,
+                          const std::vector<const char*>& feedbackVaryings)
+{
+    std::string key;
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        const char* text = reinterpret_cast<const char*>(glGetString(name));
+        key += text ? text : "";
+        key += '\n';
+    }
+    for (size_t i = 0; i < stages.size(); ++i)
+        key += std::to_string(stages[i].type) + '\n' + sources[i] + '\n';
+    for (const char* varying : feedbackVaryings)
+        key += std::string(varying) + '\n';
+    return HashCacheKey(key);
+}
+
+GLuint LoadProgramBinary(uint64_t key)
+{
+    // Payload: binary format, byte length, then the bytes padded to words.
+    std::vector<uint32_t> payload;
+    if (!LoadMeshCache("program", key, payload) || payload.size() < 2 ||
+        (payload[1] + 3) / 4 != payload.size() - 2)
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, payload[0], payload.data() + 2, static_cast<GLsizei>(payload[1]));
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        // A driver update can reject its own old binaries; just rebuild.
+        glDeleteProgram(program);
+        binaryStats.rejected++;
+        return 0;
+    }
+    return program;
+}
+
+void SaveProgramBinary(GLuint program, uint64_t key)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<uint32_t> payload(2 + (length + 3) / 4, 0u);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, payload.data() + 2);
+    if (written <= 0)
+        return;
+    payload[0] = format;
+    payload[1] = static_cast<uint32_t>(written);
+    payload.resize(2 + (written + 3) / 4);
+    if (SaveMeshCache("program", key, payload))
+        binaryStats.saved++;
+}
+
+bool ReadStageSources(const std::vector<ShaderStageSource>& stages, const std::string& defines,
+                      std::vector<std::string>& sources)
+{
+    for (const ShaderStageSource& stage : stages) {
+        std::string source = ReadShaderFile(stage.path);
+        if (source.empty())
+            return false;
+        if (!defines.empty()) {
+            size_t versionEnd = source.find('\n');
+            source.insert(versionEnd == std::string::npos ? source.size() : versionEnd + 1, defines);
+        }
+        sources.push_back(std::move(source));
+    }
+    return true;
+}
+
+// Queues every compile and the link. Errors are only looked at in
+// FinishProgramBuild(), so with parallel compilation nothing here waits.
+void IssueProgramBuild(const std::vector<ShaderStageSource>& stages, const std::vector<std::string>& sources,
+                       const std::vector<const char*>& feedbackVaryings, bool retrievable, ProgramBuild& build)
+{
+    build.program = glCreateProgram();
+    for (size_t i = 0; i < stages.size(); ++i) {
+        GLuint shader = glCreateShader(stages[i].type);
+        const char* text = sources[i].c_str();
+        glShaderSource(shader, 1, &text, nullptr);
+        glCompileShader(shader);
+        glAttachShader(build.program, shader);
+        build.shaders.push_back(shader);
+        build.paths.push_back(stages[i].path);
+    }
+    if (!feedbackVaryings.empty()) {
+        glTransformFeedbackVaryings(build.program, static_cast<GLsizei>(feedbackVaryings.size()), feedbackVaryings.data(),
+                                    GL_INTERLEAVED_ATTRIBS);
+    }
+    if (retrievable)
+        glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(build.program);
+}
+
+}
+
+GLuint BuildShaderProgram(const std::vector<ShaderStageSource>& stages, const std::string& defines,
+                          const std::vector<const char*>& feedbackVaryings)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto elapsedMs = [&]() {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    std::vector<std::string> sources;
+    if (!ReadStageSources(stages, defines, sources))
+        return 0;
+
+    bool useBinaries = GetGLCapabilities().programBinary;
+    uint64_t key = useBinaries ? ProgramBinaryKey(stages, sources, feedbackVaryings) : 0;
+    if (useBinaries) {
+        GLuint program = LoadProgramBinary(key);
+        if (program != 0) {
+            binaryStats.loaded++;
+            binaryStats.loadMs += elapsedMs();
+            return program;
+        }
+    }
+
+    ProgramBuild build;
+    IssueProgramBuild(stages, sources, feedbackVaryings, useBinaries, build);
+    GLuint program = FinishProgramBuild(build);
+    if (program != 0 && useBinaries)
+        SaveProgramBinary(program, key);
+    binaryStats.compiled++;
+    binaryStats.compileMs += elapsedMs();
+    return program;
+}
+
+const ProgramBinaryStats& GetProgramBinaryStats()
+{
+    return binaryStats;
+}
+
+bool BeginProgramBuild(const std::vector<ShaderStageSource>& stages, const std::string& defines, ProgramBuild& build,
+                       const std::vector<const char*>& feedbackVaryings)
+{
+    std::vector<std::string> sources;
+    if (!ReadStageSources(stages, defines, sources))
+        return false;
+    IssueProgramBuild(stages, sources, feedbackVaryings, false, build);
+    return true;
+}
+
+bool IsProgramBuildDone(const ProgramBuild& build)
+{
+    if (build.program == 0 || !GetGLCapabilities().parallelShaderCompile)
+        return true;
+    GLint done = GL_FALSE;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+GLuint FinishProgramBuild(ProgramBuild& build)
+{
+    bool compiled = true;
+    for (size_t i = 0; i < build.shaders.size(); ++i) {
+        GLint success = 0;
+        glGetShaderiv(build.shaders[i], GL_COMPILE_STATUS, &success);
+        if (!success) {
+            GLchar infoLog[1024];
+            glGetShaderInfoLog(build.shaders[i], 1024, nullptr, infoLog);
+            std::cerr << "| ERROR::SHADER-COMPILATION-ERROR in " << build.paths[i] << "\n" << infoLog << std::endl;
+            compiled = false;
+        }
+    }
+
+    GLuint program = build.program;
+    if (program != 0) {
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // A failed compile fails the link too; its log says it all.
+            if (compiled) {
+                GLchar infoLog[1024];
+                glGetProgramInfoLog(program, 1024, nullptr, infoLog);
+                std::cerr << "| ERROR::PROGRAM-LINKING-ERROR\n" << infoLog << std::endl;
+            }
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    for (GLuint shader : build.shaders)
+        glDeleteShader(shader);
+    build = ProgramBuild();
+    return program;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glad.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ShaderStageSource {
+    GLenum type;
+    const char* path;
+};
+
+std::string ReadShaderFile(const char* path);
+
+// Reads, compiles and links the given stages. `defines` is inserted right
+// after each stage's #version line. When `feedbackVaryings` is not empty the
+// outputs are captured interleaved by transform feedback. Logs and returns 0
+// on any failure.
+// Where the driver supports program binaries, linked programs are kept in
+// cache/ under a hash of the driver strings and the final sources; a later
+// build with the same key loads the binary and skips compiling altogether.
+GLuint BuildShaderProgram(const std::vector<ShaderStageSource>& stages, const std::string& defines = std::string(),
+                          const std::vector<const char*>& feedbackVaryings = std::vector<const char*>());
+
+// A program whose compiles and link have been issued but not checked.
+struct ProgramBuild {
+    GLuint program = 0;
+    std::vector<GLuint> shaders;
+    std::vector<const char*> paths;
+};
+
+// The same build in steps, for callers that must not wait on the driver.
+// Begin issues the compiles and the link and returns false only if a source
+// could not be read. Done reports whether Finish would return without
+// blocking; only KHR_parallel_shader_compile can tell, so without it the
+// answer is always yes. Finish logs any errors, releases the shaders and
+// returns the program or 0. These skip the binary cache.
+bool BeginProgramBuild(const std::vector<ShaderStageSource>& stages, const std::string& defines, ProgramBuild& build,
+                       const std::vector<const char*>& feedbackVaryings = std::vector<const char*>());
+bool IsProgramBuildDone(const ProgramBuild& build);
+GLuint FinishProgramBuild(ProgramBuild& build);
+
+struct ProgramBinaryStats {
+    uint32_t loaded;     // programs restored from a cached binary
+    uint32_t compiled;   // programs built from source
+    uint32_t saved;
+    uint32_t rejected;   // cached binaries the driver refused
+    float loadMs;
+    float compileMs;
+};
+
+const ProgramBinaryStats& GetProgramBinaryStats();
@@ -0,0 +1,198 @@
+#include "shadervariants.h"
+#include "def.h"
+#include "glextra.h"
+#include "hotreload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+namespace {
+
+const char* const FeatureDefines[ShaderFeatureCount] = {
+    "STRAING_TEXTURED",
+    "STRAING_INSTANCED",
+    "STRAING_DRAW_PARAMETERS",
+};
+
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    // FNV-1a, 64-bit.
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}
+
+std::string ShaderFeatureDefines(uint32_t features)
+{
+    std::string defines;
+    for (int bit = 0; bit < ShaderFeatureCount; ++bit) {
+        if (features & (1u << bit))
+            defines += std::string("#define ") + FeatureDefines[bit] + "\n";
+    }
+    return defines;
+}
+
+uint32_t MeshShaderFeatures(const Mesh& mesh)
+{
+    return mesh.textures.empty() ? 0u : static_cast<uint32_t>(ShaderFeatureTextured);
+}
+
+GLuint ShaderProgramCache::get(const std::vector<ShaderStageSource>& stages, uint32_t features, const std::string& defines,
+                               const std::vector<const char*>& feedbackVaryings)
+{
+    stats.lookups++;
+    std::string identity;
+    for (const ShaderStageSource& stage : stages)
+        identity += std::to_string(stage.type) + ':' + stage.path + ';';
+    identity += defines;
+    for (const char* varying : feedbackVaryings)
+        identity += std::string(";") + varying;
+    uint64_t key = HashBytes(14695981039346656037ull, identity.data(), identity.size());
+    key = HashBytes(key, &features, sizeof(features));
+
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+        if (found->second.identity == identity)
+            return found->second.program;
+        std::cerr << "Shader cache key collision, rebuilding " << identity << "\n";
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    GLProgram program(BuildShaderProgram(stages, ShaderFeatureDefines(features) + defines, feedbackVaryings));
+    stats.compileMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats.compiles++;
+    if (!program)
+        stats.failures++;
+
+    Entry& entry = entries[key];
+    entry.identity = std::move(identity);
+    entry.program = std::move(program);
+    entry.stages = stages;
+    entry.features = features;
+    entry.defines = defines;
+    entry.feedbackVaryings = feedbackVaryings;
+    stats.programs = static_cast<uint32_t>(entries.size());
+    return entry.program;
+}
+
+void ShaderProgramCache::clear()
+{
+    for (PendingRebuild& rebuild : rebuilds)
+        glDeleteProgram(FinishProgramBuild(rebuild.build));
+    rebuilds.clear();
+    entries.clear();
+    generation++;
+    stats.programs = 0;
+    stats.reloadsPending = 0;
+}
+
+uint32_t ShaderProgramCache::reload(const std::string& path, GLWorker* worker)
+{
+    uint32_t queued = 0;
+    for (auto& [key, entry] : entries) {
+        bool uses = std::any_of(entry.stages.begin(), entry.stages.end(),
+                                [&](const ShaderStageSource& stage) { return path == stage.path; });
+        if (!uses)
+            continue;
+        uint32_t serial = ++entry.reloadSerial;
+        std::string defines = ShaderFeatureDefines(entry.features) + entry.defines;
+        queued++;
+        stats.reloadsPending++;
+
+        if (GetGLCapabilities().parallelShaderCompile) {
+            PendingRebuild rebuild{ key, serial, ProgramBuild() };
+            if (BeginProgramBuild(entry.stages, defines, rebuild.build, entry.feedbackVaryings))
+                rebuilds.push_back(std::move(rebuild));
+            else
+                swapRebuilt(key, serial, 0);
+        } else if (worker && worker->isReady()) {
+            auto program = std::make_shared<GLuint>(0);
+            std::vector<ShaderStageSource> stages = entry.stages;
+            std::vector<const char*> varyings = entry.feedbackVaryings;
+            uint64_t entryKey = key;
+            worker->submit(
+                [program, stages, defines, varyings]() {
+                    ProgramBuild build;
+                    if (BeginProgramBuild(stages, defines, build, varyings))
+                        *program = FinishProgramBuild(build);
+                },
+                [this, program, entryKey, serial]() { swapRebuilt(entryKey, serial, *program); });
+        } else {
+            ProgramBuild build;
+            swapRebuilt(key, serial,
+                        BeginProgramBuild(entry.stages, defines, build, entry.feedbackVaryings) ? FinishProgramBuild(build) : 0);
+        }
+    }
+    return queued;
+}
+
+void ShaderProgramCache::update()
+{
+    for (size_t i = 0; i < rebuilds.size();) {
+        if (!IsProgramBuildDone(rebuilds[i].build)) {
+            ++i;
+            continue;
+        }
+        PendingRebuild rebuild = std::move(rebuilds[i]);
+        rebuilds.erase(rebuilds.begin() + i);
+        swapRebuilt(rebuild.key, rebuild.serial, FinishProgramBuild(rebuild.build));
+    }
+}
+
+void ShaderProgramCache::swapRebuilt(uint64_t key, uint32_t serial, GLuint program)
+{
+    stats.reloadsPending--;
+    auto found = entries.find(key);
+    if (found == entries.end() || found->second.reloadSerial != serial) {
+        // Cleared, or superseded by a newer edit.
+        if (program != 0)
+            glDeleteProgram(program);
+        return;
+    }
+    Entry& entry = found->second;
+    if (program == 0) {
+        stats.reloadFailures++;
+        std::cerr << "Keeping the previous program for " << entry.identity << "\n";
+        return;
+    }
+    entry.program = GLProgram(program);
+    stats.reloads++;
+    // Memoized names in ShaderVariants must be looked up again.
+    generation++;
+}
+
+ShaderProgramCache& GetShaderProgramCache()
+{
+    static ShaderProgramCache cache;
+    return cache;
+}
+
+ShaderVariants::ShaderVariants(std::vector<ShaderStageSource> stages, uint32_t supportedFeatures, std::string defines,
+                               std::vector<const char*> feedbackVaryings)
+    : stages(std::move(stages)), supported(supportedFeatures), defines(std::move(defines)),
+      feedbackVaryings(std::move(feedbackVaryings))
+{
+}
+
+GLuint ShaderVariants::get(uint32_t features) const
+{
+    ShaderProgramCache& cache = GetShaderProgramCache();
+    if (generation != cache.getGeneration()) {
+        std::fill(std::begin(resolved), std::end(resolved), false);
+        generation = cache.getGeneration();
+    }
+    features &= supported;
+    if (!resolved[features]) {
+        programs[features] = stages.empty() ? 0 : cache.get(stages, features, defines, feedbackVaryings);
+        resolved[features] = true;
+    }
+    return programs[features];
+}
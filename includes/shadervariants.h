@@ -0,0 +1,115 @@
+#pragma once
+
+#include "glresource.h"
+#include "shaderutil.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Mesh;
+class GLWorker;
+
+// Compile-time shader features. Each set bit becomes a #define in every
+// stage, so a variant pays only for what its material uses instead of
+// branching on uniforms per fragment.
+enum ShaderFeature : uint32_t {
+    ShaderFeatureTextured = 1u << 0,         // STRAING_TEXTURED: albedo from uTexture, else uColor
+    ShaderFeatureInstanced = 1u << 1,        // STRAING_INSTANCED: model matrix per instance in attributes 3-6
+    ShaderFeatureDrawParameters = 1u << 2,   // STRAING_DRAW_PARAMETERS: object index from gl_DrawIDARB
+};
+constexpr int ShaderFeatureCount = 3;
+
+// The #define lines for `features`, in bit order.
+std::string ShaderFeatureDefines(uint32_t features);
+// The material features a mesh draws with.
+uint32_t MeshShaderFeatures(const Mesh& mesh);
+
+struct ShaderCacheStats {
+    uint32_t programs;
+    uint32_t compiles;
+    uint32_t failures;
+    uint64_t lookups;
+    float compileMs;
+    uint32_t reloads;          // variants swapped for a rebuilt program
+    uint32_t reloadFailures;   // rebuilds that failed, leaving the old program in place
+    uint32_t reloadsPending;
+};
+
+// Every program variant built so far, keyed by a hash of its stages,
+// extra defines and feature mask. Failed builds are remembered too, so a
+// broken variant logs once instead of every frame.
+class ShaderProgramCache {
+public:
+    // Builds the variant on first request. Returns 0 if it does not compile.
+    // `feedbackVaryings` must point to strings that outlive the cache.
+    GLuint get(const std::vector<ShaderStageSource>& stages, uint32_t features, const std::string& defines = std::string(),
+               const std::vector<const char*>& feedbackVaryings = std::vector<const char*>());
+    // Deletes every program; the context must still be current.
+    void clear();
+
+    // Rebuilds every variant with a stage read from `path` without waiting
+    // on the driver: polled through KHR_parallel_shader_compile when present,
+    // else compiled on `worker`'s shared context, else (no worker) right
+    // away. Each variant keeps its current program until the new one has
+    // linked, and keeps it for good if it fails. Returns the variants queued.
+    uint32_t reload(const std::string& path, GLWorker* worker);
+    // Swaps in rebuilt programs that are ready. Call once per frame.
+    void update();
+
+    // Bumped by clear() and by every swapped rebuild, so holders of program
+    // names know to look them up again.
+    uint32_t getGeneration() const { return generation; }
+    const ShaderCacheStats& getStats() const { return stats; }
+
+private:
+    struct Entry {
+        std::string identity;   // checked on hit, in case two keys collide
+        GLProgram program;
+        std::vector<ShaderStageSource> stages;
+        uint32_t features;
+        std::string defines;
+        std::vector<const char*> feedbackVaryings;
+        uint32_t reloadSerial = 0;   // newest rebuild; older ones finishing late are dropped
+    };
+
+    struct PendingRebuild {
+        uint64_t key;
+        uint32_t serial;
+        ProgramBuild build;
+    };
+
+    void swapRebuilt(uint64_t key, uint32_t serial, GLuint program);
+
+    std::unordered_map<uint64_t, Entry> entries;
+    std::vector<PendingRebuild> rebuilds;
+    uint32_t generation = 1;
+    ShaderCacheStats stats{};
+};
+
+ShaderProgramCache& GetShaderProgramCache();
+
+// One shader's family of variants: its stages, the features its sources
+// understand and any fixed defines. Requested features it does not support
+// are dropped, so unrelated bits never fork identical programs. Lookups are
+// memoized per feature mask, which keeps get() cheap enough to call per draw.
+class ShaderVariants {
+public:
+    ShaderVariants() = default;
+    ShaderVariants(std::vector<ShaderStageSource> stages, uint32_t supportedFeatures,
+                   std::string defines = std::string(),
+                   std::vector<const char*> feedbackVaryings = std::vector<const char*>());
+
+    GLuint get(uint32_t features) const;
+    uint32_t getSupportedFeatures() const { return supported; }
+    bool isEmpty() const { return stages.empty(); }
+
+private:
+    std::vector<ShaderStageSource> stages;
+    uint32_t supported = 0;
+    std::string defines;
+    std::vector<const char*> feedbackVaryings;
+    mutable GLuint programs[1 << ShaderFeatureCount] = {};
+    mutable bool resolved[1 << ShaderFeatureCount] = {};
+    mutable uint32_t generation = 0;
+};
@@ -0,0 +1,590 @@
+#include "shadows.h"
+#include "culling.h"
+#include "shaderutil.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+
+GLTexture CreateDepthArray(int resolution, int layers, bool compare)
+{
+    GLTexture texture = GLTexture::create();
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, layers, 0, GL_DEPTH_COMPONENT,
+                 GL_UNSIGNED_INT, nullptr);
+    // Linear filtering with comparison gives a bilinear 2x2 PCF per tap.
+    GLint filter = compare ? GL_LINEAR : GL_NEAREST;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    if (compare) {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return texture;
+}
+
+}
+
+bool CascadedShadowMaps::init(int size)
+{
+    // Built through the program cache so that shader reloads reach them.
+    depthShader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/depth.vertex.shader" },
+                                   { GL_FRAGMENT_SHADER, "shaders/depth.fragment.shader" } },
+                                 0);
+    if (depthShader.get(0) == 0) {
+        depthShader = ShaderVariants();
+        return false;
+    }
+    resolution = size;
+    depth = CreateDepthArray(resolution, Cascades, true);
+    staticDepth = CreateDepthArray(resolution, Cascades, false);
+
+    fbo = GLFramebuffer::create();
+    copyFbo = GLFramebuffer::create();
+    // Both are depth only, including the blit source, so neither has a
+    // colour buffer to read or draw.
+    GLenum status = GL_FRAMEBUFFER_COMPLETE;
+    for (GLuint framebuffer : { static_cast<GLuint>(fbo), static_cast<GLuint>(copyFbo) }) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, framebuffer == fbo ? depth : staticDepth, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+            break;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Shadow framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+void CascadedShadowMaps::destroy()
+{
+    depthShader = ShaderVariants();
+    depth.reset();
+    staticDepth.reset();
+    fbo.reset();
+    copyFbo.reset();
+    momentsShader = ShaderVariants();
+    blurShader = ShaderVariants();
+    moments.reset();
+    blurTemp.reset();
+    momentsFbo.reset();
+    depthReadSampler.reset();
+    emptyVAO.reset();
+    for (Cascade& cascade : cascades)
+        cascade = Cascade();
+    objects.clear();
+    stats = {};
+}
+
+size_t CascadedShadowMaps::getBytes() const
+{
+    if (!isReady())
+        return 0;
+    size_t texels = static_cast<size_t>(resolution) * resolution;
+    size_t bytes = texels * Cascades * 4 * 2;
+    if (moments)
+        bytes += texels * Cascades * 8 * 4 / 3 + texels * 8;   // mipmapped moments and the blur target
+    return bytes;
+}
+
+void CascadedShadowMaps::trackObjects(const std::vector<SceneObject>& scene)
+{
+    if (objects.size() != scene.size()) {
+        objects.assign(scene.size(), { glm::vec4(0.0f), 0, false });
+        staticVersion++;
+    }
+    staticCasters.clear();
+    dynamicCasters.clear();
+    for (size_t i = 0; i < scene.size(); ++i) {
+        ObjectState& state = objects[i];
+        glm::vec4 sphere(scene[i].worldSphere.center, scene[i].worldSphere.radius);
+        // The bounds are refreshed on every transform change, so they
+        // serve as the object's motion signal.
+        state.stillFrames = sphere == state.sphere ? state.stillFrames + 1 : 0;
+        state.sphere = sphere;
+        bool isStatic = cacheStatic && state.stillFrames >= StaticFrames;
+        if (isStatic != state.isStatic) {
+            state.isStatic = isStatic;
+            staticVersion++;
+        }
+        (isStatic ? staticCasters : dynamicCasters).push_back(static_cast<uint32_t>(i));
+    }
+}
+
+void CascadedShadowMaps::fitCascades(const std::vector<SceneObject>& scene, const glm::mat4& view,
+                                     const glm::mat4& projection, const glm::vec3& lightDirection, Cascade* fitted) const
+{
+    float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    float farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    float range = std::min(shadowDistance, farPlane);
+
+    // Frustum corner rays: view depth is linear along each of them.
+    glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+    glm::vec3 nearCorners[4], farCorners[4];
+    for (int i = 0; i < 4; ++i) {
+        glm::vec2 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f);
+        glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+        glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+        nearCorners[i] = glm::vec3(nearPoint) / nearPoint.w;
+        farCorners[i] = glm::vec3(farPoint) / farPoint.w;
+    }
+
+    glm::vec3 direction = glm::normalize(lightDirection);
+    glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    // Fixed rotation with the eye at the origin: translation is left to the
+    // projection, where it can be snapped to texels.
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+    // Depth range of every caster along the light, rounded out so small
+    // motions do not change the matrices.
+    float casterNear = FLT_MAX, casterFar = -FLT_MAX;
+    for (const SceneObject& object : scene) {
+        float objectDepth = -(lightView * glm::vec4(object.worldSphere.center, 1.0f)).z;
+        casterNear = std::min(casterNear, objectDepth - object.worldSphere.radius);
+        casterFar = std::max(casterFar, objectDepth + object.worldSphere.radius);
+    }
+
+    float splitNear = nearPlane;
+    for (int c = 0; c < Cascades; ++c) {
+        float t = static_cast<float>(c + 1) / Cascades;
+        float logSplit = nearPlane * std::pow(range / nearPlane, t);
+        float uniformSplit = nearPlane + (range - nearPlane) * t;
+        float splitFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+
+        glm::vec3 corners[8];
+        for (int i = 0; i < 4; ++i) {
+            glm::vec3 ray = farCorners[i] - nearCorners[i];
+            corners[i] = nearCorners[i] + ray * ((splitNear - nearPlane) / (farPlane - nearPlane));
+            corners[i + 4] = nearCorners[i] + ray * ((splitFar - nearPlane) / (farPlane - nearPlane));
+        }
+        glm::vec3 center(0.0f);
+        for (const glm::vec3& corner : corners)
+            center += corner / 8.0f;
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners)
+            radius = std::max(radius, glm::length(corner - center));
+        // Only depends on the projection, but rounding absorbs float noise
+        // from the camera's orientation.
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        float texel = 2.0f * radius / resolution;
+        glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+        lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+        lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+        float centerDepth = -lightCenter.z;
+        float zNear = std::floor(std::min(casterNear, centerDepth - radius) / 2.0f) * 2.0f;
+        float zFar = std::ceil((centerDepth + radius) / 2.0f) * 2.0f;
+
+        Cascade& cascade = fitted[c];
+        cascade.view = lightView;
+        cascade.projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius,
+                                        lightCenter.y + radius, zNear, std::max(zFar, zNear + 1.0f));
+        cascade.splitFar = splitFar;
+        cascade.texelWorld = texel;
+        splitNear = splitFar;
+    }
+}
+
+void CascadedShadowMaps::drawCasters(const std::vector<SceneObject>& scene, const Cascade& cascade,
+                                     const std::vector<uint32_t>& casters, const ShadowCasterDraw& drawCaster)
+{
+    glm::mat4 viewProjection = cascade.projection * cascade.view;
+    Frustum frustum = ExtractFrustum(viewProjection);
+    for (uint32_t index : casters) {
+        if (!SphereInFrustum(frustum, scene[index].worldSphere))
+            continue;
+        drawCaster(index, depthShader.get(0), viewProjection);
+        stats.drawCalls++;
+    }
+}
+
+void CascadedShadowMaps::update(const std::vector<SceneObject>& scene, const glm::mat4& view,
+                                const glm::mat4& projection, const glm::vec3& lightDirection,
+                                const ShadowCasterDraw& drawCaster)
+{
+    stats = {};
+    if (!isReady())
+        return;
+    cameraView = view;
+    trackObjects(scene);
+    stats.staticCasters = static_cast<uint32_t>(staticCasters.size());
+    stats.dynamicCasters = static_cast<uint32_t>(dynamicCasters.size());
+
+    Cascade fitted[Cascades];
+    fitCascades(scene, view, projection, lightDirection, fitted);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, resolution, resolution);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    for (int c = 0; c < Cascades; ++c) {
+        Cascade& cascade = cascades[c];
+        bool moved = fitted[c].view != cascade.view || fitted[c].projection != cascade.projection;
+        cascade.view = fitted[c].view;
+        cascade.projection = fitted[c].projection;
+        cascade.splitFar = fitted[c].splitFar;
+        cascade.texelWorld = fitted[c].texelWorld;
+
+        Frustum frustum = ExtractFrustum(cascade.projection * cascade.view);
+        bool hasDynamic = false;
+        for (uint32_t index : staticCasters)
+            stats.cascadeCasters[c] += SphereInFrustum(frustum, scene[index].worldSphere) ? 1 : 0;
+        for (uint32_t index : dynamicCasters) {
+            if (SphereInFrustum(frustum, scene[index].worldSphere)) {
+                stats.cascadeCasters[c]++;
+                hasDynamic = true;
+            }
+        }
+
+        bool staticDirty = moved || cascade.staticVersion != staticVersion;
+        if (staticDirty) {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepth, 0, c);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            drawCasters(scene, cascade, staticCasters, drawCaster);
+            cascade.staticVersion = staticVersion;
+            stats.staticRedraws++;
+        }
+
+        // The live layer is the static one with the moving casters on top.
+        if (!staticDirty && !hasDynamic && !cascade.hasDynamic)
+            continue;
+        cascade.hasDynamic = hasDynamic;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFbo);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepth, 0, c);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0, c);
+        glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        stats.copies++;
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        drawCasters(scene, cascade, dynamicCasters, drawCaster);
+        momentsValid[c] = false;
+    }
+    glDisable(GL_POLYGON_OFFSET_FILL);
+
+    if (filter == ShadowFilter::EVSM && (moments || createMoments())) {
+        if (blurRadius != momentsRadius) {
+            momentsRadius = blurRadius;
+            std::fill(std::begin(momentsValid), std::end(momentsValid), false);
+        }
+        for (int c = 0; c < Cascades; ++c) {
+            if (!momentsValid[c])
+                prefilter(c);
+        }
+        if (stats.prefiltered > 0) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, moments);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+bool CascadedShadowMaps::createMoments()
+{
+    momentsShader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/fullscreen.vertex.shader" },
+                                     { GL_FRAGMENT_SHADER, "shaders/evsm.fragment.shader" } },
+                                   0, "#define FROM_DEPTH\n");
+    blurShader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/fullscreen.vertex.shader" },
+                                  { GL_FRAGMENT_SHADER, "shaders/evsm.fragment.shader" } },
+                                0);
+    if (momentsShader.get(0) == 0 || blurShader.get(0) == 0) {
+        momentsShader = ShaderVariants();
+        blurShader = ShaderVariants();
+        filter = ShadowFilter::PCF;
+        return false;
+    }
+
+    // Outside the map reads as fully lit: the moments of the far plane.
+    float positive = std::exp(PositiveExponent), negative = -std::exp(-NegativeExponent);
+    float border[] = { positive, positive * positive, negative, negative * negative };
+    moments = GLTexture::create();
+    glBindTexture(GL_TEXTURE_2D_ARRAY, moments);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA16F, resolution, resolution, Cascades, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    blurTemp = GLTexture::create();
+    glBindTexture(GL_TEXTURE_2D, blurTemp);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, resolution, resolution, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    depthReadSampler = GLSampler::create();
+    glSamplerParameteri(depthReadSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glSamplerParameteri(depthReadSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glSamplerParameteri(depthReadSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glSamplerParameteri(depthReadSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(depthReadSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    momentsFbo = GLFramebuffer::create();
+    emptyVAO = GLVertexArray::create();
+    std::fill(std::begin(momentsValid), std::end(momentsValid), false);
+    return true;
+}
+
+void CascadedShadowMaps::prefilter(int cascade)
+{
+    // Horizontal pass converts depth to moments on the fly, vertical pass
+    // writes the cascade's layer; moments are linear, so blurring them is exact.
+    float texel = 1.0f / resolution;
+    glBindFramebuffer(GL_FRAMEBUFFER, momentsFbo);
+    glBindVertexArray(emptyVAO);
+    glDisable(GL_DEPTH_TEST);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurTemp, 0);
+    GLuint momentsProgram = momentsShader.get(0), blurProgram = blurShader.get(0);
+    glUseProgram(momentsProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depth);
+    glBindSampler(0, depthReadSampler);
+    glUniform1i(glGetUniformLocation(momentsProgram, "uDepth"), 0);
+    glUniform1f(glGetUniformLocation(momentsProgram, "uLayer"), static_cast<float>(cascade));
+    glUniform2f(glGetUniformLocation(momentsProgram, "uExponents"), PositiveExponent, NegativeExponent);
+    glUniform2f(glGetUniformLocation(momentsProgram, "uStep"), texel, 0.0f);
+    glUniform1f(glGetUniformLocation(momentsProgram, "uInvResolution"), texel);
+    glUniform1i(glGetUniformLocation(momentsProgram, "uRadius"), blurRadius);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindSampler(0, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, moments, 0, cascade);
+    glUseProgram(blurProgram);
+    glBindTexture(GL_TEXTURE_2D, blurTemp);
+    glUniform1i(glGetUniformLocation(blurProgram, "uSource"), 0);
+    glUniform2f(glGetUniformLocation(blurProgram, "uStep"), 0.0f, texel);
+    glUniform1f(glGetUniformLocation(blurProgram, "uInvResolution"), texel);
+    glUniform1i(glGetUniformLocation(blurProgram, "uRadius"), blurRadius);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glEnable(GL_DEPTH_TEST);
+    glBindVertexArray(0);
+    momentsValid[cascade] = true;
+    stats.prefiltered++;
+}
+
+void BindShadowUniforms(const CascadedShadowMaps* shadows, GLuint program, GLuint unit)
+{
+    // The sampler gets its own unit even without shadows, so it never
+    // aliases a unit holding a different texture type.
+    glUniform1i(glGetUniformLocation(program, "uShadowMap"), static_cast<GLint>(unit));
+    glUniform1i(glGetUniformLocation(program, "uShadowMoments"), static_cast<GLint>(unit + 1));
+    if (!shadows || !shadows->isReady()) {
+        glUniform1i(glGetUniformLocation(program, "uShadowCascades"), 0);
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadows->depth);
+    bool evsm = shadows->filter == ShadowFilter::EVSM && shadows->moments;
+    if (evsm) {
+        glActiveTexture(GL_TEXTURE0 + unit + 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadows->moments);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(program, "uShadowFilter"), evsm ? 1 : 0);
+    glUniform2f(glGetUniformLocation(program, "uShadowExponents"), CascadedShadowMaps::PositiveExponent,
+                CascadedShadowMaps::NegativeExponent);
+
+    // Clip space to texture space.
+    const glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+    glm::mat4 matrices[CascadedShadowMaps::Cascades];
+    glm::vec4 splits, texels;
+    for (int c = 0; c < CascadedShadowMaps::Cascades; ++c) {
+        const auto& cascade = shadows->cascades[c];
+        matrices[c] = bias * cascade.projection * cascade.view;
+        splits[c] = cascade.splitFar;
+        texels[c] = cascade.texelWorld;
+    }
+    glUniform1i(glGetUniformLocation(program, "uShadowCascades"), CascadedShadowMaps::Cascades);
+    glUniformMatrix4fv(glGetUniformLocation(program, "uShadowMatrices"), CascadedShadowMaps::Cascades, GL_FALSE,
+                       glm::value_ptr(matrices[0]));
+    glUniform4fv(glGetUniformLocation(program, "uCascadeSplits"), 1, glm::value_ptr(splits));
+    glUniform4fv(glGetUniformLocation(program, "uCascadeTexels"), 1, glm::value_ptr(texels));
+    glUniformMatrix4fv(glGetUniformLocation(program, "uShadowView"), 1, GL_FALSE, glm::value_ptr(shadows->cameraView));
+    glUniform1f(glGetUniformLocation(program, "uShadowTexelSize"), 1.0f / shadows->resolution);
+}
+
+void BindForwardSunUniforms(const CascadedShadowMaps* shadows, GLuint program, const glm::vec3& sunDirection,
+                            const glm::vec3& viewPosition, GLuint unit)
+{
+    glm::vec3 sun = glm::normalize(sunDirection);
+    glUniform3fv(glGetUniformLocation(program, "uSunDirection"), 1, glm::value_ptr(sun));
+    glUniform3fv(glGetUniformLocation(program, "viewPos"), 1, glm::value_ptr(viewPosition));
+    BindShadowUniforms(shadows, program, unit);
+}
+
+bool OmniShadowMaps::init(int size)
+{
+    shader = ShaderVariants({ { GL_VERTEX_SHADER, "shaders/omnishadow.vertex.shader" },
+                              { GL_GEOMETRY_SHADER, "shaders/omnishadow.geometry.shader" },
+                              { GL_FRAGMENT_SHADER, "shaders/omnishadow.fragment.shader" } },
+                            0);
+    if (shader.get(0) == 0) {
+        shader = ShaderVariants();
+        return false;
+    }
+    resolution = size;
+
+    for (GLTexture& cubeMap : cubeMaps) {
+        cubeMap = GLTexture::create();
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+        for (GLenum face = 0; face < 6; ++face) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, resolution, resolution, 0,
+                         GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    // Attaching the whole cube makes the framebuffer layered.
+    fbo = GLFramebuffer::create();
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cubeMaps[0], 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Omni shadow framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+void OmniShadowMaps::destroy()
+{
+    shader = ShaderVariants();
+    fbo.reset();
+    for (GLTexture& cubeMap : cubeMaps)
+        cubeMap.reset();
+    slotLights.clear();
+    stats = {};
+}
+
+size_t OmniShadowMaps::getBytes() const
+{
+    return isReady() ? static_cast<size_t>(resolution) * resolution * 6 * 4 * MaxLights : 0;
+}
+
+void OmniShadowMaps::update(const std::vector<PointLight>& lights, const std::vector<SceneObject>& scene,
+                            const glm::mat4& viewProjection, const glm::vec3& cameraPosition,
+                            const ShadowCasterDraw& drawCaster)
+{
+    stats = {};
+    slotLights.clear();
+    if (!isReady())
+        return;
+
+    // Visible lights, nearest surface first.
+    Frustum frustum = ExtractFrustum(viewProjection);
+    candidates.clear();
+    for (size_t i = 0; i < lights.size(); ++i) {
+        if (SphereInFrustum(frustum, { lights[i].position, lights[i].radius }))
+            candidates.push_back({ glm::length(lights[i].position - cameraPosition) - lights[i].radius, static_cast<uint32_t>(i) });
+    }
+    size_t count = std::min<size_t>(candidates.size(), static_cast<size_t>(std::clamp(maxLights, 0, MaxLights)));
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+
+    // Cube map face orientations, in GL_TEXTURE_CUBE_MAP_POSITIVE_X order.
+    static const glm::vec3 faceDirections[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    static const glm::vec3 faceUps[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, resolution, resolution);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    GLuint program = shader.get(0);
+    glUseProgram(program);
+    GLint faceMatricesLoc = glGetUniformLocation(program, "uFaceMatrices");
+    GLint faceMaskLoc = glGetUniformLocation(program, "uFaceMask");
+
+    for (size_t slot = 0; slot < count; ++slot) {
+        const PointLight& light = lights[candidates[slot].second];
+        slotLights.push_back(candidates[slot].second);
+        stats.shadowedLights++;
+
+        glm::mat4 faceProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, light.radius);
+        glm::mat4 faceMatrices[6];
+        Frustum faceFrusta[6];
+        for (int face = 0; face < 6; ++face) {
+            faceMatrices[face] = faceProjection * glm::lookAt(light.position, light.position + faceDirections[face], faceUps[face]);
+            faceFrusta[face] = ExtractFrustum(faceMatrices[face]);
+        }
+
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cubeMaps[slot], 0);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glUniformMatrix4fv(faceMatricesLoc, 6, GL_FALSE, glm::value_ptr(faceMatrices[0]));
+        glUniform3fv(glGetUniformLocation(program, "uLightPosition"), 1, glm::value_ptr(light.position));
+        glUniform1f(glGetUniformLocation(program, "uLightRadius"), light.radius);
+
+        for (size_t index = 0; index < scene.size(); ++index) {
+            const BoundingSphere& sphere = scene[index].worldSphere;
+            int faceMask = 0;
+            if (glm::length(sphere.center - light.position) < sphere.radius + light.radius) {
+                for (int face = 0; face < 6; ++face)
+                    faceMask |= SphereInFrustum(faceFrusta[face], sphere) ? 1 << face : 0;
+            }
+            if (faceMask == 0) {
+                stats.culledCasters++;
+                continue;
+            }
+            glUniform1i(faceMaskLoc, faceMask);
+            // With an identity view-projection the vertex shader's uMVP
+            // is the model matrix; the geometry shader projects per face.
+            drawCaster(static_cast<uint32_t>(index), program, glm::mat4(1.0f));
+            stats.drawCalls++;
+            for (int face = 0; face < 6; ++face)
+                stats.faceRoutes += (faceMask >> face) & 1;
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+GLuint OmniShadowMaps::getShadowMap(size_t lightIndex) const
+{
+    for (size_t slot = 0; slot < slotLights.size(); ++slot) {
+        if (slotLights[slot] == lightIndex)
+            return cubeMaps[slot];
+    }
+    return 0;
+}
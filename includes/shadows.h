@@ -0,0 +1,161 @@
+#pragma once
+
+#include "def.h"
+#include "lights.h"
+#include "shadervariants.h"
+#include <cstdint>
+#include <functional>
+
+struct ShadowStats {
+    uint32_t staticCasters, dynamicCasters;
+    uint32_t cascadeCasters[4];
+    uint32_t staticRedraws;   // cascades whose static layer was redrawn
+    uint32_t copies;          // static layers copied under dynamic casters
+    uint32_t drawCalls;
+    uint32_t prefiltered;     // cascades whose moments were rebuilt
+};
+
+// PCF compares depth per tap. EVSM stores exponentially warped depth
+// moments that are blurred and mipmapped once, so a soft lookup is a single
+// filtered fetch; it needs 8 more bytes per texel and leaks some light
+// where casters overlap in depth.
+enum class ShadowFilter { PCF, EVSM };
+
+// Draws scene object `index` with `program` and uMVP = viewProjection * its
+// world matrix, from its position-only vertex stream.
+using ShadowCasterDraw = std::function<void(uint32_t index, GLuint program, const glm::mat4& viewProjection)>;
+
+// Cascaded shadow maps for the sun. Cascades split the camera range up to
+// shadowDistance, each bounded by a sphere so its size is independent of the
+// camera's orientation, and snapped to whole texels in light space so the
+// map does not shimmer as the camera moves.
+//
+// Objects that have not moved for StaticFrames frames are static casters:
+// they are drawn into a cached layer that is redrawn only when its cascade's
+// matrices or the static set change. Moving objects are drawn over a copy of
+// that layer each frame. With nothing moving, a frame draws nothing.
+// In EVSM mode only the cascades that changed are prefiltered again.
+class CascadedShadowMaps {
+public:
+    static constexpr int Cascades = 4;
+    static constexpr uint32_t StaticFrames = 30;
+
+    bool init(int resolution);
+    void destroy();
+    bool isReady() const { return fbo != 0; }
+
+    // Refits the cascades to the camera and redraws what changed.
+    void update(const std::vector<SceneObject>& scene, const glm::mat4& view, const glm::mat4& projection,
+                const glm::vec3& lightDirection, const ShadowCasterDraw& drawCaster);
+    // Forces every static layer to be redrawn.
+    void invalidate() { staticVersion++; }
+
+    const ShadowStats& getStats() const { return stats; }
+    size_t getBytes() const;
+
+    float shadowDistance = 40.0f;
+    // Blend of logarithmic (1) and uniform (0) split distances.
+    float splitLambda = 0.8f;
+    bool cacheStatic = true;
+    ShadowFilter filter = ShadowFilter::PCF;
+    // Gaussian half-width of the EVSM prefilter, in texels.
+    int blurRadius = 3;
+
+    // Warp exponents; e^(2c) must stay below the half-float maximum.
+    static constexpr float PositiveExponent = 5.0f;
+    static constexpr float NegativeExponent = 5.0f;
+
+private:
+    struct Cascade {
+        glm::mat4 view = glm::mat4(0.0f), projection = glm::mat4(0.0f);
+        float splitFar = 0.0f;
+        float texelWorld = 0.0f;
+        uint64_t staticVersion = UINT64_MAX;
+        bool hasDynamic = false;
+    };
+    struct ObjectState {
+        glm::vec4 sphere;
+        uint32_t stillFrames;
+        bool isStatic;
+    };
+
+    void trackObjects(const std::vector<SceneObject>& scene);
+    void fitCascades(const std::vector<SceneObject>& scene, const glm::mat4& view, const glm::mat4& projection,
+                     const glm::vec3& lightDirection, Cascade* fitted) const;
+    void drawCasters(const std::vector<SceneObject>& scene, const Cascade& cascade, const std::vector<uint32_t>& casters,
+                     const ShadowCasterDraw& drawCaster);
+    bool createMoments();
+    void prefilter(int cascade);
+
+    ShaderVariants depthShader;
+    GLTexture depth, staticDepth;
+    GLFramebuffer fbo, copyFbo;
+    int resolution = 0;
+
+    // EVSM targets, created on first use.
+    ShaderVariants momentsShader, blurShader;
+    GLTexture moments, blurTemp;
+    GLFramebuffer momentsFbo;
+    GLSampler depthReadSampler;   // reads the compare-mode depth as values
+    GLVertexArray emptyVAO;
+    bool momentsValid[Cascades] = {};
+    int momentsRadius = -1;
+
+    Cascade cascades[Cascades];
+    glm::mat4 cameraView = glm::mat4(1.0f);
+    std::vector<ObjectState> objects;
+    uint64_t staticVersion = 0;
+    std::vector<uint32_t> staticCasters, dynamicCasters;
+    ShadowStats stats{};
+
+    friend void BindShadowUniforms(const CascadedShadowMaps* shadows, GLuint program, GLuint unit);
+};
+
+// Sets the sampler and cascade uniforms of a shader that receives sun
+// shadows; `shadows` may be null. `program` must be in use.
+void BindShadowUniforms(const CascadedShadowMaps* shadows, GLuint program, GLuint unit);
+// The same plus the sun direction and viewPos, for fragment.shader built
+// with SUN_SHADOWS.
+void BindForwardSunUniforms(const CascadedShadowMaps* shadows, GLuint program, const glm::vec3& sunDirection,
+                            const glm::vec3& viewPosition, GLuint unit);
+
+struct OmniShadowStats {
+    uint32_t shadowedLights;
+    uint32_t drawCalls;       // one per caster and light
+    uint32_t faceRoutes;      // faces the casters were routed to in total
+    uint32_t culledCasters;   // outside the light's range or every face
+};
+
+// Cube-map shadows for the point lights nearest the camera. Each light is
+// one layered pass: the CPU tests every caster against the six face frusta
+// and passes the mask of faces it touches, and a geometry shader sends each
+// triangle to those faces through gl_Layer, skipping faces it misses.
+// Depth is the distance to the light over its radius.
+class OmniShadowMaps {
+public:
+    static constexpr int MaxLights = 8;
+
+    bool init(int resolution);
+    void destroy();
+    bool isReady() const { return !shader.isEmpty(); }
+
+    // Picks up to `maxLights` lights and redraws their cube maps.
+    void update(const std::vector<PointLight>& lights, const std::vector<SceneObject>& scene,
+                const glm::mat4& viewProjection, const glm::vec3& cameraPosition, const ShadowCasterDraw& drawCaster);
+    // Cube map of light `lightIndex` from the last update, or 0.
+    GLuint getShadowMap(size_t lightIndex) const;
+
+    const OmniShadowStats& getStats() const { return stats; }
+    size_t getBytes() const;
+
+    int maxLights = 4;
+
+private:
+    ShaderVariants shader;
+    GLFramebuffer fbo;
+    GLTexture cubeMaps[MaxLights];
+    std::vector<uint32_t> slotLights;   // light index per used slot
+    std::vector<std::pair<float, uint32_t>> candidates;
+    int resolution = 0;
+    OmniShadowStats stats{};
+};
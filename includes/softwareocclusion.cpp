@@ -0,0 +1,316 @@
+#include "softwareocclusion.h"
+#include "meshresidency.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define STRAING_SSE 1
+#endif
+
+namespace {
+
+const size_t OccluderTriangleBudget = 1024;
+const float NearW = 1e-4f;
+
+}
+
+OccluderMesh BuildOccluderMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                               size_t maxTriangles)
+{
+    size_t triangleCount = indices.size() / 3;
+    std::vector<uint32_t> order(triangleCount);
+    std::iota(order.begin(), order.end(), 0u);
+
+    // Keep the largest triangles: they cover most of the screen per rasterized triangle.
+    std::vector<float> area(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        glm::vec3 a = positions[indices[t * 3 + 0]];
+        glm::vec3 b = positions[indices[t * 3 + 1]];
+        glm::vec3 c = positions[indices[t * 3 + 2]];
+        area[t] = glm::length(glm::cross(b - a, c - a));
+    }
+    if (triangleCount > maxTriangles) {
+        std::nth_element(order.begin(), order.begin() + maxTriangles, order.end(),
+                         [&](uint32_t x, uint32_t y) { return area[x] > area[y]; });
+        order.resize(maxTriangles);
+    }
+
+    OccluderMesh occluder;
+    std::unordered_map<unsigned int, uint32_t> remap;
+    for (uint32_t t : order) {
+        if (area[t] <= 0.0f)
+            continue;
+        for (int k = 0; k < 3; ++k) {
+            unsigned int index = indices[t * 3 + k];
+            auto it = remap.find(index);
+            if (it == remap.end()) {
+                it = remap.emplace(index, static_cast<uint32_t>(occluder.positions.size())).first;
+                occluder.positions.push_back(positions[index]);
+            }
+            occluder.indices.push_back(it->second);
+        }
+    }
+    return occluder;
+}
+
+const OccluderMesh& GetMeshOccluder(Mesh& mesh)
+{
+    if (!mesh.occluder) {
+        mesh.occluder = std::make_shared<OccluderMesh>();
+        VisitMeshPositions(mesh, [&](const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+            *mesh.occluder = BuildOccluderMesh(positions, indices, OccluderTriangleBudget);
+        });
+    }
+    return *mesh.occluder;
+}
+
+SoftwareOcclusion::SoftwareOcclusion(int width, int height)
+    : width((width + TileSize - 1) / TileSize * TileSize),
+      height((height + TileSize - 1) / TileSize * TileSize),
+      viewProjection(1.0f)
+{
+    tilesX = this->width / TileSize;
+    tilesY = this->height / TileSize;
+    depth.assign(static_cast<size_t>(this->width) * this->height, 1.0f);
+    tileMaxDepth.assign(static_cast<size_t>(tilesX) * tilesY, 1.0f);
+}
+
+void SoftwareOcclusion::beginFrame(const glm::mat4& viewProjection)
+{
+    this->viewProjection = viewProjection;
+    triangles.clear();
+    stats = {};
+}
+
+void SoftwareOcclusion::addOccluder(const OccluderMesh& occluder, const glm::mat4& model)
+{
+    glm::mat4 mvp = viewProjection * model;
+    std::vector<glm::vec4> clip(occluder.positions.size());
+    for (size_t i = 0; i < occluder.positions.size(); ++i)
+        clip[i] = mvp * glm::vec4(occluder.positions[i], 1.0f);
+
+    auto toScreen = [&](const glm::vec4& p) {
+        float invW = 1.0f / p.w;
+        return glm::vec3((p.x * invW * 0.5f + 0.5f) * width,
+                         (p.y * invW * 0.5f + 0.5f) * height,
+                         p.z * invW * 0.5f + 0.5f);
+    };
+
+    for (size_t t = 0; t + 2 < occluder.indices.size(); t += 3) {
+        glm::vec4 in[3] = { clip[occluder.indices[t]], clip[occluder.indices[t + 1]], clip[occluder.indices[t + 2]] };
+
+        // Clip against the near plane (z > -w); the other planes are handled by the screen bounds.
+        glm::vec4 polygon[4];
+        int vertexCount = 0;
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec4& a = in[i];
+            const glm::vec4& b = in[(i + 1) % 3];
+            float da = a.z + a.w, db = b.z + b.w;
+            if (da >= 0.0f)
+                polygon[vertexCount++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                polygon[vertexCount++] = a + (b - a) * (da / (da - db));
+        }
+        if (vertexCount < 3)
+            continue;
+
+        bool behind = false;
+        for (int i = 0; i < vertexCount; ++i)
+            behind |= polygon[i].w < NearW;
+        if (behind)
+            continue;
+
+        glm::vec3 s0 = toScreen(polygon[0]);
+        for (int i = 1; i + 1 < vertexCount; ++i) {
+            ScreenTriangle tri{ { s0, toScreen(polygon[i]), toScreen(polygon[i + 1]) } };
+            glm::vec2 lo = glm::min(glm::min(glm::vec2(tri.v[0].x, tri.v[0].y), glm::vec2(tri.v[1].x, tri.v[1].y)), glm::vec2(tri.v[2].x, tri.v[2].y));
+            glm::vec2 hi = glm::max(glm::max(glm::vec2(tri.v[0].x, tri.v[0].y), glm::vec2(tri.v[1].x, tri.v[1].y)), glm::vec2(tri.v[2].x, tri.v[2].y));
+            if (hi.x < 0.0f || hi.y < 0.0f || lo.x >= width || lo.y >= height)
+                continue;
+            triangles.push_back(tri);
+        }
+    }
+    stats.occluders++;
+}
+
+void SoftwareOcclusion::rasterize()
+{
+    auto start = std::chrono::steady_clock::now();
+    stats.occluderTriangles = static_cast<uint32_t>(triangles.size());
+
+    ParallelFor(tilesY, 1, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row)
+            rasterizeBand(static_cast<int>(row));
+    });
+
+    stats.rasterMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SoftwareOcclusion::rasterizeBand(int tileRow)
+{
+    int bandY0 = tileRow * TileSize;
+    int bandY1 = bandY0 + TileSize;
+    std::fill(depth.begin() + static_cast<size_t>(bandY0) * width, depth.begin() + static_cast<size_t>(bandY1) * width, 1.0f);
+
+    for (const ScreenTriangle& input : triangles) {
+        glm::vec3 v0 = input.v[0], v1 = input.v[1], v2 = input.v[2];
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (std::fabs(area) < 1e-8f)
+            continue;
+        if (area < 0.0f) {
+            std::swap(v1, v2);
+            area = -area;
+        }
+
+        int minY = std::max(bandY0, static_cast<int>(std::floor(std::min(v0.y, std::min(v1.y, v2.y)))));
+        int maxY = std::min(bandY1 - 1, static_cast<int>(std::ceil(std::max(v0.y, std::max(v1.y, v2.y)))));
+        if (minY > maxY)
+            continue;
+        int minX = std::max(0, static_cast<int>(std::floor(std::min(v0.x, std::min(v1.x, v2.x)))));
+        int maxX = std::min(width - 1, static_cast<int>(std::ceil(std::max(v0.x, std::max(v1.x, v2.x)))));
+        if (minX > maxX)
+            continue;
+        minX &= ~3;
+
+        // Edge i is a * x + b * y + c, positive inside for the counter-clockwise order above.
+        const glm::vec3* verts[3] = { &v0, &v1, &v2 };
+        float ea[3], eb[3], ec[3];
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec3& a = *verts[i];
+            const glm::vec3& b = *verts[(i + 1) % 3];
+            ea[i] = -(b.y - a.y);
+            eb[i] = b.x - a.x;
+            ec[i] = (b.y - a.y) * a.x - (b.x - a.x) * a.y;
+        }
+
+        glm::vec3 d1 = v1 - v0, d2 = v2 - v0;
+        float dzdx = (d1.z * d2.y - d2.z * d1.y) / area;
+        float dzdy = (d2.z * d1.x - d1.z * d2.x) / area;
+        float zc = v0.z - dzdx * v0.x - dzdy * v0.y;
+
+        for (int y = minY; y <= maxY; ++y) {
+            float py = y + 0.5f;
+            float* row = &depth[static_cast<size_t>(y) * width];
+#ifdef STRAING_SSE
+            const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            const __m128 zero = _mm_setzero_ps();
+            __m128 rowE[3], stepE[3];
+            for (int i = 0; i < 3; ++i) {
+                rowE[i] = _mm_add_ps(_mm_set1_ps(eb[i] * py + ec[i]),
+                                     _mm_mul_ps(_mm_set1_ps(ea[i]), _mm_add_ps(_mm_set1_ps(static_cast<float>(minX)), offsets)));
+                stepE[i] = _mm_set1_ps(ea[i] * 4.0f);
+            }
+            __m128 z = _mm_add_ps(_mm_set1_ps(zc + dzdy * py),
+                                  _mm_mul_ps(_mm_set1_ps(dzdx), _mm_add_ps(_mm_set1_ps(static_cast<float>(minX)), offsets)));
+            __m128 stepZ = _mm_set1_ps(dzdx * 4.0f);
+
+            for (int x = minX; x <= maxX; x += 4) {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(rowE[0], zero), _mm_cmpge_ps(rowE[1], zero)),
+                                           _mm_cmpge_ps(rowE[2], zero));
+                if (_mm_movemask_ps(inside)) {
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+                for (int i = 0; i < 3; ++i)
+                    rowE[i] = _mm_add_ps(rowE[i], stepE[i]);
+                z = _mm_add_ps(z, stepZ);
+            }
+#else
+            for (int x = minX; x <= maxX; ++x) {
+                float px = x + 0.5f;
+                bool inside = true;
+                for (int i = 0; i < 3; ++i)
+                    inside &= ea[i] * px + eb[i] * py + ec[i] >= 0.0f;
+                if (inside)
+                    row[x] = std::min(row[x], zc + dzdx * px + dzdy * py);
+            }
+#endif
+        }
+    }
+
+    for (int tx = 0; tx < tilesX; ++tx) {
+        float farthest = 0.0f;
+        for (int y = bandY0; y < bandY1; ++y) {
+            const float* row = &depth[static_cast<size_t>(y) * width + tx * TileSize];
+            for (int x = 0; x < TileSize; ++x)
+                farthest = std::max(farthest, row[x]);
+        }
+        tileMaxDepth[static_cast<size_t>(tileRow) * tilesX + tx] = farthest;
+    }
+}
+
+bool SoftwareOcclusion::isVisible(const AABB& worldBounds) const
+{
+    glm::vec2 lo(FLT_MAX), hi(-FLT_MAX);
+    float nearest = FLT_MAX;
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 corner((i & 1) ? worldBounds.max.x : worldBounds.min.x,
+                         (i & 2) ? worldBounds.max.y : worldBounds.min.y,
+                         (i & 4) ? worldBounds.max.z : worldBounds.min.z);
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+        // Crossing the near plane: the box surrounds the camera, assume visible.
+        if (clip.w < NearW || clip.z < -clip.w)
+            return true;
+        float invW = 1.0f / clip.w;
+        glm::vec2 screen((clip.x * invW * 0.5f + 0.5f) * width, (clip.y * invW * 0.5f + 0.5f) * height);
+        lo = glm::min(lo, screen);
+        hi = glm::max(hi, screen);
+        nearest = std::min(nearest, clip.z * invW * 0.5f + 0.5f);
+    }
+
+    int x0 = std::max(0, static_cast<int>(std::floor(lo.x)));
+    int y0 = std::max(0, static_cast<int>(std::floor(lo.y)));
+    int x1 = std::min(width - 1, static_cast<int>(std::floor(hi.x)));
+    int y1 = std::min(height - 1, static_cast<int>(std::floor(hi.y)));
+    if (x0 > x1 || y0 > y1)
+        return true;
+
+    for (int ty = y0 / TileSize; ty <= y1 / TileSize; ++ty) {
+        for (int tx = x0 / TileSize; tx <= x1 / TileSize; ++tx) {
+            if (nearest > tileMaxDepth[static_cast<size_t>(ty) * tilesX + tx])
+                continue;
+
+            // The tile is not fully in front; check the covered pixels.
+            int px0 = std::max(x0, tx * TileSize), px1 = std::min(x1, tx * TileSize + TileSize - 1);
+            int py0 = std::max(y0, ty * TileSize), py1 = std::min(y1, ty * TileSize + TileSize - 1);
+            for (int y = py0; y <= py1; ++y) {
+                const float* row = &depth[static_cast<size_t>(y) * width];
+                for (int x = px0; x <= px1; ++x) {
+                    if (nearest <= row[x])
+                        return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void SoftwareOcclusion::filterVisible(const std::vector<SceneObject>& scene, std::vector<uint32_t>& visible)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<uint8_t> keep(visible.size());
+    ParallelFor(visible.size(), 64, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            keep[i] = isVisible(scene[visible[i]].worldBounds) ? 1 : 0;
+    });
+
+    size_t kept = 0;
+    for (size_t i = 0; i < visible.size(); ++i) {
+        if (keep[i])
+            visible[kept++] = visible[i];
+    }
+    stats.tested = static_cast<uint32_t>(visible.size());
+    stats.occluded = static_cast<uint32_t>(visible.size() - kept);
+    visible.resize(kept);
+
+    stats.testMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
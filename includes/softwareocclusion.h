@@ -0,0 +1,65 @@
+#pragma once
+
+#include "def.h"
+#include <cstdint>
+
+// A reduced copy of a mesh used only for occlusion. It is a subset of the
+// original triangles, so it can never hide something the mesh would not.
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+};
+
+OccluderMesh BuildOccluderMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                               size_t maxTriangles);
+// Builds the mesh's occluder on first use.
+const OccluderMesh& GetMeshOccluder(Mesh& mesh);
+
+struct SoftwareOcclusionStats {
+    uint32_t occluders;
+    uint32_t occluderTriangles;
+    uint32_t tested;
+    uint32_t occluded;
+    float rasterMs;
+    float testMs;
+};
+
+// Low resolution CPU depth buffer split into 8x8 tiles. Occluders are
+// rasterized four pixels at a time with SSE, one tile row per task, and
+// each tile keeps its farthest depth so most tests stop at the tile level.
+class SoftwareOcclusion {
+public:
+    static constexpr int TileSize = 8;
+
+    SoftwareOcclusion(int width = 256, int height = 128);
+
+    void beginFrame(const glm::mat4& viewProjection);
+    void addOccluder(const OccluderMesh& occluder, const glm::mat4& model);
+    void rasterize();
+
+    // Conservative: false only when every pixel the box could cover already
+    // holds something nearer.
+    bool isVisible(const AABB& worldBounds) const;
+    // Removes occluded objects from `visible`, testing in parallel.
+    void filterVisible(const std::vector<SceneObject>& scene, std::vector<uint32_t>& visible);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const std::vector<float>& getDepth() const { return depth; }
+    const SoftwareOcclusionStats& getStats() const { return stats; }
+
+private:
+    struct ScreenTriangle {
+        glm::vec3 v[3];   // pixel x, pixel y, depth in [0, 1]
+    };
+
+    void rasterizeBand(int tileRow);
+
+    int width, height;
+    int tilesX, tilesY;
+    glm::mat4 viewProjection;
+    std::vector<float> depth;
+    std::vector<float> tileMaxDepth;
+    std::vector<ScreenTriangle> triangles;
+    SoftwareOcclusionStats stats{};
+};
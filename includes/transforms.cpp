@@ -0,0 +1,269 @@
+#include "transforms.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define STRAING_SSE 1
+#endif
+
+namespace {
+
+// Objects per update task; a multiple of 4 so every task starts on an SSE lane boundary.
+const size_t TransformGrain = 256;
+
+// Columns of rotateX * rotateY * rotateZ.
+glm::mat3 EulerRotation(float sx, float cx, float sy, float cy, float sz, float cz)
+{
+    return glm::mat3(glm::vec3(cy * cz, cx * sz + sx * sy * cz, sx * sz - cx * sy * cz),
+                     glm::vec3(-cy * sz, cx * cz - sx * sy * sz, sx * cz + cx * sy * sz),
+                     glm::vec3(sy, -sx * cy, cx * cy));
+}
+
+float SafeReciprocal(float value)
+{
+    return value != 0.0f ? 1.0f / value : 0.0f;
+}
+
+glm::mat4 WorldFromRotation(const glm::mat3& rotation, const glm::vec3& position, const glm::vec3& scale)
+{
+    return glm::mat4(glm::vec4(rotation[0] * scale.x, 0.0f), glm::vec4(rotation[1] * scale.y, 0.0f),
+                     glm::vec4(rotation[2] * scale.z, 0.0f), glm::vec4(position, 1.0f));
+}
+
+#ifdef STRAING_SSE
+// Writes column `column` of `member` for four consecutive objects, one per lane.
+void StoreColumn(ObjectMatrices* out, glm::mat4 ObjectMatrices::*member, int column, __m128 x, __m128 y, __m128 z,
+                 __m128 w)
+{
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(glm::value_ptr(out[0].*member) + column * 4, x);
+    _mm_storeu_ps(glm::value_ptr(out[1].*member) + column * 4, y);
+    _mm_storeu_ps(glm::value_ptr(out[2].*member) + column * 4, z);
+    _mm_storeu_ps(glm::value_ptr(out[3].*member) + column * 4, w);
+}
+#endif
+
+}
+
+glm::mat4 ComposeTransform(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale)
+{
+    glm::mat3 euler = EulerRotation(std::sin(rotation.x), std::cos(rotation.x), std::sin(rotation.y),
+                                    std::cos(rotation.y), std::sin(rotation.z), std::cos(rotation.z));
+    return WorldFromRotation(euler, position, scale);
+}
+
+glm::mat3 AffineNormalMatrix(const glm::mat4& model)
+{
+    glm::vec3 c0(model[0]), c1(model[1]), c2(model[2]);
+    glm::mat3 cofactor(glm::cross(c1, c2), glm::cross(c2, c0), glm::cross(c0, c1));
+    float det = glm::dot(c0, cofactor[0]);
+    float inverseDet = SafeReciprocal(det);
+    return glm::mat3(cofactor[0] * inverseDet, cofactor[1] * inverseDet, cofactor[2] * inverseDet);
+}
+
+glm::mat4 AffineInverse(const glm::mat4& model)
+{
+    glm::mat3 inverse = glm::transpose(AffineNormalMatrix(model));
+    glm::vec3 translation = -(inverse * glm::vec3(model[3]));
+    return glm::mat4(glm::vec4(inverse[0], 0.0f), glm::vec4(inverse[1], 0.0f), glm::vec4(inverse[2], 0.0f),
+                     glm::vec4(translation, 1.0f));
+}
+
+void TransformSystem::resize(size_t newCount)
+{
+    count = newCount;
+    size_t padded = (newCount + 3) & ~size_t(3);
+    for (std::vector<float>* values : { &positionX, &positionY, &positionZ, &sinX, &sinY, &sinZ })
+        values->resize(padded, 0.0f);
+    for (std::vector<float>* values : { &cosX, &cosY, &cosZ, &scaleX, &scaleY, &scaleZ })
+        values->resize(padded, 1.0f);
+    matrices.resize(padded);
+}
+
+void TransformSystem::set(size_t index, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale)
+{
+    positionX[index] = position.x;
+    positionY[index] = position.y;
+    positionZ[index] = position.z;
+    sinX[index] = std::sin(rotation.x);
+    cosX[index] = std::cos(rotation.x);
+    sinY[index] = std::sin(rotation.y);
+    cosY[index] = std::cos(rotation.y);
+    sinZ[index] = std::sin(rotation.z);
+    cosZ[index] = std::cos(rotation.z);
+    scaleX[index] = scale.x;
+    scaleY[index] = scale.y;
+    scaleZ[index] = scale.z;
+}
+
+void TransformSystem::update(const glm::mat4& viewProjection)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    ParallelFor(matrices.size(), TransformGrain, [&](size_t begin, size_t end) {
+        size_t i = begin;
+#ifdef STRAING_SSE
+        if (simd) {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            __m128 vp[4][4];
+            for (int column = 0; column < 4; ++column) {
+                for (int row = 0; row < 4; ++row)
+                    vp[column][row] = _mm_set1_ps(viewProjection[column][row]);
+            }
+
+            for (; i < end; i += 4) {
+                __m128 sx = _mm_loadu_ps(&sinX[i]), cx = _mm_loadu_ps(&cosX[i]);
+                __m128 sy = _mm_loadu_ps(&sinY[i]), cy = _mm_loadu_ps(&cosY[i]);
+                __m128 sz = _mm_loadu_ps(&sinZ[i]), cz = _mm_loadu_ps(&cosZ[i]);
+                __m128 sxsy = _mm_mul_ps(sx, sy), cxsy = _mm_mul_ps(cx, sy);
+
+                // rotation[column][row], as in EulerRotation().
+                __m128 rotation[3][3] = {
+                    { _mm_mul_ps(cy, cz), _mm_add_ps(_mm_mul_ps(cx, sz), _mm_mul_ps(sxsy, cz)),
+                      _mm_sub_ps(_mm_mul_ps(sx, sz), _mm_mul_ps(cxsy, cz)) },
+                    { _mm_sub_ps(zero, _mm_mul_ps(cy, sz)), _mm_sub_ps(_mm_mul_ps(cx, cz), _mm_mul_ps(sxsy, sz)),
+                      _mm_add_ps(_mm_mul_ps(sx, cz), _mm_mul_ps(cxsy, sz)) },
+                    { sy, _mm_sub_ps(zero, _mm_mul_ps(sx, cy)), _mm_mul_ps(cx, cy) },
+                };
+                __m128 scale[3] = { _mm_loadu_ps(&scaleX[i]), _mm_loadu_ps(&scaleY[i]), _mm_loadu_ps(&scaleZ[i]) };
+
+                __m128 world[4][3], normal[3][3];
+                for (int column = 0; column < 3; ++column) {
+                    // A zero scale gets a zero column rather than infinities.
+                    __m128 inverseScale = _mm_and_ps(_mm_cmpneq_ps(scale[column], zero), _mm_div_ps(one, scale[column]));
+                    for (int row = 0; row < 3; ++row) {
+                        world[column][row] = _mm_mul_ps(rotation[column][row], scale[column]);
+                        normal[column][row] = _mm_mul_ps(rotation[column][row], inverseScale);
+                    }
+                }
+                world[3][0] = _mm_loadu_ps(&positionX[i]);
+                world[3][1] = _mm_loadu_ps(&positionY[i]);
+                world[3][2] = _mm_loadu_ps(&positionZ[i]);
+
+                // The world matrix's last row is (0, 0, 0, 1), so each MVP
+                // element is three products, plus the view-projection's
+                // translation in the last column.
+                __m128 mvp[4][4];
+                for (int column = 0; column < 4; ++column) {
+                    for (int row = 0; row < 4; ++row) {
+                        __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vp[0][row], world[column][0]),
+                                                             _mm_mul_ps(vp[1][row], world[column][1])),
+                                                  _mm_mul_ps(vp[2][row], world[column][2]));
+                        mvp[column][row] = column == 3 ? _mm_add_ps(value, vp[3][row]) : value;
+                    }
+                }
+
+                ObjectMatrices* out = &matrices[i];
+                for (int column = 0; column < 4; ++column) {
+                    __m128 w = column == 3 ? one : zero;
+                    StoreColumn(out, &ObjectMatrices::world, column, world[column][0], world[column][1],
+                                world[column][2], w);
+                    StoreColumn(out, &ObjectMatrices::mvp, column, mvp[column][0], mvp[column][1], mvp[column][2],
+                                mvp[column][3]);
+                    if (column < 3)
+                        StoreColumn(out, &ObjectMatrices::normal, column, normal[column][0], normal[column][1],
+                                    normal[column][2], zero);
+                    else
+                        StoreColumn(out, &ObjectMatrices::normal, column, zero, zero, zero, one);
+                }
+            }
+        }
+#endif
+        for (; i < end; ++i) {
+            glm::mat3 rotation = EulerRotation(sinX[i], cosX[i], sinY[i], cosY[i], sinZ[i], cosZ[i]);
+            glm::vec3 scale(scaleX[i], scaleY[i], scaleZ[i]);
+            ObjectMatrices& out = matrices[i];
+            out.world = WorldFromRotation(rotation, glm::vec3(positionX[i], positionY[i], positionZ[i]), scale);
+            out.mvp = viewProjection * out.world;
+            out.normal = glm::mat4(glm::vec4(rotation[0] * SafeReciprocal(scale.x), 0.0f),
+                                   glm::vec4(rotation[1] * SafeReciprocal(scale.y), 0.0f),
+                                   glm::vec4(rotation[2] * SafeReciprocal(scale.z), 0.0f),
+                                   glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        }
+    });
+
+    stats.objects = static_cast<uint32_t>(count);
+    stats.updateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string BenchmarkTransforms(size_t objectCount)
+{
+    using Clock = std::chrono::steady_clock;
+    const int Runs = 10;
+    std::ostringstream report;
+    report.setf(std::ios::fixed);
+    report.precision(3);
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f), angle(-3.14159f, 3.14159f), scale(0.25f, 4.0f);
+    std::vector<glm::vec3> positions(objectCount), rotations(objectCount), scales(objectCount);
+    for (size_t i = 0; i < objectCount; ++i) {
+        positions[i] = glm::vec3(position(random), position(random), position(random));
+        rotations[i] = glm::vec3(angle(random), angle(random), angle(random));
+        scales[i] = glm::vec3(scale(random), scale(random), scale(random));
+    }
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 2.0f, 0.1f, 100.0f) *
+                               glm::lookAt(glm::vec3(0.0f, 10.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // What every draw used to do.
+    std::vector<ObjectMatrices> reference(objectCount);
+    auto t0 = Clock::now();
+    for (int run = 0; run < Runs; ++run) {
+        for (size_t i = 0; i < objectCount; ++i) {
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+            model = glm::rotate(model, rotations[i].x, glm::vec3(1.0f, 0.0f, 0.0f));
+            model = glm::rotate(model, rotations[i].y, glm::vec3(0.0f, 1.0f, 0.0f));
+            model = glm::rotate(model, rotations[i].z, glm::vec3(0.0f, 0.0f, 1.0f));
+            model = glm::scale(model, scales[i]);
+            reference[i].world = model;
+            reference[i].mvp = viewProjection * model;
+            reference[i].normal = glm::mat4(glm::transpose(glm::inverse(glm::mat3(model))));
+        }
+    }
+    auto t1 = Clock::now();
+
+    TransformSystem transforms;
+    transforms.resize(objectCount);
+    for (size_t i = 0; i < objectCount; ++i)
+        transforms.set(i, positions[i], rotations[i], scales[i]);
+    auto t2 = Clock::now();
+
+    float updateMs[2] = {};
+    for (int simd = 0; simd < 2; ++simd) {
+        transforms.setSIMD(simd != 0);
+        for (int run = 0; run < Runs; ++run) {
+            transforms.update(viewProjection);
+            updateMs[simd] += transforms.getStats().updateMs / Runs;
+        }
+    }
+
+    float maxError = 0.0f;
+    for (size_t i = 0; i < objectCount; ++i) {
+        const ObjectMatrices& a = reference[i];
+        const ObjectMatrices& b = transforms.get(i);
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                float world = std::abs(a.world[column][row] - b.world[column][row]);
+                float normal = std::abs(a.normal[column][row] - b.normal[column][row]);
+                maxError = std::max(maxError, std::max(world, normal));
+            }
+        }
+    }
+
+    auto ms = [](Clock::duration d) { return std::chrono::duration<float, std::milli>(d).count(); };
+    report << "Transforms, " << objectCount << " objects on " << ParallelThreadCount() << " threads:\n"
+           << "  glm per draw (3 rotations + inverse): " << ms(t1 - t0) / Runs << " ms\n"
+           << "  system, one object at a time: " << updateMs[0] << " ms\n"
+           << "  system, SSE: " << updateMs[1] << " ms\n"
+           << "  set() with sin/cos: " << ms(t2 - t1) << " ms, max difference from glm " << maxError << "\n";
+    return report.str();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "def.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Everything a draw needs from an object's transform. The normal matrix is
+// the inverse transpose of the upper 3x3, padded to a mat4 so arrays of
+// these go to std430 buffers as they are.
+struct ObjectMatrices {
+    glm::mat4 world;
+    glm::mat4 mvp;
+    glm::mat4 normal;
+};
+
+// translate * rotateX * rotateY * rotateZ * scale, in closed form from one
+// sine and cosine per axis.
+glm::mat4 ComposeTransform(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale);
+// Inverse transpose of the upper 3x3 through its cofactors. Only the 3x3
+// part is inverted, which is all an affine matrix needs.
+glm::mat3 AffineNormalMatrix(const glm::mat4& model);
+// The 3x3 part inverted as above and the translation carried back through it.
+glm::mat4 AffineInverse(const glm::mat4& model);
+
+struct TransformStats {
+    uint32_t objects;
+    float updateMs;
+};
+
+// Translation, rotation and scale of every scene object, stored as
+// structure of arrays with the rotation kept as sines and cosines. update()
+// turns them into world, MVP and normal matrices for four objects per SSE
+// instruction, spread over the ParallelFor pool. A rotation times a scale
+// needs no general inverse: its inverse transpose is the same rotation
+// with each column divided by its scale.
+class TransformSystem {
+public:
+    // New objects start at the identity.
+    void resize(size_t count);
+    size_t size() const { return count; }
+    void set(size_t index, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale);
+
+    // Recomputes every object's matrices for this camera.
+    void update(const glm::mat4& viewProjection);
+    const ObjectMatrices& get(size_t index) const { return matrices[index]; }
+
+    // Computes one object at a time instead, for comparison.
+    void setSIMD(bool enabled) { simd = enabled; }
+    const TransformStats& getStats() const { return stats; }
+
+private:
+    size_t count = 0;
+    // Padded to a multiple of 4, so every SIMD group is full.
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> sinX, cosX, sinY, cosY, sinZ, cosZ;
+    std::vector<float> scaleX, scaleY, scaleZ;
+    std::vector<ObjectMatrices> matrices;
+    bool simd = true;
+    TransformStats stats{};
+};
+
+// Times the per-draw glm path (three rotations and a general inverse)
+// against TransformSystem on random transforms.
+std::string BenchmarkTransforms(size_t objectCount);
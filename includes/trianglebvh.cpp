@@ -0,0 +1,690 @@
+#include "trianglebvh.h"
+#include "meshresidency.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <memory>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define STRAING_SSE 1
+#endif
+
+namespace {
+
+const int BinCount = 16;
+const uint32_t MaxLeafSize = 8;
+const size_t ParallelBinThreshold = 1 << 16;
+const int MaxStackDepth = 96;
+// Past this depth nodes are split at the object median, which bounds the traversal stack.
+const int MedianSplitDepth = 48;
+
+struct Bounds {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+    void grow(const Bounds& b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+    float area() const
+    {
+        if (min.x > max.x)
+            return 0.0f;
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+};
+
+struct Bin {
+    Bounds bounds;
+    uint32_t count = 0;
+};
+
+struct Split {
+    int axis = -1;
+    int bin = 0;
+    float cost = FLT_MAX;
+};
+
+glm::vec3 SafeInverse(const glm::vec3& d)
+{
+    auto inv = [](float x) { return 1.0f / (std::fabs(x) > 1e-20f ? x : std::copysign(1e-20f, x)); };
+    return glm::vec3(inv(d.x), inv(d.y), inv(d.z));
+}
+
+}
+
+// Holds the per-triangle build data; the top of the tree is split with
+// parallel binning, everything below the subtree threshold is built by
+// independent tasks and spliced in afterwards.
+class TriangleBVHBuilder {
+public:
+    TriangleBVHBuilder(TriangleBVH& bvh, const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+        : bvh(bvh), positions(positions), indices(indices) {}
+
+    void run()
+    {
+        size_t triangleCount = indices.size() / 3;
+        triBounds.resize(triangleCount);
+        centroids.resize(triangleCount);
+        primIds.resize(triangleCount);
+
+        ParallelFor(triangleCount, 4096, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                Bounds b;
+                for (int k = 0; k < 3; ++k)
+                    b.grow(positions[indices[i * 3 + k]]);
+                triBounds[i] = b;
+                centroids[i] = (b.min + b.max) * 0.5f;
+                primIds[i] = static_cast<uint32_t>(i);
+            }
+        });
+
+        subtreeThreshold = std::max<size_t>(triangleCount / (ParallelThreadCount() * 8), 4096);
+
+        topNodes.push_back({});
+        buildTop(0, 0, static_cast<uint32_t>(triangleCount), 0);
+
+        ParallelFor(tasks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                TopNode& top = topNodes[tasks[t]];
+                buildSubtree(top.subtree, top.begin, top.end, top.depth);
+            }
+        });
+
+        bvh.nodes.clear();
+        bvh.nodes.reserve(countNodes(0));
+        flatten(0);
+
+        bvh.triangles.resize(triangleCount);
+        bvh.triangleIds = primIds;
+        ParallelFor(triangleCount, 4096, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t tri = primIds[i];
+                glm::vec3 v0 = positions[indices[tri * 3 + 0]];
+                glm::vec3 v1 = positions[indices[tri * 3 + 1]];
+                glm::vec3 v2 = positions[indices[tri * 3 + 2]];
+                bvh.triangles[i] = { v0, v1 - v0, v2 - v0 };
+            }
+        });
+    }
+
+private:
+    struct TopNode {
+        Bounds bounds;
+        uint32_t begin = 0, end = 0;
+        int32_t left = -1, right = -1;
+        int axis = 0;
+        int depth = 0;
+        bool isTask = false;
+        std::vector<TriangleBVHNode> subtree;
+    };
+
+    void rangeBounds(uint32_t begin, uint32_t end, bool parallel, Bounds& bounds, Bounds& centroidBounds) const
+    {
+        if (!parallel) {
+            for (uint32_t i = begin; i < end; ++i) {
+                bounds.grow(triBounds[primIds[i]]);
+                centroidBounds.grow(centroids[primIds[i]]);
+            }
+            return;
+        }
+
+        size_t grain = 16384;
+        size_t chunks = (end - begin + grain - 1) / grain;
+        std::vector<Bounds> partial(chunks), partialCentroid(chunks);
+        ParallelFor(end - begin, grain, [&](size_t b, size_t e) {
+            size_t chunk = b / grain;
+            for (size_t i = begin + b; i < begin + e; ++i) {
+                partial[chunk].grow(triBounds[primIds[i]]);
+                partialCentroid[chunk].grow(centroids[primIds[i]]);
+            }
+        });
+        for (size_t c = 0; c < chunks; ++c) {
+            bounds.grow(partial[c]);
+            centroidBounds.grow(partialCentroid[c]);
+        }
+    }
+
+    Split findSplit(uint32_t begin, uint32_t end, const Bounds& centroidBounds, bool parallel) const
+    {
+        Split best;
+        glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            if (extent[axis] <= 1e-12f)
+                continue;
+            float scale = BinCount / extent[axis];
+            float axisMin = centroidBounds.min[axis];
+
+            auto binRange = [&](uint32_t b, uint32_t e, Bin* bins) {
+                for (uint32_t i = b; i < e; ++i) {
+                    uint32_t prim = primIds[i];
+                    int bin = std::min(BinCount - 1, static_cast<int>((centroids[prim][axis] - axisMin) * scale));
+                    bins[bin].count++;
+                    bins[bin].bounds.grow(triBounds[prim]);
+                }
+            };
+
+            Bin bins[BinCount];
+            if (parallel) {
+                size_t grain = 16384;
+                size_t chunks = (end - begin + grain - 1) / grain;
+                std::vector<Bin> partial(chunks * BinCount);
+                ParallelFor(end - begin, grain, [&](size_t b, size_t e) {
+                    binRange(begin + static_cast<uint32_t>(b), begin + static_cast<uint32_t>(e), &partial[(b / grain) * BinCount]);
+                });
+                for (size_t c = 0; c < chunks; ++c) {
+                    for (int k = 0; k < BinCount; ++k) {
+                        bins[k].count += partial[c * BinCount + k].count;
+                        bins[k].bounds.grow(partial[c * BinCount + k].bounds);
+                    }
+                }
+            } else {
+                binRange(begin, end, bins);
+            }
+
+            // Sweep from both sides to evaluate every plane between bins.
+            float leftArea[BinCount - 1], rightArea[BinCount - 1];
+            uint32_t leftCount[BinCount - 1], rightCount[BinCount - 1];
+            Bounds left, right;
+            uint32_t leftSum = 0, rightSum = 0;
+            for (int i = 0; i < BinCount - 1; ++i) {
+                leftSum += bins[i].count;
+                left.grow(bins[i].bounds);
+                leftCount[i] = leftSum;
+                leftArea[i] = left.area();
+
+                rightSum += bins[BinCount - 1 - i].count;
+                right.grow(bins[BinCount - 1 - i].bounds);
+                rightCount[BinCount - 2 - i] = rightSum;
+                rightArea[BinCount - 2 - i] = right.area();
+            }
+            for (int i = 0; i < BinCount - 1; ++i) {
+                if (leftCount[i] == 0 || rightCount[i] == 0)
+                    continue;
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < best.cost) {
+                    best.axis = axis;
+                    best.bin = i;
+                    best.cost = cost;
+                }
+            }
+        }
+        return best;
+    }
+
+    // Partitions the range for the node and returns the first index of the second child,
+    // or `begin` when the node should stay a leaf.
+    uint32_t partition(uint32_t begin, uint32_t end, const Bounds& bounds, const Bounds& centroidBounds, bool parallel, int depth, int& axisOut)
+    {
+        uint32_t count = end - begin;
+        if (count <= 2)
+            return begin;
+
+        Split split;
+        if (depth < MedianSplitDepth)
+            split = findSplit(begin, end, centroidBounds, parallel);
+        float leafCost = count * bounds.area();
+
+        if (split.axis >= 0 && (split.cost < leafCost || count > MaxLeafSize)) {
+            int axis = split.axis;
+            float scale = BinCount / (centroidBounds.max[axis] - centroidBounds.min[axis]);
+            float axisMin = centroidBounds.min[axis];
+            uint32_t* middle = std::partition(&primIds[begin], &primIds[begin] + count, [&](uint32_t prim) {
+                int bin = std::min(BinCount - 1, static_cast<int>((centroids[prim][axis] - axisMin) * scale));
+                return bin <= split.bin;
+            });
+            axisOut = axis;
+            return static_cast<uint32_t>(middle - &primIds[0]);
+        }
+
+        if (count <= MaxLeafSize)
+            return begin;
+
+        // No usable SAH split (coincident centroids or too deep): split at the object median.
+        glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        uint32_t middle = begin + count / 2;
+        std::nth_element(&primIds[begin], &primIds[middle], &primIds[begin] + count, [&](uint32_t a, uint32_t b) {
+            return centroids[a][axis] < centroids[b][axis];
+        });
+        axisOut = axis;
+        return middle;
+    }
+
+    void buildTop(int32_t index, uint32_t begin, uint32_t end, int depth)
+    {
+        Bounds bounds, centroidBounds;
+        bool parallel = (end - begin) >= ParallelBinThreshold;
+        rangeBounds(begin, end, parallel, bounds, centroidBounds);
+        topNodes[index].bounds = bounds;
+        topNodes[index].begin = begin;
+        topNodes[index].end = end;
+        topNodes[index].depth = depth;
+
+        if (end - begin <= subtreeThreshold) {
+            topNodes[index].isTask = true;
+            tasks.push_back(index);
+            return;
+        }
+
+        int axis = 0;
+        uint32_t middle = partition(begin, end, bounds, centroidBounds, parallel, depth, axis);
+        if (middle == begin) {
+            topNodes[index].isTask = true;
+            tasks.push_back(index);
+            return;
+        }
+
+        int32_t left = static_cast<int32_t>(topNodes.size());
+        topNodes.push_back({});
+        int32_t right = static_cast<int32_t>(topNodes.size());
+        topNodes.push_back({});
+        topNodes[index].left = left;
+        topNodes[index].right = right;
+        topNodes[index].axis = axis;
+        buildTop(left, begin, middle, depth + 1);
+        buildTop(right, middle, end, depth + 1);
+    }
+
+    void buildSubtree(std::vector<TriangleBVHNode>& out, uint32_t begin, uint32_t end, int depth)
+    {
+        Bounds nodeBounds, centroidBounds;
+        rangeBounds(begin, end, false, nodeBounds, centroidBounds);
+
+        size_t index = out.size();
+        out.push_back({});
+        out[index].boundsMin = nodeBounds.min;
+        out[index].boundsMax = nodeBounds.max;
+
+        int axis = 0;
+        uint32_t middle = partition(begin, end, nodeBounds, centroidBounds, false, depth, axis);
+        if (middle == begin) {
+            out[index].offset = begin;
+            out[index].count = static_cast<uint16_t>(end - begin);
+            out[index].axis = 0;
+            return;
+        }
+
+        out[index].count = 0;
+        out[index].axis = static_cast<uint16_t>(axis);
+        buildSubtree(out, begin, middle, depth + 1);
+        out[index].offset = static_cast<uint32_t>(out.size());
+        buildSubtree(out, middle, end, depth + 1);
+    }
+
+    size_t countNodes(int32_t index) const
+    {
+        const TopNode& top = topNodes[index];
+        if (top.isTask)
+            return top.subtree.size();
+        return 1 + countNodes(top.left) + countNodes(top.right);
+    }
+
+    void flatten(int32_t index)
+    {
+        TopNode& top = topNodes[index];
+        if (top.isTask) {
+            uint32_t base = static_cast<uint32_t>(bvh.nodes.size());
+            for (TriangleBVHNode node : top.subtree) {
+                if (node.count == 0)
+                    node.offset += base;
+                bvh.nodes.push_back(node);
+            }
+            return;
+        }
+
+        size_t self = bvh.nodes.size();
+        bvh.nodes.push_back({});
+        bvh.nodes[self].boundsMin = top.bounds.min;
+        bvh.nodes[self].boundsMax = top.bounds.max;
+        bvh.nodes[self].count = 0;
+        bvh.nodes[self].axis = static_cast<uint16_t>(top.axis);
+        flatten(top.left);
+        bvh.nodes[self].offset = static_cast<uint32_t>(bvh.nodes.size());
+        flatten(top.right);
+    }
+
+    TriangleBVH& bvh;
+    const std::vector<glm::vec3>& positions;
+    const std::vector<unsigned int>& indices;
+
+    std::vector<Bounds> triBounds;
+    std::vector<glm::vec3> centroids;
+    std::vector<uint32_t> primIds;
+    std::vector<TopNode> topNodes;
+    std::vector<int32_t> tasks;
+    size_t subtreeThreshold = 0;
+};
+
+void TriangleBVH::build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        positions[i] = vertices[i].Position;
+    build(positions, indices);
+}
+
+void TriangleBVH::build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+{
+    nodes.clear();
+    triangles.clear();
+    triangleIds.clear();
+    if (indices.size() < 3)
+        return;
+
+    TriangleBVHBuilder builder(*this, positions, indices);
+    builder.run();
+}
+
+AABB TriangleBVH::getBounds() const
+{
+    if (nodes.empty())
+        return { glm::vec3(0.0f), glm::vec3(0.0f) };
+    return { nodes[0].boundsMin, nodes[0].boundsMax };
+}
+
+bool TriangleBVH::intersectClosest(const Ray& ray, RayHit& hit) const
+{
+    hit.t = ray.tMax;
+    hit.triangle = RayHit::NoHit;
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 invDir = SafeInverse(ray.direction);
+    uint32_t stack[MaxStackDepth];
+    int stackSize = 0;
+    uint32_t index = 0;
+
+    for (;;) {
+        const TriangleBVHNode& node = nodes[index];
+        glm::vec3 t0 = (node.boundsMin - ray.origin) * invDir;
+        glm::vec3 t1 = (node.boundsMax - ray.origin) * invDir;
+        glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+        float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, ray.tMin));
+        float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, hit.t));
+
+        if (enter <= exit) {
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                    // Moller-Trumbore.
+                    const BuildTriangle& tri = triangles[i];
+                    glm::vec3 p = glm::cross(ray.direction, tri.e2);
+                    float det = glm::dot(tri.e1, p);
+                    if (std::fabs(det) < 1e-12f)
+                        continue;
+                    float invDet = 1.0f / det;
+                    glm::vec3 s = ray.origin - tri.v0;
+                    float u = glm::dot(s, p) * invDet;
+                    if (u < 0.0f || u > 1.0f)
+                        continue;
+                    glm::vec3 q = glm::cross(s, tri.e1);
+                    float v = glm::dot(ray.direction, q) * invDet;
+                    if (v < 0.0f || u + v > 1.0f)
+                        continue;
+                    float t = glm::dot(tri.e2, q) * invDet;
+                    if (t > ray.tMin && t < hit.t) {
+                        hit.t = t;
+                        hit.u = u;
+                        hit.v = v;
+                        hit.triangle = triangleIds[i];
+                    }
+                }
+            } else {
+                uint32_t first = index + 1, second = node.offset;
+                if (ray.direction[node.axis] < 0.0f)
+                    std::swap(first, second);
+                stack[stackSize++] = second;
+                index = first;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        index = stack[--stackSize];
+    }
+    return hit.triangle != RayHit::NoHit;
+}
+
+bool TriangleBVH::intersectAny(const Ray& ray) const
+{
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 invDir = SafeInverse(ray.direction);
+    uint32_t stack[MaxStackDepth];
+    int stackSize = 0;
+    uint32_t index = 0;
+
+    for (;;) {
+        const TriangleBVHNode& node = nodes[index];
+        glm::vec3 t0 = (node.boundsMin - ray.origin) * invDir;
+        glm::vec3 t1 = (node.boundsMax - ray.origin) * invDir;
+        glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+        float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, ray.tMin));
+        float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, ray.tMax));
+
+        if (enter <= exit) {
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                    const BuildTriangle& tri = triangles[i];
+                    glm::vec3 p = glm::cross(ray.direction, tri.e2);
+                    float det = glm::dot(tri.e1, p);
+                    if (std::fabs(det) < 1e-12f)
+                        continue;
+                    float invDet = 1.0f / det;
+                    glm::vec3 s = ray.origin - tri.v0;
+                    float u = glm::dot(s, p) * invDet;
+                    if (u < 0.0f || u > 1.0f)
+                        continue;
+                    glm::vec3 q = glm::cross(s, tri.e1);
+                    float v = glm::dot(ray.direction, q) * invDet;
+                    if (v < 0.0f || u + v > 1.0f)
+                        continue;
+                    float t = glm::dot(tri.e2, q) * invDet;
+                    if (t > ray.tMin && t < ray.tMax)
+                        return true;
+                }
+            } else {
+                stack[stackSize++] = node.offset;
+                index = index + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        index = stack[--stackSize];
+    }
+    return false;
+}
+
+void TriangleBVH::intersectClosest(const Ray* rays, RayHit* hits, size_t count) const
+{
+    size_t packets = (count + 3) / 4;
+    ParallelFor(packets, 16, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p) {
+            size_t first = p * 4;
+            intersectPacket(rays + first, hits + first, std::min<size_t>(4, count - first), false);
+        }
+    });
+}
+
+void TriangleBVH::intersectAny(const Ray* rays, uint8_t* occluded, size_t count) const
+{
+    size_t packets = (count + 3) / 4;
+    ParallelFor(packets, 16, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p) {
+            size_t first = p * 4;
+            size_t lanes = std::min<size_t>(4, count - first);
+            RayHit hits[4];
+            intersectPacket(rays + first, hits, lanes, true);
+            for (size_t i = 0; i < lanes; ++i)
+                occluded[first + i] = hits[i].triangle != RayHit::NoHit ? 1 : 0;
+        }
+    });
+}
+
+void TriangleBVH::intersectPacket(const Ray* rays, RayHit* hits, size_t count, bool anyHit) const
+{
+    for (size_t i = 0; i < count; ++i) {
+        hits[i].t = rays[i].tMax;
+        hits[i].triangle = RayHit::NoHit;
+        hits[i].u = hits[i].v = 0.0f;
+    }
+    if (nodes.empty())
+        return;
+
+#ifdef STRAING_SSE
+    alignas(16) float ox[4], oy[4], oz[4], dx[4], dy[4], dz[4], ix[4], iy[4], iz[4], tMin[4], tBest[4];
+    for (size_t i = 0; i < 4; ++i) {
+        const Ray& ray = rays[i < count ? i : 0];
+        glm::vec3 inv = SafeInverse(ray.direction);
+        ox[i] = ray.origin.x; oy[i] = ray.origin.y; oz[i] = ray.origin.z;
+        dx[i] = ray.direction.x; dy[i] = ray.direction.y; dz[i] = ray.direction.z;
+        ix[i] = inv.x; iy[i] = inv.y; iz[i] = inv.z;
+        tMin[i] = ray.tMin;
+        tBest[i] = ray.tMax;
+    }
+
+    const __m128 rox = _mm_load_ps(ox), roy = _mm_load_ps(oy), roz = _mm_load_ps(oz);
+    const __m128 rdx = _mm_load_ps(dx), rdy = _mm_load_ps(dy), rdz = _mm_load_ps(dz);
+    const __m128 rix = _mm_load_ps(ix), riy = _mm_load_ps(iy), riz = _mm_load_ps(iz);
+    const __m128 rtMin = _mm_load_ps(tMin);
+    __m128 rt = _mm_load_ps(tBest);
+    __m128 ru = _mm_setzero_ps(), rv = _mm_setzero_ps();
+    __m128i rtri = _mm_set1_epi32(-1);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), eps = _mm_set1_ps(1e-12f);
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    int liveMask = (1 << count) - 1;
+
+    // Children are ordered by the packet's summed direction on the split axis.
+    glm::vec3 packetDir(0.0f);
+    for (size_t i = 0; i < count; ++i)
+        packetDir += rays[i].direction;
+
+    uint32_t stack[MaxStackDepth];
+    int stackSize = 0;
+    uint32_t index = 0;
+
+    for (;;) {
+        const TriangleBVHNode& node = nodes[index];
+        __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), rox), rix);
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), rox), rix);
+        __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), roy), riy);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), roy), riy);
+        __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), roz), riz);
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), roz), riz);
+        __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+                                  _mm_max_ps(_mm_min_ps(tz0, tz1), rtMin));
+        __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+                                 _mm_min_ps(_mm_max_ps(tz0, tz1), rt));
+        int hitMask = _mm_movemask_ps(_mm_cmple_ps(enter, exit)) & liveMask;
+
+        if (hitMask) {
+            if (node.count > 0) {
+                __m128 active = _mm_castsi128_ps(_mm_set_epi32(hitMask & 8 ? -1 : 0, hitMask & 4 ? -1 : 0,
+                                                               hitMask & 2 ? -1 : 0, hitMask & 1 ? -1 : 0));
+                for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                    const BuildTriangle& tri = triangles[i];
+                    __m128 e1x = _mm_set1_ps(tri.e1.x), e1y = _mm_set1_ps(tri.e1.y), e1z = _mm_set1_ps(tri.e1.z);
+                    __m128 e2x = _mm_set1_ps(tri.e2.x), e2y = _mm_set1_ps(tri.e2.y), e2z = _mm_set1_ps(tri.e2.z);
+
+                    // p = d x e2
+                    __m128 px = _mm_sub_ps(_mm_mul_ps(rdy, e2z), _mm_mul_ps(rdz, e2y));
+                    __m128 py = _mm_sub_ps(_mm_mul_ps(rdz, e2x), _mm_mul_ps(rdx, e2z));
+                    __m128 pz = _mm_sub_ps(_mm_mul_ps(rdx, e2y), _mm_mul_ps(rdy, e2x));
+                    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+                    __m128 invDet = _mm_div_ps(one, det);
+
+                    __m128 sx = _mm_sub_ps(rox, _mm_set1_ps(tri.v0.x));
+                    __m128 sy = _mm_sub_ps(roy, _mm_set1_ps(tri.v0.y));
+                    __m128 sz = _mm_sub_ps(roz, _mm_set1_ps(tri.v0.z));
+                    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+                    // q = s x e1
+                    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rdx, qx), _mm_mul_ps(rdy, qy)), _mm_mul_ps(rdz, qz)), invDet);
+                    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+                    __m128 hit = _mm_and_ps(active, _mm_cmpgt_ps(_mm_and_ps(det, signMask), eps));
+                    hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+                    hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+                    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                    hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, rtMin));
+                    hit = _mm_and_ps(hit, _mm_cmplt_ps(t, rt));
+                    if (_mm_movemask_ps(hit) == 0)
+                        continue;
+
+                    rt = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, rt));
+                    ru = _mm_or_ps(_mm_and_ps(hit, u), _mm_andnot_ps(hit, ru));
+                    rv = _mm_or_ps(_mm_and_ps(hit, v), _mm_andnot_ps(hit, rv));
+                    __m128i hitInt = _mm_castps_si128(hit);
+                    rtri = _mm_or_si128(_mm_and_si128(hitInt, _mm_set1_epi32(static_cast<int>(triangleIds[i]))),
+                                        _mm_andnot_si128(hitInt, rtri));
+
+                    if (anyHit) {
+                        // Occluded rays are finished; stop as soon as the whole packet is.
+                        liveMask &= ~_mm_movemask_ps(hit);
+                        active = _mm_andnot_ps(hit, active);
+                        if (liveMask == 0)
+                            break;
+                    }
+                }
+                if (anyHit && liveMask == 0)
+                    break;
+            } else {
+                uint32_t first = index + 1, second = node.offset;
+                if (packetDir[node.axis] < 0.0f)
+                    std::swap(first, second);
+                stack[stackSize++] = second;
+                index = first;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        index = stack[--stackSize];
+    }
+
+    alignas(16) float outT[4], outU[4], outV[4];
+    alignas(16) int32_t outTri[4];
+    _mm_store_ps(outT, rt);
+    _mm_store_ps(outU, ru);
+    _mm_store_ps(outV, rv);
+    _mm_store_si128(reinterpret_cast<__m128i*>(outTri), rtri);
+    for (size_t i = 0; i < count; ++i) {
+        hits[i].t = outT[i];
+        hits[i].u = outU[i];
+        hits[i].v = outV[i];
+        hits[i].triangle = static_cast<uint32_t>(outTri[i]);
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        if (anyHit) {
+            if (intersectAny(rays[i]))
+                hits[i].triangle = 0;
+        } else {
+            intersectClosest(rays[i], hits[i]);
+        }
+    }
+#endif
+}
+
+const TriangleBVH& GetMeshBVH(Mesh& mesh)
+{
+    if (!mesh.bvh) {
+        mesh.bvh = std::make_shared<TriangleBVH>();
+        VisitMeshPositions(mesh, [&](const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+            mesh.bvh->build(positions, indices);
+        });
+    }
+    return *mesh.bvh;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "def.h"
+#include <cstdint>
+
+// 32 bytes, two nodes per cache line. Nodes are stored depth first, so the
+// first child of an interior node always directly follows it.
+struct TriangleBVHNode {
+    glm::vec3 boundsMin;
+    uint32_t offset;   // leaf: first triangle, interior: index of the second child
+    glm::vec3 boundsMax;
+    uint16_t count;    // triangles in the leaf, 0 for interior nodes
+    uint16_t axis;     // split axis of interior nodes, used for front-to-back order
+};
+
+struct Ray {
+    glm::vec3 origin;
+    float tMin;
+    glm::vec3 direction;
+    float tMax;
+};
+
+struct RayHit {
+    float t;
+    float u, v;
+    uint32_t triangle;   // index into the mesh's triangle list, NoHit on a miss
+
+    static constexpr uint32_t NoHit = 0xFFFFFFFFu;
+};
+
+class TriangleBVH {
+public:
+    // Binned SAH build; large nodes are binned in parallel and the subtrees
+    // below them are built on separate threads.
+    void build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+    void build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+    bool intersectClosest(const Ray& ray, RayHit& hit) const;
+    bool intersectAny(const Ray& ray) const;
+
+    // Batched queries: rays are traversed in packets of four with SSE and the
+    // packets are spread across the worker pool. Coherent batches (camera
+    // rays, shadow rays to one light) traverse fastest.
+    void intersectClosest(const Ray* rays, RayHit* hits, size_t count) const;
+    void intersectAny(const Ray* rays, uint8_t* occluded, size_t count) const;
+
+    bool empty() const { return nodes.empty(); }
+    size_t getNodeCount() const { return nodes.size(); }
+    size_t getTriangleCount() const { return triangleIds.size(); }
+    AABB getBounds() const;
+
+private:
+    struct BuildTriangle {
+        glm::vec3 v0, e1, e2;
+    };
+
+    void intersectPacket(const Ray* rays, RayHit* hits, size_t count, bool anyHit) const;
+
+    std::vector<TriangleBVHNode> nodes;
+    std::vector<BuildTriangle> triangles;   // in leaf order, with precomputed edges
+    std::vector<uint32_t> triangleIds;      // leaf order -> original triangle index
+
+    friend class TriangleBVHBuilder;
+};
+
+// Builds the mesh's BVH on first use.
+const TriangleBVH& GetMeshBVH(Mesh& mesh);
@@ -22,7 +22,37 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <unordered_map>
 #include <filesystem>
-
+#include <cfloat>
+#include <future>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include "def.h"
+#include "culling.h"
+#include "scenebvh.h"
+#include "trianglebvh.h"
+#include "softwareocclusion.h"
+#include "occlusionquery.h"
+#include "meshlod.h"
+#include "meshlet.h"
+#include "meshoptimize.h"
+#include "glextra.h"
+#include "geometrypool.h"
+#include "indirect.h"
+#include "gpuculling.h"
+#include "meshresources.h"
+#include "meshresidency.h"
+#include "gputimer.h"
+#include "lights.h"
+#include "deferred.h"
+#include "clustered.h"
+#include "shadervariants.h"
+#include "shadows.h"
+#include "hotreload.h"
+#include "transforms.h"
+
+bool UploadTextureFile(GLuint textureID, const char* filepath);
 GLuint LoadTextureFromFile(const char* filepath);
 GLuint LoadGLTFTexture(cgltf_data* data, const char* basePath, int imageIndex);
 
@@ -41,86 +71,52 @@ glm::vec3 cameraTarget= glm::vec3(0.0f, 0.0f, 0.0f);
 glm::vec3 cameraUp    = glm::vec3(0.0f, 1.0f, 0.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
 
-struct Color {
-    float r;
-    float g;
-    float b;
-    float a;
-};
-
-struct Camera {
-    glm::mat4 view;
-    glm::mat4 projection;
-};
-
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-
-    bool operator==(const Vertex& other) const {
-        return Position == other.Position &&
-               Normal == other.Normal &&
-               TexCoords == other.TexCoords;
-    }
-};
-
-struct Texture {
-    unsigned int id;
-    std::string type;
-    std::string path;
-};
-
-class Mesh {
-public:
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
-    GLuint VAO, VBO, EBO;
-
-    Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<Texture>& textures)
-        : vertices(vertices), indices(indices), textures(textures)
-    {
-        setupMesh();
-    }
-
-    Mesh() : VAO(0), VBO(0), EBO(0) {}
-
-    void Draw(GLuint& shader, const glm::mat4& view, const glm::mat4& projection, glm::vec3 position, float rotationAngleX, float rotationAngleY, float rotationAngleZ, glm::vec3 scale);
-
-private:
-    void setupMesh();
-};
-
-namespace std {
-    template<> struct hash<Vertex> {
-        size_t operator()(const Vertex& v) const {
-            size_t h1 = hash<float>()(v.Position.x) ^ (hash<float>()(v.Position.y) << 1) ^ (hash<float>()(v.Position.z) << 2);
-            size_t h2 = hash<float>()(v.Normal.x) ^ (hash<float>()(v.Normal.y) << 1) ^ (hash<float>()(v.Normal.z) << 2);
-            size_t h3 = hash<float>()(v.TexCoords.x) ^ (hash<float>()(v.TexCoords.y) << 1);
-            return h1 ^ (h2 << 1) ^ (h3 << 2);
-        }
-    };
-}
-
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
 
-void Mesh::setupMesh()
+void Mesh::upload()
 {
-    glGenVertexArrays(1, &this->VAO);
-    glGenBuffers(1, &this->VBO);
-    glGenBuffers(1, &this->EBO);
+    vertexCount = static_cast<uint32_t>(vertices.size());
+    indexCount = static_cast<uint32_t>(indices.size());
+    VBO = GLBuffer::create();
+    EBO = GLBuffer::create();
   
-    glBindVertexArray(this->VAO);
     glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+
+    // Filled through the copy target, so no vertex array has to be bound yet.
+    glBindBuffer(GL_COPY_WRITE_BUFFER, this->EBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, (indices.size() + lodIndices.size()) * sizeof(unsigned int), 
+                 nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, indices.size() * sizeof(unsigned int), indices.data());
+    if (!lodIndices.empty()) {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(unsigned int),
+                        lodIndices.size() * sizeof(unsigned int), lodIndices.data());
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    positionVBO.reset();
+    if (positionStream) {
+        std::vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+            positions[i] = vertices[i].Position;
 
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        positionVBO = GLBuffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    bindVertexArrays();
+}  
 
+void Mesh::bindVertexArrays()
+{
+    VAO = GLVertexArray::create();
+    glBindVertexArray(this->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), 
-                 &indices[0], GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);   
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -129,8 +125,30 @@ void Mesh::setupMesh()
     glEnableVertexAttribArray(2);   
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
 
+    depthVAO.reset();
+    if (positionVBO) {
+        depthVAO = GLVertexArray::create();
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    }
     glBindVertexArray(0);
-}  
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::setBounds(const AABB& box)
+{
+    bounds = box;
+    sphere = SphereFromAABB(box);
+}
+
+void ReportMeshOptimization(const std::string& path, const MeshOptimizeStats& stats)
+{
+    std::cout << "Optimized " << path << (stats.cached ? " (cached)" : "") << ": ACMR " << stats.before.acmr << " -> "
+              << stats.after.acmr << ", ATVR " << stats.before.atvr << " -> " << stats.after.atvr << std::endl;
+}
 
 Mesh LoadMeshFromOBJ(const std::string& path)
 {
@@ -149,6 +167,7 @@ Mesh LoadMeshFromOBJ(const std::string& path)
     std::vector<unsigned int> indices;
 
     std::unordered_map<Vertex, unsigned int> uniqueVertices;
+    AABB bounds{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
 
     for (const auto& shape : shapes)
     {
@@ -184,6 +203,8 @@ Mesh LoadMeshFromOBJ(const std::string& path)
             if (uniqueVertices.count(vertex) == 0) {
                 uniqueVertices[vertex] = static_cast<unsigned int>(vertices.size());
                 vertices.push_back(vertex);
+                bounds.min = glm::min(bounds.min, vertex.Position);
+                bounds.max = glm::max(bounds.max, vertex.Position);
             }
             indices.push_back(uniqueVertices[vertex]);
         }
@@ -194,7 +215,11 @@ Mesh LoadMeshFromOBJ(const std::string& path)
     // This example assumes you'll load the texture separately as you are doing for skull.obj
     // If you need full .mtl parsing, that would be a more involved addition.
 
-    return Mesh(vertices, indices, textures);
+    ReportMeshOptimization(path, OptimizeMeshBuffers(vertices, indices));
+    Mesh mesh(std::move(vertices), std::move(indices), std::move(textures));
+    if (!mesh.vertices.empty())
+        mesh.setBounds(bounds);
+    return mesh;
 }
 
 Mesh LoadMeshFromGLTF(const std::string& path)
@@ -251,6 +276,14 @@ Mesh LoadMeshFromGLTF(const std::string& path)
     const float* normals = normAcc ? (const float*)((uint8_t*)normAcc->buffer_view->buffer->data + normAcc->buffer_view->offset + normAcc->offset) : nullptr;
     const float* uvs = uvAcc ? (const float*)((uint8_t*)uvAcc->buffer_view->buffer->data + uvAcc->buffer_view->offset + uvAcc->offset) : nullptr;
 
+    // glTF requires min/max on POSITION accessors, so the bounds come for free.
+    AABB bounds{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+    bool hasAccessorBounds = posAcc->has_min && posAcc->has_max;
+    if (hasAccessorBounds) {
+        bounds.min = glm::vec3(posAcc->min[0], posAcc->min[1], posAcc->min[2]);
+        bounds.max = glm::vec3(posAcc->max[0], posAcc->max[1], posAcc->max[2]);
+    }
+
     std::vector<Vertex> vertices;
     for (size_t i = 0; i < posAcc->count; ++i) {
         Vertex vertex{};
@@ -273,6 +306,10 @@ Mesh LoadMeshFromGLTF(const std::string& path)
         ) : glm::vec2(0.0f, 0.0f);
 
         vertices.push_back(vertex);
+        if (!hasAccessorBounds) {
+            bounds.min = glm::min(bounds.min, vertex.Position);
+            bounds.max = glm::max(bounds.max, vertex.Position);
+        }
     }
 
     std::vector<unsigned int> indices;
@@ -316,7 +353,7 @@ Mesh LoadMeshFromGLTF(const std::string& path)
                     GLuint textureID = LoadGLTFTexture(data, baseDir.c_str(), imageIndex);
                     if (textureID != 0) {
                         std::string texturePath = gltfImage->uri ? (baseDir + gltfImage->uri) : "embedded_texture";
-                        meshTextures.push_back({textureID, "diffuse", texturePath});
+                        meshTextures.push_back({ GLTexture(textureID), "diffuse", texturePath });
                         std::cout << "Loaded texture: " << texturePath << std::endl;
                     }
                 }
@@ -325,48 +362,81 @@ Mesh LoadMeshFromGLTF(const std::string& path)
     }
 
     cgltf_free(data);
-    return Mesh(vertices, indices, meshTextures);
+    ReportMeshOptimization(path, OptimizeMeshBuffers(vertices, indices));
+    Mesh mesh(std::move(vertices), std::move(indices), std::move(meshTextures));
+    if (!mesh.vertices.empty())
+        mesh.setBounds(bounds);
+    return mesh;
 }
 
 
 
-void Mesh::Draw(GLuint& shader, const glm::mat4& view, const glm::mat4& projection, glm::vec3 position, float rotationAngleX, float rotationAngleY, float rotationAngleZ, glm::vec3 scale)
+// uMVP, plus uModel and uNormalMatrix where the program has them, on the
+// program in use.
+void SetTransformUniforms(GLuint shader, const ObjectMatrices& matrices)
 {
-    glUseProgram(shader);
-
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, position);
-    model = glm::rotate(model, rotationAngleX, glm::vec3(1.0f, 0.0f, 0.0f));
-    model = glm::rotate(model, rotationAngleY, glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::rotate(model, rotationAngleZ, glm::vec3(0.0f, 0.0f, 1.0f));
-    model = glm::scale(model, scale);
-
-    glm::mat4 mvp = projection * view * model;
     GLint mvpLoc = glGetUniformLocation(shader, "uMVP");
-    glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
+    glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(matrices.mvp));
 
-    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    GLint modelLoc = glGetUniformLocation(shader, "uModel");
+    if (modelLoc != -1) {
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(matrices.world));
+    }
     GLint normalMatrixLoc = glGetUniformLocation(shader, "uNormalMatrix");
     if (normalMatrixLoc != -1) {
+        glm::mat3 normalMatrix(matrices.normal);
         glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
     }
+}
 
-    GLuint useTextureLoc = glGetUniformLocation(shader, "uUseTexture");
-    GLint colorLoc = glGetUniformLocation(shader, "uColor");
+void Mesh::Draw(GLuint shader, const glm::mat4& view, const glm::mat4& projection, glm::vec3 position, float rotationAngleX, float rotationAngleY, float rotationAngleZ, glm::vec3 scale, int lod)
+{
+    glm::mat4 model = ComposeTransform(position, glm::vec3(rotationAngleX, rotationAngleY, rotationAngleZ), scale);
 
+    GLsizei count = static_cast<GLsizei>(indexCount);
+    size_t offset = 0;
+    if (lod > 0 && lod < static_cast<int>(lods.size())) {
+        count = static_cast<GLsizei>(lods[lod].indexCount);
+        offset = lods[lod].indexOffset;
+    }
+    DrawIndexed(shader, view, projection, model, this->VAO, count, offset);
+}
+
+void Mesh::DrawIndexed(GLuint shader, const glm::mat4& view, const glm::mat4& projection, const glm::mat4& model,
+                       GLuint vertexArray, GLsizei indexCount, size_t indexOffset, GLint baseVertex)
+{
+    ObjectMatrices matrices{ model, projection * view * model, glm::mat4(AffineNormalMatrix(model)) };
+    DrawIndexed(shader, matrices, vertexArray, indexCount, indexOffset, baseVertex);
+}
+
+void Mesh::DrawDepth(GLuint shader, const glm::mat4& mvp, GLuint vertexArray, GLsizei indexCount, size_t indexOffset,
+                     GLint baseVertex)
+{
+    glUseProgram(shader);
+    glUniformMatrix4fv(glGetUniformLocation(shader, "uMVP"), 1, GL_FALSE, glm::value_ptr(mvp));
+    glBindVertexArray(vertexArray);
+    glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)(indexOffset * sizeof(unsigned int)), baseVertex);
+    glBindVertexArray(0);
+}
+
+void Mesh::DrawIndexed(GLuint shader, const ObjectMatrices& matrices, GLuint vertexArray, GLsizei indexCount,
+                       size_t indexOffset, GLint baseVertex)
+{
+    glUseProgram(shader);
+    SetTransformUniforms(shader, matrices);
+
+    // The program is expected to be the variant for MeshShaderFeatures(*this).
     if (!textures.empty()) {
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, textures[0].id);
         glUniform1i(glGetUniformLocation(shader, "uTexture"), 0);
-        glUniform1i(useTextureLoc, 1);
     } else {
         glBindTexture(GL_TEXTURE_2D, 0);
-        glUniform1i(useTextureLoc, 0);
-        glUniform4f(colorLoc, 1.0f, 0.5f, 0.2f, 1.0f);
+        glUniform4f(glGetUniformLocation(shader, "uColor"), 1.0f, 0.5f, 0.2f, 1.0f);
     }
 
-    glBindVertexArray(this->VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
+    glBindVertexArray(vertexArray);
+    glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)(indexOffset * sizeof(unsigned int)), baseVertex);
     glBindVertexArray(0);
 
     glActiveTexture(GL_TEXTURE0);
@@ -375,81 +445,6 @@ void Mesh::Draw(GLuint& shader, const glm::mat4& view, const glm::mat4& projecti
 
 
 
-void checkShaderCompileErrors(GLuint shader, const std::string& type) {
-    GLint success;
-    GLchar infoLog[1024];
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(shader, 1024, nullptr, infoLog);
-        std::cerr << "| ERROR::SHADER-COMPILATION-ERROR of type: " << type << "\n" << infoLog << std::endl;
-    }
-}
-
-void checkProgramLinkErrors(GLuint program) {
-    GLint success;
-    GLchar infoLog[1024];
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(program, 1024, nullptr, infoLog);
-        std::cerr << "| ERROR::PROGRAM-LINKING-ERROR\n" << infoLog << std::endl;
-    }
-}
-
-const char* LoadShaderFromFile(const char* fileName) {
-    std::ifstream inputFile(fileName);
-    if (!inputFile.is_open()) {
-        std::cerr << "Failed to load the shader from file: " << fileName << "\n";
-        return nullptr;
-    }
-
-    std::string source((std::istreambuf_iterator<char>(inputFile)),
-                        std::istreambuf_iterator<char>());
-    inputFile.close();
-
-    char* shaderSource = new char[source.size() + 1];
-    std::copy(source.begin(), source.end(), shaderSource);
-    shaderSource[source.size()] = '\0';
-
-    return shaderSource;
-}
-
-GLuint compileShader(GLenum type, const char* source) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, nullptr);
-    glCompileShader(shader);
-    
-    return shader;
-}
-
-GLuint createShaderProgram() {
-    const char* vertexShaderSource = LoadShaderFromFile("shaders/vertex.shader");
-    const char* fragmentShaderSource = LoadShaderFromFile("shaders/fragment.shader");
-    
-    if (!vertexShaderSource || !fragmentShaderSource) {
-        std::cerr << "Failed to load shader source files.\n";
-        return 0;
-    }
-
-    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-    checkShaderCompileErrors(vertexShader, "VERTEX");
-    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-    checkShaderCompileErrors(fragmentShader, "FRAGMENT");
-
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    checkProgramLinkErrors(shaderProgram);
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    delete[] vertexShaderSource;
-    delete[] fragmentShaderSource;
-
-    return shaderProgram;
-}
-
 void drawTriangle3D(GLuint shaderProgram, 
                     glm::vec3 pos, 
                     glm::vec3 scale,
@@ -502,15 +497,8 @@ void drawTriangle3D(GLuint shaderProgram,
 
     glUseProgram(shaderProgram);
 
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, pos);
-    model = glm::rotate(model, rotation, glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::scale(model, scale);
-
-    glm::mat4 mvp = projection * view * model;
-
-    GLint mvpLoc = glGetUniformLocation(shaderProgram, "uMVP");
-    glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
+    glm::mat4 model = ComposeTransform(pos, glm::vec3(0.0f, rotation, 0.0f), scale);
+    SetTransformUniforms(shaderProgram, { model, projection * view * model, glm::mat4(AffineNormalMatrix(model)) });
 
     GLint colorLoc = glGetUniformLocation(shaderProgram, "uColor");
     glUniform4f(colorLoc, color.r, color.g, color.b, color.a);
@@ -520,6 +508,83 @@ void drawTriangle3D(GLuint shaderProgram,
     glBindVertexArray(0);
 }
 
+// Casts a ray through the cursor against the scene BVH, refining candidates
+// with each mesh's triangle BVH in object space.
+bool pickSceneObject(GLFWwindow* window, const Camera& camera, const SceneBVH& sceneBVH,
+                     std::vector<SceneObject>& scene, SceneRayHit& hit) {
+    double cursorX, cursorY;
+    int width, height;
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+    glfwGetWindowSize(window, &width, &height);
+    if (width == 0 || height == 0)
+        return false;
+
+    glm::vec2 ndc(2.0f * (float)cursorX / width - 1.0f, 1.0f - 2.0f * (float)cursorY / height);
+    glm::mat4 invViewProj = glm::inverse(camera.projection * camera.view);
+    glm::vec4 nearPoint = invViewProj * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+    glm::vec4 farPoint = invViewProj * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+    return sceneBVH.raycast(origin, direction, 1000.0f, hit, [&](uint32_t index, float maxT) {
+        SceneObject& object = scene[index];
+        // An affine transform keeps the ray parameter, so object-space t is world-space t.
+        glm::mat4 invModel = AffineInverse(SceneObjectModel(object));
+        Ray ray;
+        ray.origin = glm::vec3(invModel * glm::vec4(origin, 1.0f));
+        ray.direction = glm::vec3(invModel * glm::vec4(direction, 0.0f));
+        ray.tMin = 0.0f;
+        ray.tMax = maxT;
+        RayHit meshHit;
+        return GetMeshBVH(*object.mesh).intersectClosest(ray, meshHit) ? meshHit.t : -1.0f;
+    });
+}
+
+// Rasterizes the largest on-screen objects as occluders and drops every
+// visible object hidden behind them.
+void softwareOcclusionCull(SoftwareOcclusion& occlusion, const Camera& camera, std::vector<SceneObject>& scene,
+                           std::vector<uint32_t>& visible, size_t maxOccluders) {
+    occlusion.beginFrame(camera.projection * camera.view);
+
+    std::vector<std::pair<float, uint32_t>> candidates;
+    for (uint32_t index : visible) {
+        const BoundingSphere& sphere = scene[index].worldSphere;
+        float distance = glm::max(glm::length(sphere.center - cameraPos), 1e-3f);
+        candidates.push_back({ sphere.radius / distance, index });
+    }
+    size_t occluderCount = std::min(maxOccluders, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + occluderCount, candidates.end(),
+                      [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    for (size_t i = 0; i < occluderCount; ++i) {
+        SceneObject& object = scene[candidates[i].second];
+        occlusion.addOccluder(GetMeshOccluder(*object.mesh), SceneObjectModel(object));
+    }
+    occlusion.rasterize();
+    occlusion.filterVisible(scene, visible);
+}
+
+// A side x side field of copies of the mesh behind the car, each scaled to
+// about one unit across and turned by a hashed angle.
+std::vector<glm::mat4> makeInstanceGrid(const Mesh& mesh, int side) {
+    std::vector<glm::mat4> models;
+    models.reserve(static_cast<size_t>(side) * side);
+    float scale = mesh.sphere.radius > 0.0f ? 0.5f / mesh.sphere.radius : 1.0f;
+    const float spacing = 1.5f;
+    for (int z = 0; z < side; ++z) {
+        for (int x = 0; x < side; ++x) {
+            uint32_t hash = static_cast<uint32_t>(x * 73856093) ^ static_cast<uint32_t>(z * 19349663);
+            float angle = glm::radians(static_cast<float>(hash % 360u));
+            glm::vec3 position((x - side * 0.5f) * spacing, 0.5f, -4.0f - z * spacing);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+            model = glm::rotate(model, angle, glm::vec3(0.0f, 1.0f, 0.0f));
+            model = glm::scale(model, glm::vec3(scale));
+            models.push_back(glm::translate(model, -mesh.sphere.center));
+        }
+    }
+    return models;
+}
+
 Camera cameraUpdate() {
     Camera cam;
 
@@ -599,18 +664,18 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
 }
 
 
-GLuint LoadTextureFromFile(const char* filepath) {
+// Decodes the image into an existing texture name, mipmaps included, so
+// anything holding the name sees the new contents.
+bool UploadTextureFile(GLuint textureID, const char* filepath) {
     int width, height, nrChannels;
     stbi_set_flip_vertically_on_load(true);
     unsigned char* data = stbi_load(filepath, &width, &height, &nrChannels, 0);
 
     if (!data) {
         std::cerr << "Failed to load texture: " << filepath << std::endl;
-        return 0;
+        return false;
     }
 
-    GLuint textureID;
-    glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_2D, textureID);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -628,13 +693,23 @@ GLuint LoadTextureFromFile(const char* filepath) {
     else {
         std::cerr << "Unsupported number of channels for texture: " << nrChannels << " in " << filepath << std::endl;
         stbi_image_free(data);
-        return 0;
+        return false;
     }
 
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
 
     stbi_image_free(data);
+    return true;
+}
+
+GLuint LoadTextureFromFile(const char* filepath) {
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    if (!UploadTextureFile(textureID, filepath)) {
+        glDeleteTextures(1, &textureID);
+        return 0;
+    }
     return textureID;
 }
 
@@ -732,22 +807,12 @@ void drawPlane3D(GLuint shaderProgram,
 
     glUseProgram(shaderProgram);
 
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, pos);
-    model = glm::rotate(model, rotation, glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::scale(model, scale);
-
-    glm::mat4 mvp = projection * view * model;
-
-    GLint mvpLoc = glGetUniformLocation(shaderProgram, "uMVP");
-    glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
+    glm::mat4 model = ComposeTransform(pos, glm::vec3(0.0f, rotation, 0.0f), scale);
+    SetTransformUniforms(shaderProgram, { model, projection * view * model, glm::mat4(AffineNormalMatrix(model)) });
 
     GLint colorLoc = glGetUniformLocation(shaderProgram, "uColor");
     glUniform4f(colorLoc, color.r, color.g, color.b, color.a);
 
-    GLint useTextureLoc = glGetUniformLocation(shaderProgram, "uUseTexture");
-    glUniform1i(useTextureLoc, 0);
-
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     glBindVertexArray(0);
@@ -834,63 +899,38 @@ void drawSphere3D(GLuint shaderProgram,
 
     glUseProgram(shaderProgram);
 
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, pos);
-    model = glm::rotate(model, rotation, glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::scale(model, scale);
-
-    glm::mat4 mvp = projection * view * model;
-
-    GLint mvpLoc = glGetUniformLocation(shaderProgram, "uMVP");
-    glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
+    glm::mat4 model = ComposeTransform(pos, glm::vec3(0.0f, rotation, 0.0f), scale);
+    SetTransformUniforms(shaderProgram, { model, projection * view * model, glm::mat4(AffineNormalMatrix(model)) });
 
     GLint colorLoc = glGetUniformLocation(shaderProgram, "uColor");
     glUniform4f(colorLoc, color.r, color.g, color.b, color.a);
 
-    GLint useTextureLoc = glGetUniformLocation(shaderProgram, "uUseTexture");
-    glUniform1i(useTextureLoc, 0);
-
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, vertexCount);
     glBindVertexArray(0);
 }
 
-void ShadowInit(const unsigned int SHADOW_WIDTH, const unsigned int SHADOW_HEIGHT) {
-    GLuint depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
-
-    GLuint depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = {1.0, 1.0, 1.0, 1.0};
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-}
-
 int main() {
-    const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
+    const int SHADOW_SIZE = 1024;
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW!" << std::endl;
         return -1;
     }
     
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
-    GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Straing", NULL, NULL);
+    // Ask for the newest core context first; 3.3 is the baseline everything
+    // else falls back to.
+    const int contextVersions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 3 }, { 3, 3 } };
+    GLFWwindow* window = NULL;
+    for (const auto& version : contextVersions) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Straing", NULL, NULL);
+        if (window)
+            break;
+    }
     if (!window) {
         std::cerr << "Failed to create GLFW window!" << std::endl;
         glfwTerminate();
@@ -905,12 +945,24 @@ int main() {
         std::cerr << "Failed to initialize GLAD!" << std::endl;
         return -1;
     }
-
-    GLuint shaderProgram = createShaderProgram();
-    if (shaderProgram == 0) {
+    LoadGLExtras((GLADloadproc)glfwGetProcAddress);
+
+    // Forward shading, one variant per material feature set, compiled on first use.
+    ShaderVariants forwardShader({ { GL_VERTEX_SHADER, "shaders/vertex.shader" },
+                                   { GL_FRAGMENT_SHADER, "shaders/fragment.shader" },
+                                   { GL_FRAGMENT_SHADER, "shaders/sunshadow.fragment.shader" } },
+                                 ShaderFeatureTextured, "#define SUN_SHADOWS\n");
+    if (forwardShader.get(0) == 0) {
         glfwTerminate();
         return -1;
     }
+
+    ShaderVariants boundingBoxShader({ { GL_VERTEX_SHADER, "shaders/boundingbox.vertex.shader" },
+                                       { GL_FRAGMENT_SHADER, "shaders/boundingbox.fragment.shader" } },
+                                     0);
+    OcclusionQueries occlusionQueries;
+    occlusionQueries.init(boundingBoxShader);
+    bool useOcclusionQueries = false;
     
     float rotation = 0;
 
@@ -920,18 +972,107 @@ int main() {
     cameraPos.y = 1.53258f;
     cameraPos.z = 5.0f;
 
-    ShadowInit(SHADOW_WIDTH, SHADOW_HEIGHT);
+    CascadedShadowMaps shadowMaps;
+    shadowMaps.init(SHADOW_SIZE);
+    ResourceTicket shadowMapResource = GetResourceManager().add("Shadow maps", ResourceCategory::RenderTarget,
+                                                                shadowMaps.getBytes());
+    OmniShadowMaps pointShadowMaps;
+    pointShadowMaps.init(SHADOW_SIZE / 2);
+    ResourceTicket pointShadowResource = GetResourceManager().add("Point light shadow maps", ResourceCategory::RenderTarget,
+                                                                  pointShadowMaps.getBytes());
 
     Mesh Skull = LoadMeshFromOBJ("models/skull.obj");
+    GenerateMeshLODs(Skull);
 
     //GLuint skullTexture = LoadTextureFromFile("models/Skull.jpg");
-    //Skull.textures.push_back({ skullTexture, "diffuse", "models/Skull.jpg" });
+    //Skull.textures.push_back({ GLTexture(skullTexture), "diffuse", "models/Skull.jpg" });
 
     //Mesh TeaPot = LoadMeshFromGLTF("models/teapot/scene.gltf");
     
     //Mesh BuildingModel = LoadMeshFromGLTF("models/building/scene.gltf");
 
     Mesh CarModel = LoadMeshFromGLTF("models/car/scene.gltf");
+    GenerateMeshLODs(CarModel);
+    GetMeshMeshlets(CarModel);
+
+    TrackMeshResources(Skull, "models/skull.obj");
+    TrackMeshResources(CarModel, "models/car/scene.gltf");
+
+    GeometryPool geometryPool;
+    geometryPool.add(CarModel);
+    ResourceTicket geometryPoolResource = GetResourceManager().add("Geometry pool", ResourceCategory::Pool, 0);
+    bool useGeometryPool = true;
+    IndirectRenderer indirectRenderer;
+    if (GetGLCapabilities().multiDrawIndirect)
+        indirectRenderer.init(geometryPool);
+    bool useIndirect = indirectRenderer.isReady();
+
+    GPUInstanceCuller instanceCuller;
+    // The culler's vertex arrays hold on to the skull's buffer names.
+    if (instanceCuller.init(Skull))
+        PinMeshResources(Skull, true);
+
+    // Load-time processing is done. Picking and software occlusion still
+    // need the car's positions; nothing reads the skull's on the CPU.
+    ApplyMeshResidency(CarModel, MeshResidency::CollisionOnly);
+    ApplyMeshResidency(Skull, MeshResidency::DropAfterUpload);
+    bool useInstancedPopulation = false;
+    int populationSide = 64;
+    int uploadedPopulationSide = 0;
+
+    std::vector<SceneObject> scene;
+    scene.push_back({ &CarModel, glm::vec3(-6.0f, 0.0f, 0.0f), glm::vec3(0.0f, rotation, 0.0f), glm::vec3(1.0f), {}, {}, true, SceneBVH::NullNode, 0 });
+
+    FrustumCuller frustumCuller;
+    SceneBVH sceneBVH;
+    std::vector<uint32_t> visibleObjects;
+    bool useHierarchicalCulling = true;
+    std::future<std::string> bvhBenchmark;
+    std::string bvhBenchmarkReport;
+    SoftwareOcclusion softwareOcclusion;
+    bool useSoftwareOcclusion = true;
+    bool showOcclusionBuffer = false;
+    GLTexture occlusionDebugTexture;
+    std::vector<unsigned char> occlusionDebugPixels;
+    bool useLOD = true;
+    float lodErrorPixels = 1.0f;
+    uint64_t lodTriangles = 0, fullTriangles = 0;
+    MeshletCuller meshletCuller;
+    bool useClusterCulling = true;
+    std::future<std::string> meshletBenchmark;
+    std::string meshletBenchmarkReport;
+    // World, MVP and normal matrices of every scene object, refreshed once
+    // per frame instead of per draw.
+    TransformSystem transforms;
+    bool useSIMDTransforms = true;
+    std::future<std::string> transformBenchmark;
+    std::string transformBenchmarkReport;
+    int resourceBudgetMB = 0;
+    ShaderVariants depthShader({ { GL_VERTEX_SHADER, "shaders/depth.vertex.shader" },
+                                 { GL_FRAGMENT_SHADER, "shaders/depth.fragment.shader" } },
+                               0);
+    bool useDepthPrepass = false;
+    bool useFrontToBack = true;
+    bool usePositionStream = true;
+    GPUTimers gpuTimers;
+    DeferredRenderer deferredRenderer;
+    deferredRenderer.init();
+    ResourceTicket deferredResource = GetResourceManager().add("Deferred targets", ResourceCategory::RenderTarget, 0);
+    ClusteredLighting clusteredLighting;
+    clusteredLighting.init();
+    // Forward is the original single-light shader; the others add the point lights.
+    enum LightingPath { LightingForward, LightingDeferred, LightingClustered };
+    int lightingPath = LightingForward;
+    std::vector<PointLight> lights;
+    int lightCount = 256;
+    glm::vec3 sunDirection(-0.4f, -1.0f, -0.3f);
+    bool useShadows = true;
+    bool usePointShadows = true;
+    // Last shadow pass and lighting pass timings seen with each filter, for comparison.
+    float shadowFilterMs[2][2] = {};
+    bool pickHeld = false;
+    bool hasPick = false;
+    SceneRayHit pick{};
 
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -940,9 +1081,138 @@ int main() {
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330");
 
+    const ProgramBinaryStats& startupPrograms = GetProgramBinaryStats();
+    std::cout << "Startup shaders: " << startupPrograms.loaded << " from cached binaries (" << startupPrograms.loadMs
+              << " ms), " << startupPrograms.compiled << " compiled (" << startupPrograms.compileMs << " ms)" << std::endl;
+
+    // Edits under shaders/ and models/ are picked up while running. Programs
+    // are rebuilt by the shader cache; meshes and textures load on the worker
+    // and are swapped in from its callbacks, so the frame never waits on disk
+    // or the compiler.
+    FileWatcher fileWatcher;
+    bool useHotReload = fileWatcher.init({ "shaders", "models" });
+    GLWorker glWorker;
+    glWorker.init(window);
+    struct MeshSource {
+        Mesh* mesh;
+        const char* path;
+        bool gltf;
+    };
+    const MeshSource meshSources[] = { { &Skull, "models/skull.obj", false }, { &CarModel, "models/car/scene.gltf", true } };
+    std::vector<std::string> changedFiles;
+    uint32_t meshReloads = 0, textureReloads = 0, assetReloadFailures = 0;
+
+    auto runReload = [&](std::function<void()> job, std::function<void()> done) {
+        if (glWorker.isReady()) {
+            glWorker.submit(std::move(job), std::move(done));
+        } else {
+            job();
+            done();
+        }
+    };
+
+    auto reloadMesh = [&](const MeshSource& source) {
+        auto fresh = std::make_shared<Mesh>();
+        std::string path = source.path;
+        bool gltf = source.gltf;
+        bool buildMeshlets = source.mesh->meshlets != nullptr;
+        runReload(
+            [fresh, path, gltf, buildMeshlets]() {
+                // A half-written file makes the OBJ loader throw; the worker has
+                // no handler, so leave the mesh empty and keep the old one.
+                try {
+                    *fresh = gltf ? LoadMeshFromGLTF(path) : LoadMeshFromOBJ(path);
+                } catch (const std::exception& e) {
+                    std::cerr << e.what() << "\n";
+                    *fresh = Mesh();
+                }
+                if (!fresh->vertices.empty()) {
+                    GenerateMeshLODs(*fresh);
+                    if (buildMeshlets)
+                        fresh->meshlets = std::make_shared<MeshletSet>(BuildMeshlets(*fresh));
+                }
+                // Vertex arrays belong to the context that made them.
+                GLuint arrays[] = { fresh->VAO.detach(), fresh->depthVAO.detach() };
+                glDeleteVertexArrays(2, arrays);
+            },
+            [&, fresh, source]() {
+                Mesh& mesh = *source.mesh;
+                if (fresh->vertices.empty()) {
+                    std::cerr << "Keeping the previous " << source.path << "\n";
+                    assetReloadFailures++;
+                    return;
+                }
+                bool pooled = geometryPool.find(&mesh) != nullptr;
+                if (pooled)
+                    geometryPool.remove(mesh);
+                bool culled = &mesh == &Skull && instanceCuller.isReady();
+                if (culled)
+                    instanceCuller.destroy();
+                MeshResidency policy = mesh.residency;
+                mesh.gpuResources.clear();
+
+                // Safe against the meshlet benchmark: it runs on its own copy
+                // of the car, so no task reads a scene mesh while it is replaced.
+                mesh = std::move(*fresh);
+                mesh.bindVertexArrays();
+                UploadMeshletBuffers(mesh);
+                if (pooled)
+                    geometryPool.add(mesh);
+                TrackMeshResources(mesh, source.path);
+                if (culled) {
+                    if (instanceCuller.init(mesh))
+                        PinMeshResources(mesh, true);
+                    uploadedPopulationSide = 0;
+                }
+                ApplyMeshResidency(mesh, policy);
+                for (SceneObject& object : scene) {
+                    if (object.mesh == &mesh)
+                        object.dirty = true;
+                }
+                // Same bounds, new shape: the cached static layers cannot tell.
+                // The cube maps are redrawn every frame and need nothing.
+                shadowMaps.invalidate();
+                meshReloads++;
+            });
+    };
+
+    auto reloadChangedFile = [&](const std::string& file) {
+        std::filesystem::path changed = std::filesystem::path(file).lexically_normal();
+        if (changed.extension() == ".shader") {
+            GetShaderProgramCache().reload(changed.generic_string(), &glWorker);
+            return;
+        }
+        for (const MeshSource& source : meshSources) {
+            std::filesystem::path modelPath = std::filesystem::path(source.path).lexically_normal();
+            if (changed == modelPath ||
+                (source.gltf && changed.extension() == ".bin" && changed.parent_path() == modelPath.parent_path())) {
+                reloadMesh(source);
+                continue;
+            }
+            for (Texture& texture : source.mesh->textures) {
+                if (std::filesystem::path(texture.path).lexically_normal() != changed)
+                    continue;
+                // Decoded into the same name, so nothing holding it needs updating.
+                TouchMeshResources(*source.mesh);
+                GLuint textureID = texture.id;
+                auto uploaded = std::make_shared<bool>(false);
+                runReload([textureID, file, uploaded]() { *uploaded = UploadTextureFile(textureID, file.c_str()); },
+                          [&, uploaded]() { *uploaded ? textureReloads++ : assetReloadFailures++; });
+            }
+        }
+    };
+
     while (!glfwWindowShouldClose(window)) {
         inputHandler(window);
 
+        glWorker.pump();
+        GetShaderProgramCache().update();
+        changedFiles.clear();
+        if (useHotReload)
+            fileWatcher.poll(changedFiles);
+        for (const std::string& file : changedFiles)
+            reloadChangedFile(file);
+
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -957,10 +1227,245 @@ int main() {
         //BuildingModel.Draw(shaderProgram, currentCamera.view, currentCamera.projection, 
         //                   glm::vec3(-2.0f, 0.0f, 0.0f), 0.0f, rotation, 0.0f, glm::vec3(1.0f));
         
-        drawPlane3D(shaderProgram, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(100.0f, 100.0f, 100.0f), 0, {1, 1, 1}, currentCamera.view, currentCamera.projection);
-       
-        CarModel.Draw(shaderProgram, currentCamera.view, currentCamera.projection, 
-                           glm::vec3(-6.0f, 0.0f, 0.0f), 0.0f, rotation, 0.0f, glm::vec3(1.0f));
+        // The lit paths draw the ground with their own shaders so it receives shadows.
+        auto drawGround = [&](GLuint program) {
+            drawPlane3D(program, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(100.0f, 100.0f, 100.0f), 0, {1, 1, 1},
+                        currentCamera.view, currentCamera.projection);
+        };
+
+        Frustum frustum = ExtractFrustum(currentCamera.projection * currentCamera.view);
+        if (frustumCuller.size() != scene.size()) {
+            frustumCuller.resize(scene.size());
+            transforms.resize(scene.size());
+            for (SceneObject& object : scene)
+                object.dirty = true;
+        }
+        for (size_t i = 0; i < scene.size(); ++i) {
+            SceneObject& object = scene[i];
+            if (!object.dirty)
+                continue;
+            UpdateSceneObjectBounds(object);
+            frustumCuller.set(i, object.worldBounds, object.worldSphere);
+            transforms.set(i, object.position, object.rotation, object.scale);
+            if (object.bvhProxy == SceneBVH::NullNode)
+                object.bvhProxy = sceneBVH.insert(object.worldBounds, static_cast<uint32_t>(i));
+            else
+                sceneBVH.update(object.bvhProxy, object.worldBounds);
+            object.dirty = false;
+        }
+        transforms.setSIMD(useSIMDTransforms);
+        transforms.update(currentCamera.projection * currentCamera.view);
+
+        visibleObjects.clear();
+        if (useHierarchicalCulling)
+            sceneBVH.cullFrustum(frustum, visibleObjects);
+        else
+            frustumCuller.cull(frustum, visibleObjects);
+
+        if (useSoftwareOcclusion)
+            softwareOcclusionCull(softwareOcclusion, currentCamera, scene, visibleObjects, 8);
+
+        bool pickPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (pickPressed && !pickHeld && !io.WantCaptureMouse)
+            hasPick = pickSceneObject(window, currentCamera, sceneBVH, scene, pick);
+        pickHeld = pickPressed;
+
+        int framebufferWidth = 0, framebufferHeight = 0;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        LODSelection lodSelection = MakeLODSelection(currentCamera.projection, framebufferHeight, lodErrorPixels);
+        lodTriangles = fullTriangles = 0;
+        for (uint32_t index : visibleObjects) {
+            SceneObject& object = scene[index];
+            object.lod = useLOD ? SelectLOD(object, cameraPos, lodSelection) : 0;
+            TouchMeshResources(*object.mesh);
+            fullTriangles += object.mesh->indexCount / 3;
+            lodTriangles += object.lod > 0 ? object.mesh->lods[object.lod].indexCount / 3 : object.mesh->indexCount / 3;
+        }
+
+        // Queued before the scene so the readback in draw() rarely waits.
+        if (useInstancedPopulation && instanceCuller.isReady()) {
+            if (uploadedPopulationSide != populationSide) {
+                instanceCuller.setInstances(makeInstanceGrid(Skull, populationSide));
+                uploadedPopulationSide = populationSide;
+            }
+            instanceCuller.cull(currentCamera.projection * currentCamera.view, cameraPos, lodSelection);
+        }
+
+        meshletCuller.beginFrame();
+        // depthOnly sets only the MVP and picks the position-only vertex
+        // arrays where they exist.
+        auto drawObjectWith = [&](uint32_t index, const ShaderVariants& shader, bool depthOnly) {
+            SceneObject& object = scene[index];
+            const ObjectMatrices& matrices = transforms.get(index);
+            GLuint program = shader.get(MeshShaderFeatures(*object.mesh));
+            bool positionStream = depthOnly && usePositionStream;
+            auto draw = [&](GLuint vertexArray, GLsizei indexCount, size_t indexOffset, GLint baseVertex) {
+                if (depthOnly)
+                    object.mesh->DrawDepth(program, matrices.mvp, vertexArray, indexCount, indexOffset, baseVertex);
+                else
+                    object.mesh->DrawIndexed(program, matrices, vertexArray, indexCount, indexOffset, baseVertex);
+            };
+            // Clusters are built from the full-detail mesh, so they only replace LOD 0.
+            if (useClusterCulling && object.lod == 0 && object.mesh->meshlets) {
+                MeshletSet& meshlets = *object.mesh->meshlets;
+                size_t indexCount = meshletCuller.cull(meshlets, matrices.world, currentCamera.projection * currentCamera.view,
+                                                       cameraPos, lodSelection.pixelsPerUnit);
+                if (indexCount > 0) {
+                    GLuint vertexArray = positionStream && meshlets.depthVAO ? meshlets.depthVAO : meshlets.VAO;
+                    draw(vertexArray, static_cast<GLsizei>(indexCount), 0, 0);
+                }
+                return;
+            }
+            const PooledMesh* pooled = useGeometryPool ? geometryPool.find(object.mesh) : nullptr;
+            if (pooled) {
+                const MeshLOD& lod = pooled->lods[std::min<size_t>(std::max(object.lod, 0), pooled->lods.size() - 1)];
+                draw(positionStream ? geometryPool.getDepthVertexArray() : geometryPool.getVertexArray(),
+                     static_cast<GLsizei>(lod.indexCount), pooled->firstIndex + lod.indexOffset, pooled->baseVertex);
+                return;
+            }
+            const Mesh& mesh = *object.mesh;
+            GLsizei count = static_cast<GLsizei>(mesh.indexCount);
+            size_t offset = 0;
+            if (object.lod > 0 && object.lod < static_cast<int>(mesh.lods.size())) {
+                count = static_cast<GLsizei>(mesh.lods[object.lod].indexCount);
+                offset = mesh.lods[object.lod].indexOffset;
+            }
+            draw(positionStream && mesh.depthVAO ? mesh.depthVAO : mesh.VAO, count, offset, 0);
+        };
+        auto drawObject = [&](uint32_t index) { drawObjectWith(index, forwardShader, false); };
+        // Full detail from the position stream: the cached static layers
+        // outlive any one frame's LOD choice.
+        auto drawShadowCaster = [&](uint32_t index, GLuint program, const glm::mat4& viewProjection) {
+            const SceneObject& object = scene[index];
+            Mesh& mesh = *object.mesh;
+            TouchMeshResources(mesh);
+            glm::mat4 mvp = viewProjection * transforms.get(index).world;
+            const PooledMesh* pooled = useGeometryPool ? geometryPool.find(&mesh) : nullptr;
+            if (pooled) {
+                mesh.DrawDepth(program, mvp, geometryPool.getDepthVertexArray(),
+                               static_cast<GLsizei>(pooled->lods[0].indexCount), pooled->firstIndex, pooled->baseVertex);
+            } else if (mesh.VAO) {
+                mesh.DrawDepth(program, mvp, mesh.depthVAO ? mesh.depthVAO : mesh.VAO,
+                               static_cast<GLsizei>(mesh.indexCount), 0);
+            }
+        };
+
+        auto sortFrontToBack = [&]() {
+            std::sort(visibleObjects.begin(), visibleObjects.end(), [&](uint32_t a, uint32_t b) {
+                return glm::length(scene[a].worldSphere.center - cameraPos) - scene[a].worldSphere.radius <
+                       glm::length(scene[b].worldSphere.center - cameraPos) - scene[b].worldSphere.radius;
+            });
+        };
+        // Grouping by mesh keeps texture changes to one per mesh.
+        auto sortByMesh = [&]() {
+            std::sort(visibleObjects.begin(), visibleObjects.end(),
+                      [&](uint32_t a, uint32_t b) { return std::less<const Mesh*>()(scene[a].mesh, scene[b].mesh); });
+        };
+
+        gpuTimers.beginFrame();
+        // Every path, indirect and the GPU-culled population included, is lit
+        // by the sun and receives its shadows.
+        deferredRenderer.sunDirection = clusteredLighting.sunDirection = indirectRenderer.sunDirection = sunDirection;
+        deferredRenderer.shadows = clusteredLighting.shadows = useShadows ? &shadowMaps : nullptr;
+        indirectRenderer.shadows = instanceCuller.shadows = useShadows ? &shadowMaps : nullptr;
+        instanceCuller.sunDirection = sunDirection;
+        if (useShadows) {
+            gpuTimers.begin("Shadows");
+            shadowMaps.update(scene, currentCamera.view, currentCamera.projection, sunDirection, drawShadowCaster);
+            GetResourceManager().setBytes(shadowMapResource.get(), shadowMaps.getBytes());
+        }
+        // Set every frame, as the other paths fall back to forward when they
+        // are unavailable. Uniforms are per program, so every variant a draw
+        // may pick gets them.
+        uint32_t forwardFeatures = forwardShader.getSupportedFeatures();
+        for (uint32_t features = 0; features <= forwardFeatures; ++features) {
+            GLuint program = (features & ~forwardFeatures) == 0 ? forwardShader.get(features) : 0;
+            if (program == 0)
+                continue;
+            glUseProgram(program);
+            BindForwardSunUniforms(useShadows ? &shadowMaps : nullptr, program, sunDirection, cameraPos, 4);
+        }
+        if (lightingPath == LightingForward) {
+            drawGround(forwardShader.get(0));
+        } else {
+            const BoundingSphere& bounds = scene[0].worldSphere;
+            AnimateLightField(lights, static_cast<size_t>(lightCount), bounds.center, bounds.radius * 1.5f,
+                              static_cast<float>(glfwGetTime()));
+            // Only the deferred light volumes sample the cube maps.
+            bool drawPointShadows = usePointShadows && lightingPath == LightingDeferred;
+            deferredRenderer.pointShadows = drawPointShadows ? &pointShadowMaps : nullptr;
+            if (drawPointShadows) {
+                gpuTimers.begin("Point shadows");
+                pointShadowMaps.update(lights, scene, currentCamera.projection * currentCamera.view, cameraPos,
+                                       drawShadowCaster);
+            }
+        }
+        if (lightingPath == LightingDeferred && deferredRenderer.isReady()) {
+            deferredRenderer.resize(framebufferWidth, framebufferHeight);
+            GetResourceManager().setBytes(deferredResource.get(), deferredRenderer.getStats().targetBytes);
+
+            if (useGeometryPool)
+                sortByMesh();
+            gpuTimers.begin("G-buffer");
+            deferredRenderer.beginGeometry();
+            drawGround(deferredRenderer.getGeometryShader().get(0));
+            for (uint32_t index : visibleObjects)
+                drawObjectWith(index, deferredRenderer.getGeometryShader(), false);
+            gpuTimers.begin("Lighting");
+            deferredRenderer.resolve(lights, currentCamera.view, currentCamera.projection, cameraPos);
+        } else if (lightingPath == LightingClustered && clusteredLighting.isReady()) {
+            // Binned on the CPU while the GPU is still busy with the last frame.
+            clusteredLighting.update(lights, currentCamera.view, currentCamera.projection, framebufferWidth, framebufferHeight);
+            if (useFrontToBack)
+                sortFrontToBack();
+            else if (useGeometryPool)
+                sortByMesh();
+            gpuTimers.begin("Opaque");
+            clusteredLighting.bind(cameraPos);
+            drawGround(clusteredLighting.getShader().get(0));
+            for (uint32_t index : visibleObjects)
+                drawObjectWith(index, clusteredLighting.getShader(), false);
+        } else if (useIndirect) {
+            gpuTimers.begin("Opaque");
+            indirectRenderer.render(scene, transforms, visibleObjects, currentCamera.projection * currentCamera.view,
+                                    cameraPos);
+        } else if (useOcclusionQueries) {
+            gpuTimers.begin("Opaque");
+            occlusionQueries.render(scene, visibleObjects, currentCamera.projection * currentCamera.view, cameraPos, drawObject);
+        } else if (useDepthPrepass) {
+            // Depth only, nearest first so later occluded fragments fail early.
+            sortFrontToBack();
+            gpuTimers.begin("Depth pre-pass");
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            for (uint32_t index : visibleObjects)
+                drawObjectWith(index, depthShader, true);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+            // Each pixel is now shaded exactly once, so order only matters
+            // for state changes. Cluster culling runs again, count it once.
+            if (useGeometryPool)
+                sortByMesh();
+            meshletCuller.beginFrame();
+            gpuTimers.begin("Opaque");
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+            for (uint32_t index : visibleObjects)
+                drawObject(index);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+        } else {
+            if (useFrontToBack)
+                sortFrontToBack();
+            else if (useGeometryPool)
+                sortByMesh();
+            gpuTimers.begin("Opaque");
+            for (uint32_t index : visibleObjects)
+                drawObject(index);
+        }
+        gpuTimers.end();
+        geometryPool.compact();
+        if (useInstancedPopulation && instanceCuller.isReady())
+            instanceCuller.draw(currentCamera.projection * currentCamera.view, cameraPos);
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -968,6 +1473,312 @@ int main() {
         
         ImGui::Begin("Debug");
             ImGui::Text("CameraSpeed: %f", cameraSpeed);
+            ImGui::Checkbox("Hierarchical culling (BVH)", &useHierarchicalCulling);
+            if (useHierarchicalCulling) {
+                const SceneBVHStats& bvhStats = sceneBVH.getStats();
+                ImGui::Text("Frustum culling: %u visible, %u culled, %u nodes visited (height %d)",
+                            bvhStats.visible, static_cast<uint32_t>(scene.size()) - bvhStats.visible,
+                            bvhStats.nodesVisited, sceneBVH.getHeight());
+            } else {
+                const CullingStats& cullStats = frustumCuller.getStats();
+                ImGui::Text("Frustum culling: %u visible, %u culled", cullStats.visible, cullStats.culled);
+            }
+
+            ImGui::Checkbox("Software occlusion culling", &useSoftwareOcclusion);
+            if (useSoftwareOcclusion) {
+                const SoftwareOcclusionStats& occlusionStats = softwareOcclusion.getStats();
+                ImGui::Text("Occluders: %u (%u triangles), raster %.3f ms", occlusionStats.occluders,
+                            occlusionStats.occluderTriangles, occlusionStats.rasterMs);
+                ImGui::Text("Occlusion: %u tested, %u hidden, test %.3f ms", occlusionStats.tested,
+                            occlusionStats.occluded, occlusionStats.testMs);
+                ImGui::Checkbox("Show occlusion buffer", &showOcclusionBuffer);
+                if (showOcclusionBuffer) {
+                    int bufferWidth = softwareOcclusion.getWidth(), bufferHeight = softwareOcclusion.getHeight();
+                    const std::vector<float>& depth = softwareOcclusion.getDepth();
+                    occlusionDebugPixels.resize(depth.size());
+                    for (size_t i = 0; i < depth.size(); ++i)
+                        occlusionDebugPixels[i] = static_cast<unsigned char>(glm::clamp(1.0f - depth[i], 0.0f, 1.0f) * 255.0f);
+
+                    if (occlusionDebugTexture == 0) {
+                        occlusionDebugTexture = GLTexture::create();
+                        glBindTexture(GL_TEXTURE_2D, occlusionDebugTexture);
+                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                        GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+                        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+                    }
+                    glBindTexture(GL_TEXTURE_2D, occlusionDebugTexture);
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, bufferWidth, bufferHeight, 0, GL_RED, GL_UNSIGNED_BYTE, occlusionDebugPixels.data());
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                    glBindTexture(GL_TEXTURE_2D, 0);
+                    // Row 0 is the bottom of the screen, so flip V.
+                    ImGui::Image((ImTextureID)(intptr_t)occlusionDebugTexture.get(), ImVec2((float)bufferWidth * 2.0f, (float)bufferHeight * 2.0f),
+                                 ImVec2(0.0f, 1.0f), ImVec2(1.0f, 0.0f));
+                }
+            }
+
+            ImGui::Checkbox("Geometry pool (base-vertex draws)", &useGeometryPool);
+            if (useGeometryPool) {
+                GeometryPoolStats poolStats = geometryPool.getStats();
+                ImGui::Text("Pool: %u meshes, vertices %u / %u, indices %u / %u", poolStats.meshes, poolStats.verticesUsed,
+                            poolStats.vertexCapacity, poolStats.indicesUsed, poolStats.indexCapacity);
+                ImGui::Text("Pool: %u free blocks, %u grows, %u compaction moves", poolStats.freeBlocks, poolStats.grows,
+                            poolStats.moves);
+            }
+
+            if (indirectRenderer.isReady()) {
+                ImGui::Checkbox("GPU-driven multi-draw indirect", &useIndirect);
+                if (useIndirect) {
+                    const IndirectStats& indirectStats = indirectRenderer.getStats();
+                    ImGui::Text("Indirect: %u draws in %u multi-draw calls (overrides queries and cluster culling)",
+                                indirectStats.draws, indirectStats.multiDrawCalls);
+                }
+            } else {
+                ImGui::Text("Multi-draw indirect: unavailable (OpenGL %d.%d)", GetGLCapabilities().major, GetGLCapabilities().minor);
+            }
+
+            if (instanceCuller.isReady()) {
+                ImGui::Checkbox("GPU-culled instance field", &useInstancedPopulation);
+                if (useInstancedPopulation) {
+                    ImGui::SliderInt("Field side", &populationSide, 8, 128);
+                    const GPUCullingStats& gpuStats = instanceCuller.getStats();
+                    ImGui::Text("Instances: %u of %u visible in %u instanced draws", gpuStats.visible, gpuStats.instances,
+                                gpuStats.drawCalls);
+                    for (int level = 0; level < GPUCullingMaxLevels; ++level) {
+                        if (gpuStats.levelInstances[level] == 0)
+                            continue;
+                        ImGui::SameLine();
+                        ImGui::Text("L%d: %u", level, gpuStats.levelInstances[level]);
+                    }
+                }
+            }
+
+            const char* lightingPaths[] = { "Forward (single light)", "Deferred", "Clustered forward" };
+            ImGui::Combo("Lighting", &lightingPath, lightingPaths, IM_ARRAYSIZE(lightingPaths));
+            if (lightingPath != LightingForward)
+                ImGui::SliderInt("Point lights", &lightCount, 0, 1024);
+            ImGui::SliderFloat3("Sun direction", &sunDirection.x, -1.0f, 1.0f);
+            if (glm::length(sunDirection) < 0.01f)
+                sunDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+            ImGui::Checkbox("Cascaded sun shadows", &useShadows);
+            if (useShadows && shadowMaps.isReady()) {
+                const ShadowStats& shadowStats = shadowMaps.getStats();
+                ImGui::SameLine();
+                ImGui::Checkbox("Cache static casters", &shadowMaps.cacheStatic);
+                ImGui::SliderFloat("Shadow distance", &shadowMaps.shadowDistance, 5.0f, 200.0f);
+                ImGui::Text("Casters: %u static, %u moving; per cascade %u / %u / %u / %u", shadowStats.staticCasters,
+                            shadowStats.dynamicCasters, shadowStats.cascadeCasters[0], shadowStats.cascadeCasters[1],
+                            shadowStats.cascadeCasters[2], shadowStats.cascadeCasters[3]);
+                ImGui::Text("Static layers redrawn: %u, copied: %u, draw calls: %u, GPU %.3f ms",
+                            shadowStats.staticRedraws, shadowStats.copies, shadowStats.drawCalls,
+                            gpuTimers.getMs("Shadows"));
+                int filter = static_cast<int>(shadowMaps.filter);
+                const char* filters[] = { "PCF 3x3", "EVSM prefiltered" };
+                if (ImGui::Combo("Shadow filter", &filter, filters, IM_ARRAYSIZE(filters)))
+                    shadowMaps.filter = static_cast<ShadowFilter>(filter);
+                if (shadowMaps.filter == ShadowFilter::EVSM) {
+                    ImGui::SliderInt("Blur radius", &shadowMaps.blurRadius, 0, 8);
+                    ImGui::Text("Cascades prefiltered this frame: %u", shadowStats.prefiltered);
+                }
+                float* filterMs = shadowFilterMs[static_cast<int>(shadowMaps.filter)];
+                filterMs[0] = gpuTimers.getMs("Shadows");
+                filterMs[1] = gpuTimers.getMs(lightingPath == LightingDeferred ? "Lighting" : "Opaque");
+                ImGui::Text("Shadow pass / shading: PCF %.3f / %.3f ms, EVSM %.3f / %.3f ms", shadowFilterMs[0][0],
+                            shadowFilterMs[0][1], shadowFilterMs[1][0], shadowFilterMs[1][1]);
+            }
+            if (lightingPath == LightingDeferred) {
+                if (!deferredRenderer.isReady()) {
+                    ImGui::Text("Deferred renderer unavailable");
+                } else {
+                    const DeferredStats& deferredStats = deferredRenderer.getStats();
+                    ImGui::Checkbox("Stencil-culled light volumes", &deferredRenderer.stencilCulling);
+                    ImGui::Text("Lights: %u drawn, %u culled, %u stencil-tested, %u around camera",
+                                deferredStats.lights - deferredStats.culled, deferredStats.culled,
+                                deferredStats.stencilTested, deferredStats.cameraInside);
+                    ImGui::Text("GPU: G-buffer %.3f ms, lighting %.3f ms; targets %.1f MB", gpuTimers.getMs("G-buffer"),
+                                gpuTimers.getMs("Lighting"), deferredStats.targetBytes / (1024.0 * 1024.0));
+                    if (pointShadowMaps.isReady()) {
+                        ImGui::Checkbox("Point light shadows", &usePointShadows);
+                        if (usePointShadows) {
+                            const OmniShadowStats& omniStats = pointShadowMaps.getStats();
+                            ImGui::SameLine();
+                            ImGui::SliderInt("Shadowed lights", &pointShadowMaps.maxLights, 0, OmniShadowMaps::MaxLights);
+                            float perLight = omniStats.shadowedLights > 0 ? float(omniStats.drawCalls) / omniStats.shadowedLights : 0.0f;
+                            ImGui::Text("Draw calls per light: %.1f (%.1f as six passes), %u face routes, %u casters culled",
+                                        perLight, perLight * 6.0f, omniStats.faceRoutes, omniStats.culledCasters);
+                            ImGui::Text("GPU: point shadows %.3f ms", gpuTimers.getMs("Point shadows"));
+                        }
+                    }
+                }
+            } else if (lightingPath == LightingClustered) {
+                if (!clusteredLighting.isReady()) {
+                    ImGui::Text("Clustered lighting unavailable");
+                } else {
+                    const ClusteredStats& clusterStats = clusteredLighting.getStats();
+                    ImGui::Checkbox("Show lights per cluster", &clusteredLighting.showClusterLoad);
+                    ImGui::Text("Clusters: %u of %d occupied, %u light indices, at most %u per cluster",
+                                clusterStats.occupiedClusters, ClusteredLighting::ClusterCount, clusterStats.lightIndices,
+                                clusterStats.maxClusterLights);
+                    ImGui::Text("Binning %.3f ms (CPU), opaque %.3f ms (GPU)", clusterStats.binMs, gpuTimers.getMs("Opaque"));
+                }
+            }
+
+            ImGui::Checkbox("Depth pre-pass", &useDepthPrepass);
+            ImGui::SameLine();
+            ImGui::Checkbox("Front-to-back order", &useFrontToBack);
+            ImGui::Checkbox("Position-only depth stream", &usePositionStream);
+            if (lightingPath == LightingDeferred || useIndirect || useOcclusionQueries)
+                ImGui::Text("Pre-pass and ordering apply to direct drawing only");
+            float depthMs = useDepthPrepass ? gpuTimers.getMs("Depth pre-pass") : 0.0f;
+            float opaqueMs = gpuTimers.getMs("Opaque");
+            ImGui::Text("GPU: depth pre-pass %.3f ms, opaque %.3f ms, total %.3f ms", depthMs, opaqueMs,
+                        std::max(depthMs, 0.0f) + std::max(opaqueMs, 0.0f));
+
+            ImGui::Checkbox("Hardware occlusion queries", &useOcclusionQueries);
+            if (useOcclusionQueries) {
+                const OcclusionQueryStats& queryStats = occlusionQueries.getStats();
+                ImGui::Text("Queries: %u drawn, %u skipped, %u conditional", queryStats.drawn, queryStats.skipped,
+                            queryStats.conditionalDraws);
+                ImGui::Text("Issued: %u box, %u geometry", queryStats.boxQueries, queryStats.geometryQueries);
+            }
+
+            ImGui::Checkbox("Mesh LOD", &useLOD);
+            if (useLOD) {
+                ImGui::SliderFloat("LOD max error (px)", &lodErrorPixels, 0.25f, 8.0f);
+                ImGui::Text("Triangles: %llu of %llu", static_cast<unsigned long long>(lodTriangles),
+                            static_cast<unsigned long long>(fullTriangles));
+                if (ImGui::CollapsingHeader("LOD levels")) {
+                    for (const MeshSource& source : meshSources) {
+                        ImGui::Text("%s", source.path);
+                        const std::vector<MeshLOD>& levels = source.mesh->lods;
+                        for (size_t level = 0; level < levels.size(); ++level) {
+                            ImGui::Text("  %zu: %u triangles, error %.4f", level, levels[level].indexCount / 3,
+                                        levels[level].error);
+                        }
+                    }
+                }
+            }
+
+            ImGui::Checkbox("Cluster culling", &useClusterCulling);
+            if (useClusterCulling) {
+                ImGui::Checkbox("Cluster frustum", &meshletCuller.frustumCulling);
+                ImGui::SameLine();
+                ImGui::Checkbox("Cluster backface", &meshletCuller.backfaceCulling);
+                ImGui::SameLine();
+                ImGui::Checkbox("Small clusters", &meshletCuller.smallClusterCulling);
+                const MeshletCullStats& clusterStats = meshletCuller.getStats();
+                ImGui::Text("Clusters: %u tested, %u frustum, %u backface, %u small, %.3f ms", clusterStats.clusters,
+                            clusterStats.frustumCulled, clusterStats.backfaceCulled, clusterStats.smallCulled, clusterStats.cullMs);
+                ImGui::Text("Cluster triangles: %llu of %llu", static_cast<unsigned long long>(clusterStats.trianglesSubmitted),
+                            static_cast<unsigned long long>(clusterStats.triangles));
+            }
+            bool meshletBenchmarkRunning = meshletBenchmark.valid();
+            if (meshletBenchmarkRunning && meshletBenchmark.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                meshletBenchmarkReport = meshletBenchmark.get();
+                std::cout << meshletBenchmarkReport;
+                meshletBenchmarkRunning = false;
+            }
+            if (meshletBenchmarkRunning) {
+                ImGui::Text("Meshlet benchmark running...");
+            } else if (ImGui::Button("Run meshlet culling benchmark")) {
+                // The car keeps only collision data, so its full arrays come
+                // back from the cache into a CPU-only copy; the task never
+                // touches CarModel itself.
+                auto snapshot = std::make_shared<Mesh>();
+                if (RestoreMeshCPUData(CarModel)) {
+                    snapshot->vertices = CarModel.vertices;
+                    snapshot->indices = CarModel.indices;
+                    ReleaseMeshCPUData(CarModel);
+                }
+                snapshot->bounds = CarModel.bounds;
+                snapshot->sphere = CarModel.sphere;
+                meshletBenchmark = std::async(std::launch::async, [snapshot]() { return BenchmarkMeshletCulling(*snapshot); });
+            }
+            if (!meshletBenchmarkReport.empty())
+                ImGui::TextUnformatted(meshletBenchmarkReport.c_str());
+
+            ImGui::Checkbox("SIMD transforms", &useSIMDTransforms);
+            const TransformStats& transformStats = transforms.getStats();
+            ImGui::Text("Transforms: %u objects in %.3f ms", transformStats.objects, transformStats.updateMs);
+            bool transformBenchmarkRunning = transformBenchmark.valid();
+            if (transformBenchmarkRunning && transformBenchmark.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                transformBenchmarkReport = transformBenchmark.get();
+                std::cout << transformBenchmarkReport;
+                transformBenchmarkRunning = false;
+            }
+            if (transformBenchmarkRunning) {
+                ImGui::Text("Transform benchmark running...");
+            } else if (ImGui::Button("Run transform benchmark")) {
+                transformBenchmark = std::async(std::launch::async, BenchmarkTransforms, size_t(100000));
+            }
+            if (!transformBenchmarkReport.empty())
+                ImGui::TextUnformatted(transformBenchmarkReport.c_str());
+
+            GPUResourceManager& resources = GetResourceManager();
+            ImGui::SliderInt("VRAM budget (MB, 0 = off)", &resourceBudgetMB, 0, 1024);
+            resources.budgetBytes = static_cast<size_t>(resourceBudgetMB) << 20;
+            const ResourceStats& resourceStats = resources.getStats();
+            ImGui::Text("GPU memory: %.2f MB resident, %.2f MB evicted, %u evictions, %u restores",
+                        resourceStats.residentTotal / 1048576.0, resourceStats.evictedBytes / 1048576.0,
+                        resourceStats.evictions, resourceStats.restores);
+            for (int category = 0; category < static_cast<int>(ResourceCategory::Count); ++category) {
+                ImGui::Text("  %s: %.2f MB", ResourceCategoryName(static_cast<ResourceCategory>(category)),
+                            resourceStats.residentBytes[category] / 1048576.0);
+            }
+            if (ImGui::CollapsingHeader("GPU resources")) {
+                resources.forEach([](const ResourceInfo& info) {
+                    ImGui::Text("%-13s %9.1f KB %s%s  %s", ResourceCategoryName(info.category), info.bytes / 1024.0,
+                                info.resident ? "resident" : "evicted ", info.pinned ? " pinned" : "", info.owner.c_str());
+                });
+            }
+            ImGui::Text("GL names awaiting release: %zu", GetGLReleaseQueue().getPendingCount());
+            const ShaderCacheStats& shaderStats = GetShaderProgramCache().getStats();
+            ImGui::Text("Shader variants: %u programs, %u compiles (%u failed) in %.1f ms", shaderStats.programs,
+                        shaderStats.compiles, shaderStats.failures, shaderStats.compileMs);
+            const ProgramBinaryStats& binaryStats = GetProgramBinaryStats();
+            if (GetGLCapabilities().programBinary) {
+                ImGui::Text("Program binaries: %u loaded in %.1f ms, %u compiled in %.1f ms, %u saved, %u rejected",
+                            binaryStats.loaded, binaryStats.loadMs, binaryStats.compiled, binaryStats.compileMs,
+                            binaryStats.saved, binaryStats.rejected);
+            } else {
+                ImGui::Text("Program binaries unsupported: %u compiled in %.1f ms", binaryStats.compiled,
+                            binaryStats.compileMs);
+            }
+            if (fileWatcher.isReady()) {
+                ImGui::Checkbox("Hot reload shaders and models", &useHotReload);
+                ImGui::Text("Reloaded: %u programs (%u failed, %u building), %u meshes, %u textures (%u failed), %zu jobs queued",
+                            shaderStats.reloads, shaderStats.reloadFailures, shaderStats.reloadsPending, meshReloads,
+                            textureReloads, assetReloadFailures, glWorker.getPendingCount());
+            } else {
+                ImGui::Text("Hot reload unavailable: no file watching on this platform");
+            }
+
+            const char* residencyNames[] = { "Keep CPU data", "Drop after upload", "Collision only" };
+            int carResidency = static_cast<int>(CarModel.residency);
+            if (ImGui::Combo("Car CPU residency", &carResidency, residencyNames, IM_ARRAYSIZE(residencyNames)))
+                ApplyMeshResidency(CarModel, static_cast<MeshResidency>(carResidency));
+            ImGui::Text("CPU geometry: car %.2f MB, skull %.2f MB", MeshCPUBytes(CarModel) / 1048576.0,
+                        MeshCPUBytes(Skull) / 1048576.0);
+
+            if (hasPick)
+                ImGui::Text("Picked object %u at distance %.3f", pick.userData, pick.t);
+            else
+                ImGui::Text("Picked object: none (left click to pick)");
+
+            bool benchmarkRunning = bvhBenchmark.valid();
+            if (benchmarkRunning && bvhBenchmark.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                bvhBenchmarkReport = bvhBenchmark.get();
+                std::cout << bvhBenchmarkReport;
+                benchmarkRunning = false;
+            }
+            if (benchmarkRunning) {
+                ImGui::Text("Scene BVH benchmark running...");
+            } else if (ImGui::Button("Run scene BVH benchmark")) {
+                bvhBenchmark = std::async(std::launch::async, BenchmarkSceneBVH);
+            }
+            if (!bvhBenchmarkReport.empty())
+                ImGui::TextUnformatted(bvhBenchmarkReport.c_str());
         ImGui::End();
 
         ImGui::Render();
@@ -975,9 +1786,28 @@ int main() {
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+        GeometryPoolStats poolUsage = geometryPool.getStats();
+        GetResourceManager().setBytes(geometryPoolResource.get(), poolUsage.vertexCapacity * (sizeof(Vertex) + sizeof(glm::vec3)) +
+                                                                  poolUsage.indexCapacity * sizeof(unsigned int));
+        GetResourceManager().endFrame();
+        GetGLReleaseQueue().endFrame();
     }
 
-    glDeleteProgram(shaderProgram);
+    glWorker.destroy();
+    fileWatcher.destroy();
+    occlusionQueries.destroy();
+    indirectRenderer.destroy();
+    geometryPool.destroy();
+    instanceCuller.destroy();
+    gpuTimers.destroy();
+    deferredRenderer.destroy();
+    clusteredLighting.destroy();
+    shadowMaps.destroy();
+    pointShadowMaps.destroy();
+    occlusionDebugTexture.reset();
+    GetShaderProgramCache().clear();
+    // Handles still alive past this point (the meshes) go with the context.
+    GetGLReleaseQueue().shutdown();
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -0,0 +1,87 @@
+#version 330 core
+
+out vec4 FragColor;
+
+in vec3 Normal;
+in vec2 TexCoords;
+
+#ifdef STRAING_TEXTURED
+uniform sampler2D uTexture;
+#else
+uniform vec4 uColor;
+#endif
+uniform float uRoughness = 0.6;
+uniform float uMetal = 0.0;
+
+uniform usamplerBuffer uClusterGrid;   // first index, count
+uniform usamplerBuffer uLightIndices;
+uniform samplerBuffer uLightData;      // position + radius, colour
+uniform ivec3 uClusterCount;
+uniform vec2 uTileSize;
+uniform vec2 uDepthRange;              // near, far
+uniform vec2 uSliceScaleBias;
+uniform mat4 uInverseViewProjection;
+uniform vec2 uInvScreenSize;
+uniform vec3 uViewPos;
+uniform vec3 uSunDirection;
+uniform vec3 uSunColor;
+uniform float uAmbient;
+uniform bool uShowClusterLoad;
+
+// In sunshadow.fragment.shader, linked in alongside.
+float SunShadow(vec3 position, vec3 normal);
+
+// Same model as deferredlight.fragment.shader.
+vec3 Shade(vec3 albedo, float metal, float roughness, vec3 normal, vec3 toLight, vec3 toView, vec3 radiance)
+{
+    float nDotL = max(dot(normal, toLight), 0.0);
+    vec3 halfway = normalize(toLight + toView);
+    float a = max(roughness * roughness, 0.002);
+    float exponent = 2.0 / (a * a) - 2.0;
+    float specular = (exponent + 8.0) / 8.0 * pow(max(dot(normal, halfway), 0.0), exponent);
+    vec3 specularColor = mix(vec3(0.04), albedo, metal);
+    vec3 diffuse = albedo * (1.0 - metal);
+    return (diffuse + specularColor * specular) * radiance * nDotL;
+}
+
+void main()
+{
+#ifdef STRAING_TEXTURED
+    vec3 albedo = texture(uTexture, TexCoords).rgb;
+#else
+    vec3 albedo = uColor.rgb;
+#endif
+    vec3 normal = normalize(gl_FrontFacing ? Normal : -Normal);
+
+    vec4 world = uInverseViewProjection * vec4(vec3(gl_FragCoord.xy * uInvScreenSize, gl_FragCoord.z) * 2.0 - 1.0, 1.0);
+    vec3 position = world.xyz / world.w;
+    vec3 toView = normalize(uViewPos - position);
+
+    // View depth from the window depth, then the exponential slice.
+    float nearPlane = uDepthRange.x, farPlane = uDepthRange.y;
+    float viewDepth = 2.0 * nearPlane * farPlane /
+                      (farPlane + nearPlane - (2.0 * gl_FragCoord.z - 1.0) * (farPlane - nearPlane));
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / uTileSize), int(log(viewDepth) * uSliceScaleBias.x + uSliceScaleBias.y));
+    cluster = clamp(cluster, ivec3(0), uClusterCount - 1);
+    uvec2 range = texelFetch(uClusterGrid, (cluster.z * uClusterCount.y + cluster.y) * uClusterCount.x + cluster.x).xy;
+
+    if (uShowClusterLoad) {
+        float load = clamp(float(range.y) / 32.0, 0.0, 1.0);
+        FragColor = vec4(mix(vec3(0.0, 0.0, 0.5), vec3(1.0, 0.2, 0.0), load) + albedo * 0.1, 1.0);
+        return;
+    }
+
+    vec3 color = uAmbient * albedo + Shade(albedo, uMetal, uRoughness, normal, -uSunDirection, toView,
+                                        uSunColor * SunShadow(position, normal));
+    for (uint i = 0u; i < range.y; ++i) {
+        int light = int(texelFetch(uLightIndices, int(range.x + i)).r);
+        vec4 sphere = texelFetch(uLightData, light * 2);
+        vec3 toLight = sphere.xyz - position;
+        float lightDistance = length(toLight);
+        float window = clamp(1.0 - pow(lightDistance / sphere.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (lightDistance * lightDistance + 1.0);
+        vec3 radiance = texelFetch(uLightData, light * 2 + 1).rgb * attenuation;
+        color += Shade(albedo, uMetal, uRoughness, normal, toLight / max(lightDistance, 1e-4), toView, radiance);
+    }
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+out vec4 FragColor;
+
+uniform sampler2D uLight;
+uniform sampler2D uDepth;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(uDepth, texel, 0).r;
+    // Leave the clear colour where nothing was drawn.
+    if (depth == 1.0)
+        discard;
+    FragColor = vec4(texelFetch(uLight, texel, 0).rgb, 1.0);
+    gl_FragDepth = depth;
+}
@@ -0,0 +1,90 @@
+#version 330 core
+
+// Sun and ambient by default; one point light with POINT_LIGHT defined.
+
+out vec4 FragColor;
+
+uniform sampler2D uAlbedoMetal;
+uniform sampler2D uNormalRoughness;
+uniform sampler2D uDepth;
+uniform mat4 uInverseViewProjection;
+uniform vec2 uInvScreenSize;
+uniform vec3 uViewPos;
+
+#ifdef POINT_LIGHT
+uniform vec3 uLightPosition;
+uniform float uLightRadius;
+uniform vec3 uLightColor;
+uniform samplerCubeShadow uPointShadow;
+uniform bool uPointShadowed;
+#else
+uniform vec3 uSunDirection;
+uniform vec3 uSunColor;
+uniform float uAmbient;
+#endif
+
+vec3 DecodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = clamp(-n.z, 0.0, 1.0);
+    n.x += n.x >= 0.0 ? -fold : fold;
+    n.y += n.y >= 0.0 ? -fold : fold;
+    return normalize(n);
+}
+
+#ifndef POINT_LIGHT
+// In sunshadow.fragment.shader, linked in alongside.
+float SunShadow(vec3 position, vec3 normal);
+#endif
+
+// Lambert plus normalized Blinn-Phong, metals tinting the highlight.
+vec3 Shade(vec3 albedo, float metal, float roughness, vec3 normal, vec3 toLight, vec3 toView, vec3 radiance)
+{
+    float nDotL = max(dot(normal, toLight), 0.0);
+    vec3 halfway = normalize(toLight + toView);
+    float a = max(roughness * roughness, 0.002);
+    float exponent = 2.0 / (a * a) - 2.0;
+    float specular = (exponent + 8.0) / 8.0 * pow(max(dot(normal, halfway), 0.0), exponent);
+    vec3 specularColor = mix(vec3(0.04), albedo, metal);
+    vec3 diffuse = albedo * (1.0 - metal);
+    return (diffuse + specularColor * specular) * radiance * nDotL;
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(uDepth, texel, 0).r;
+    if (depth == 1.0)
+        discard;
+
+    vec4 albedoMetal = texelFetch(uAlbedoMetal, texel, 0);
+    vec4 normalRoughness = texelFetch(uNormalRoughness, texel, 0);
+    vec3 normal = DecodeNormal(normalRoughness.xy);
+
+    vec4 clip = vec4(vec3(gl_FragCoord.xy * uInvScreenSize, depth) * 2.0 - 1.0, 1.0);
+    vec4 world = uInverseViewProjection * clip;
+    vec3 position = world.xyz / world.w;
+    vec3 toView = normalize(uViewPos - position);
+
+#ifdef POINT_LIGHT
+    vec3 toLight = uLightPosition - position;
+    float lightDistance = length(toLight);
+    // Windowed inverse square, exactly zero at the radius.
+    float window = clamp(1.0 - pow(lightDistance / uLightRadius, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (lightDistance * lightDistance + 1.0);
+    toLight /= max(lightDistance, 1e-4);
+    if (uPointShadowed) {
+        // Stored depth is distance over radius; bias more at grazing angles.
+        float bias = 0.004 + 0.02 * (1.0 - max(dot(normal, toLight), 0.0));
+        attenuation *= texture(uPointShadow, vec4(-toLight, lightDistance / uLightRadius - bias));
+    }
+    vec3 color = Shade(albedoMetal.rgb, albedoMetal.a, normalRoughness.z, normal, toLight, toView,
+                       uLightColor * attenuation);
+#else
+    vec3 color = uAmbient * albedoMetal.rgb +
+                 Shade(albedoMetal.rgb, albedoMetal.a, normalRoughness.z, normal, -uSunDirection, toView,
+                       uSunColor * SunShadow(position, normal));
+#endif
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+// Must produce bit-identical depth to vertex.shader for the GL_EQUAL color
+// pass, hence the same expression and the invariant qualifier in both.
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 uMVP;
+
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = uMVP * vec4(aPos, 1.0);
+}
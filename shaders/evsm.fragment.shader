@@ -0,0 +1,44 @@
+#version 330 core
+
+// One separable Gaussian pass over exponential variance shadow moments.
+// With FROM_DEPTH the source is a shadow map layer, warped to moments per tap.
+
+out vec4 FragColor;
+
+#ifdef FROM_DEPTH
+uniform sampler2DArray uDepth;
+uniform float uLayer;
+uniform vec2 uExponents;
+#else
+uniform sampler2D uSource;
+#endif
+uniform vec2 uStep;
+uniform float uInvResolution;
+uniform int uRadius;
+
+vec4 Fetch(vec2 uv)
+{
+#ifdef FROM_DEPTH
+    // Warp from [-1, 1] so the negative exponent sees the same range.
+    float depth = texture(uDepth, vec3(uv, uLayer)).r * 2.0 - 1.0;
+    float positive = exp(uExponents.x * depth);
+    float negative = -exp(-uExponents.y * depth);
+    return vec4(positive, positive * positive, negative, negative * negative);
+#else
+    return texture(uSource, uv);
+#endif
+}
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy * uInvResolution;
+    float sigma = max(float(uRadius) * 0.5, 0.5);
+    vec4 sum = Fetch(uv);
+    float weightSum = 1.0;
+    for (int i = 1; i <= uRadius; ++i) {
+        float weight = exp(-float(i * i) / (2.0 * sigma * sigma));
+        sum += (Fetch(uv + uStep * float(i)) + Fetch(uv - uStep * float(i))) * weight;
+        weightSum += 2.0 * weight;
+    }
+    FragColor = sum / weightSum;
+}
@@ -8,25 +8,38 @@ in vec2 TexCoords;
 
 uniform vec3 lightDir;
 uniform vec3 viewPos;
-uniform vec4 uColor;
+#ifdef STRAING_TEXTURED
 uniform sampler2D uTexture;
-uniform bool uUseTexture;
+#else
+uniform vec4 uColor;
+#endif
+#ifdef SUN_SHADOWS
+// The single light is the sun, which shadows.
+uniform vec3 uSunDirection;
+// In sunshadow.fragment.shader, linked in alongside.
+float SunShadow(vec3 position, vec3 normal);
+#endif
 
 void main()
 {
-    vec3 baseColor;
-    if (uUseTexture) {
-      baseColor = texture(uTexture, TexCoords).rgb;
-    } else {
-      baseColor = uColor.rgb;
-    }
+#ifdef STRAING_TEXTURED
+    vec3 baseColor = texture(uTexture, TexCoords).rgb;
+#else
+    vec3 baseColor = uColor.rgb;
+#endif
 
     // Ambient
     vec3 ambient = 1.2 * baseColor;
 
     // Diffuse
     vec3 norm = normalize(Normal);
+#ifdef SUN_SHADOWS
+    vec3 lightDir = normalize(uSunDirection);
+    float shadow = SunShadow(FragPos, norm);
+#else
     vec3 lightDir = normalize(lightDir - FragPos);
+    float shadow = 1.0;
+#endif
     float diff = max(dot(norm, -lightDir), 0.0);
     vec3 diffuse = diff * baseColor;
 
@@ -36,6 +49,6 @@ void main()
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
     vec3 specular = vec3(0.5) * spec;
 
-    vec3 result = ambient + diffuse + specular;
+    vec3 result = ambient + (diffuse + specular) * shadow;
     FragColor = vec4(result, 1.0);
 }
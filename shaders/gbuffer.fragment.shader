@@ -0,0 +1,39 @@
+#version 330 core
+
+layout (location = 0) out vec4 AlbedoMetal;
+layout (location = 1) out vec4 NormalRoughness;
+
+in vec3 Normal;
+in vec2 TexCoords;
+
+#ifdef STRAING_TEXTURED
+uniform sampler2D uTexture;
+#else
+uniform vec4 uColor;
+#endif
+// Meshes carry no material parameters yet.
+uniform float uRoughness = 0.6;
+uniform float uMetal = 0.0;
+
+// Octahedral mapping: the unit sphere folded onto [0, 1]^2.
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.xy * 0.5 + 0.5;
+}
+
+void main()
+{
+#ifdef STRAING_TEXTURED
+    vec3 baseColor = texture(uTexture, TexCoords).rgb;
+#else
+    vec3 baseColor = uColor.rgb;
+#endif
+    // Both faces are drawn; light the visible one.
+    vec3 normal = normalize(gl_FrontFacing ? Normal : -Normal);
+
+    AlbedoMetal = vec4(baseColor, uMetal);
+    NormalRoughness = vec4(EncodeNormal(normal), uRoughness, 0.0);
+}
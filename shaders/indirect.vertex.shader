@@ -0,0 +1,45 @@
+#version 430 core
+
+// IndirectRenderer picks the STRAING_DRAW_PARAMETERS variant when
+// gl_DrawIDARB is available. Without it, each command's baseInstance
+// picks the object through the instanced aDrawID attribute.
+#ifdef STRAING_DRAW_PARAMETERS
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+#ifndef STRAING_DRAW_PARAMETERS
+layout (location = 3) in uint aDrawID;
+#endif
+
+struct ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+uniform mat4 uViewProjection;
+uniform uint uDrawOffset;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+void main()
+{
+#ifdef STRAING_DRAW_PARAMETERS
+    ObjectData object = objects[uDrawOffset + uint(gl_DrawIDARB)];
+#else
+    ObjectData object = objects[aDrawID];
+#endif
+    vec4 worldPos = object.model * vec4(aPos, 1.0);
+    gl_Position = uViewProjection * worldPos;
+    FragPos = worldPos.xyz;
+    Normal = mat3(object.normalMatrix) * aNormal;
+    TexCoords = aTexCoords;
+}
@@ -0,0 +1,31 @@
+#version 330 core
+
+// GL 3.3 only has transform feedback stream 0, so the culler runs one pass
+// per LOD and this stage keeps the instances that belong to it.
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in vec4 vModel0[];
+in vec4 vModel1[];
+in vec4 vModel2[];
+in vec4 vModel3[];
+flat in int vLod[];
+
+uniform int uLod;
+
+out vec4 outModel0;
+out vec4 outModel1;
+out vec4 outModel2;
+out vec4 outModel3;
+
+void main()
+{
+    if (vLod[0] != uLod)
+        return;
+    outModel0 = vModel0[0];
+    outModel1 = vModel1[0];
+    outModel2 = vModel2[0];
+    outModel3 = vModel3[0];
+    EmitVertex();
+    EndPrimitive();
+}
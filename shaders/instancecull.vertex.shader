@@ -0,0 +1,56 @@
+#version 330 core
+
+// One point per instance. Tests the instance's bounding sphere against the
+// frustum and picks its LOD the same way SelectLOD does, minus hysteresis:
+// nothing persists between frames on the GPU side.
+layout (location = 0) in vec4 aModel0;
+layout (location = 1) in vec4 aModel1;
+layout (location = 2) in vec4 aModel2;
+layout (location = 3) in vec4 aModel3;
+
+const int MaxLevels = 8;
+
+uniform vec4 uPlanes[6];
+uniform vec4 uSphere;          // object-space center and radius
+uniform vec3 uCameraPos;
+uniform float uLodErrors[MaxLevels];
+uniform int uLodCount;
+uniform float uPixelsPerUnit;
+uniform float uMaxErrorPixels;
+
+out vec4 vModel0;
+out vec4 vModel1;
+out vec4 vModel2;
+out vec4 vModel3;
+flat out int vLod;
+
+void main()
+{
+    mat4 model = mat4(aModel0, aModel1, aModel2, aModel3);
+    vec3 center = (model * vec4(uSphere.xyz, 1.0)).xyz;
+    float scale = max(length(aModel0.xyz), max(length(aModel1.xyz), length(aModel2.xyz)));
+    float radius = uSphere.w * scale;
+
+    bool visible = true;
+    for (int i = 0; i < 6; ++i) {
+        if (dot(uPlanes[i].xyz, center) + uPlanes[i].w < -radius)
+            visible = false;
+    }
+
+    int lod = 0;
+    float distance = length(center - uCameraPos) - radius;
+    if (distance > 0.0) {
+        float pixelsPerError = uPixelsPerUnit * scale / distance;
+        for (int l = 1; l < uLodCount; ++l) {
+            if (uLodErrors[l] * pixelsPerError > uMaxErrorPixels)
+                break;
+            lod = l;
+        }
+    }
+
+    vModel0 = aModel0;
+    vModel1 = aModel1;
+    vModel2 = aModel2;
+    vModel3 = aModel3;
+    vLod = visible ? lod : -1;
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 uViewProjection;
+uniform vec3 uLightPosition;
+uniform float uVolumeRadius;
+
+void main()
+{
+    gl_Position = uViewProjection * vec4(uLightPosition + aPos * uVolumeRadius, 1.0);
+}
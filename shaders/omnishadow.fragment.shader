@@ -0,0 +1,12 @@
+#version 330 core
+
+in vec3 gWorld;
+
+uniform vec3 uLightPosition;
+uniform float uLightRadius;
+
+void main()
+{
+    // Linear distance, so lookups compare along the light ray directly.
+    gl_FragDepth = length(gWorld - uLightPosition) / uLightRadius;
+}
@@ -0,0 +1,37 @@
+#version 330 core
+
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+uniform mat4 uFaceMatrices[6];
+// Faces the CPU found the whole object touching.
+uniform int uFaceMask;
+
+in vec3 vWorld[];
+out vec3 gWorld;
+
+void main()
+{
+    for (int face = 0; face < 6; ++face) {
+        if ((uFaceMask & (1 << face)) == 0)
+            continue;
+        vec4 clip[3];
+        for (int i = 0; i < 3; ++i)
+            clip[i] = uFaceMatrices[face] * vec4(vWorld[i], 1.0);
+        // Skip the face if all three corners are beyond one of its planes.
+        bvec3 left = bvec3(clip[0].x < -clip[0].w, clip[1].x < -clip[1].w, clip[2].x < -clip[2].w);
+        bvec3 right = bvec3(clip[0].x > clip[0].w, clip[1].x > clip[1].w, clip[2].x > clip[2].w);
+        bvec3 bottom = bvec3(clip[0].y < -clip[0].w, clip[1].y < -clip[1].w, clip[2].y < -clip[2].w);
+        bvec3 top = bvec3(clip[0].y > clip[0].w, clip[1].y > clip[1].w, clip[2].y > clip[2].w);
+        bvec3 behind = bvec3(clip[0].w <= 0.0, clip[1].w <= 0.0, clip[2].w <= 0.0);
+        if (all(left) || all(right) || all(bottom) || all(top) || all(behind))
+            continue;
+        for (int i = 0; i < 3; ++i) {
+            gl_Layer = face;
+            gl_Position = clip[i];
+            gWorld = vWorld[i];
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+
+// The model matrix: casters are drawn with identity view and projection.
+uniform mat4 uMVP;
+
+out vec3 vWorld;
+
+void main()
+{
+    vWorld = vec3(uMVP * vec4(aPos, 1.0));
+}
@@ -0,0 +1,71 @@
+#version 330 core
+
+// Cascaded sun shadow lookup, linked as a second fragment shader into every
+// program that receives sun shadows. Callers declare
+//     float SunShadow(vec3 position, vec3 normal);
+// and BindShadowUniforms() sets everything below.
+
+uniform sampler2DArrayShadow uShadowMap;
+uniform int uShadowCascades;           // 0 without shadows
+uniform mat4 uShadowMatrices[4];
+uniform vec4 uCascadeSplits;           // far view depth of each cascade
+uniform vec4 uCascadeTexels;           // world size of one texel
+uniform mat4 uShadowView;
+uniform float uShadowTexelSize;
+uniform sampler2DArray uShadowMoments;
+uniform int uShadowFilter;             // 0 PCF, 1 EVSM
+uniform vec2 uShadowExponents;
+
+// Chebyshev bound on each warped moment pair; the tighter one wins, and the
+// bottom of the bound is cut off to hide light bleeding.
+float ChebyshevBound(vec2 moments, float depth, float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    float pMax = variance / (variance + d * d);
+    pMax = clamp((pMax - 0.2) / 0.8, 0.0, 1.0);
+    return depth <= moments.x ? 1.0 : pMax;
+}
+
+// The moments are mipmapped, so the lookup takes explicit gradients: it runs
+// after a per-pixel cascade choice, where implicit derivatives are undefined.
+float MomentShadow(vec3 coord, int cascade, vec2 gradX, vec2 gradY)
+{
+    vec4 moments = textureGrad(uShadowMoments, vec3(coord.xy, float(cascade)), gradX, gradY);
+    float depth = coord.z * 2.0 - 1.0;
+    float positive = exp(uShadowExponents.x * depth);
+    float negative = -exp(-uShadowExponents.y * depth);
+    vec2 depthScale = 0.0001 * uShadowExponents * vec2(positive, negative);
+    float lit = ChebyshevBound(moments.xy, positive, depthScale.x * depthScale.x);
+    return min(lit, ChebyshevBound(moments.zw, negative, depthScale.y * depthScale.y));
+}
+
+// Cascade by view depth, then 3x3 taps of hardware 2x2 PCF or one
+// filtered moments lookup.
+float SunShadow(vec3 position, vec3 normal)
+{
+    // Taken while every pixel of the quad is still here; the cascade
+    // matrices are affine, so they carry these over to texture space.
+    vec3 positionDx = dFdx(position), positionDy = dFdy(position);
+    if (uShadowCascades == 0)
+        return 1.0;
+    float viewDepth = -(uShadowView * vec4(position, 1.0)).z;
+    int cascade = 0;
+    while (cascade < uShadowCascades && viewDepth > uCascadeSplits[cascade])
+        ++cascade;
+    if (cascade == uShadowCascades)
+        return 1.0;
+    // Offsetting along the normal keeps grazing surfaces out of their own shadow.
+    vec4 coord = uShadowMatrices[cascade] * vec4(position + normal * uCascadeTexels[cascade] * 1.5, 1.0);
+    if (uShadowFilter == 1) {
+        vec2 gradX = (uShadowMatrices[cascade] * vec4(positionDx, 0.0)).xy;
+        vec2 gradY = (uShadowMatrices[cascade] * vec4(positionDy, 0.0)).xy;
+        return MomentShadow(coord.xyz, cascade, gradX, gradY);
+    }
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x)
+            lit += texture(uShadowMap, vec4(coord.xy + vec2(x, y) * uShadowTexelSize, float(cascade), coord.z));
+    }
+    return lit / 9.0;
+}
@@ -3,18 +3,47 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef STRAING_INSTANCED
+// Per-instance transform written by the culling pass.
+layout (location = 3) in vec4 aModel0;
+layout (location = 4) in vec4 aModel1;
+layout (location = 5) in vec4 aModel2;
+layout (location = 6) in vec4 aModel3;
 
+uniform mat4 uViewProjection;
+#else
 uniform mat4 uMVP;
 uniform mat4 uModel;
+// Inverse transpose of uModel's 3x3, computed once per object on the CPU.
+uniform mat3 uNormalMatrix;
+#endif
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
+#ifndef STRAING_INSTANCED
+// Matches depth.vertex.shader for the depth pre-pass.
+invariant gl_Position;
+#endif
+
 void main() 
 {
+#ifdef STRAING_INSTANCED
+    mat4 model = mat4(aModel0, aModel1, aModel2, aModel3);
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    gl_Position = uViewProjection * worldPos;
+    FragPos = worldPos.xyz;
+    // The cofactor matrix is the inverse transpose times the determinant:
+    // three cross products instead of an inverse, and the fragment shader
+    // normalizes anyway. The sign keeps mirrored instances facing out.
+    mat3 linear = mat3(model);
+    mat3 cofactor = mat3(cross(linear[1], linear[2]), cross(linear[2], linear[0]), cross(linear[0], linear[1]));
+    Normal = cofactor * aNormal * sign(dot(linear[0], cofactor[0]));
+#else
     gl_Position = uMVP * vec4(aPos, 1.0);
     FragPos = vec3(uModel * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(uModel))) * aNormal;
+    Normal = uNormalMatrix * aNormal;
+#endif
     TexCoords = aTexCoords;
 }